@@ -0,0 +1,81 @@
+#include "stdafx.h"
+#include "AdaptiveStepper.h"
+
+AdaptiveStepper::AdaptiveStepper(SimulatorBase* sim) :
+    sim_(sim), tcl_{ "./config/simulator.config" },
+    accepted_(0), rejected_(0), dt_min_used_(0.0), dt_max_used_(0.0)
+{
+    tolerance_ = tcl_.get_value("Adaptive_Tolerance");
+    dt_min_ = tcl_.get_value("Adaptive_Min_Step");
+    dt_max_ = std::max(tcl_.get_value("Adaptive_Max_Step"), static_cast<float>(dt_min_));
+    dt_ = dt_min_;
+}
+
+// one step of h from start_, returns its error estimate.
+double AdaptiveStepper::trial(double h)
+{
+    sim_->step(h);
+    double error = sim_->step_error();
+    if (error >= 0.0)
+        return error;
+
+    // step doubling.
+    sim_->get_state(full_);
+    sim_->set_state(start_);
+    sim_->step(0.5 * h);
+    sim_->step(0.5 * h);
+    auto &p = sim_->get_position();
+    error = 0.0;
+    for (size_t vi = 0; vi < p.size(); ++vi)
+        error = std::max(error, static_cast<double>((p[vi] - full_.position[vi]).norm()));
+    return error;
+}
+
+// dt_ rounded to quantum * 2^k, halved while above the bound or the rest of
+// the interval. A rest below that still gets one step of its own.
+double AdaptiveStepper::quantize(double h, double remaining) const
+{
+    const double q = sim_->step_quantum();
+    if (q > 0.0)
+    {
+        h = q * std::pow(2.0, std::round(std::log2(h / q)));
+        while (h > dt_max_ * (1.0 + 1e-9) || (h > remaining * (1.0 + 1e-9) && h > 2.0 * dt_min_))
+            h *= 0.5;
+    }
+    return std::min(h, remaining);
+}
+
+void AdaptiveStepper::advance(double interval)
+{
+    double remaining = interval;
+    while (remaining > 1e-12)
+    {
+        double h = quantize(dt_, remaining);
+        sim_->get_state(start_);
+        double error = trial(h);
+
+        double factor = error > 0.0 ? 0.9 * std::sqrt(tolerance_ / error) : 2.0;
+        factor = std::min(std::max(factor, 0.2), 2.0);
+        // quantized, a retry has to go at least one level down.
+        const bool quantized = sim_->step_quantum() > 0.0;
+        if (error <= tolerance_ || h <= dt_min_ || (quantized && h < 2.0 * dt_min_))
+        {
+            remaining -= h;
+            if (accepted_++ == 0)
+                dt_min_used_ = dt_max_used_ = h;
+            dt_min_used_ = std::min(dt_min_used_, h);
+            dt_max_used_ = std::max(dt_max_used_, h);
+            // a step cut short by the interval says little about growing.
+            if (h < dt_ && factor > 1.0)
+                continue;
+        }
+        else
+        {
+            sim_->set_state(start_);
+            ++rejected_;
+            if (quantized)
+                factor = std::min(factor, 0.5);
+        }
+        dt_ = std::min(std::max(h * factor, dt_min_), dt_max_);
+    }
+}
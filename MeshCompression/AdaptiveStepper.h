@@ -0,0 +1,42 @@
+#pragma once
+#include "SimulatorBase.h"
+#include "TextConfigLoader.h"
+
+// Advances a simulator over an interval with steps chosen by the local error.
+//
+// The error of a step is the simulator's embedded estimate (Euler against
+// midpoint), or else step doubling: one step of h against two of h/2, the
+// two half steps are kept. A step with error above the tolerance is rolled
+// back and retried smaller, the next step is scaled by 0.9 sqrt(tol / err)
+// within [1/5, 2], for a first order local error, and kept in the bounds.
+// For a simulator with a step_quantum(), the step is rounded to the nearest
+// quantum * 2^k, so it goes between a few cached factorizations.
+class AdaptiveStepper
+{
+public:
+    explicit AdaptiveStepper(SimulatorBase *sim);
+    void advance(double interval);
+
+    long long accepted() const { return accepted_; }
+    long long rejected() const { return rejected_; }
+    double dt() const { return dt_; }
+    double dt_min_used() const { return dt_min_used_; }
+    double dt_max_used() const { return dt_max_used_; }
+
+private:
+    double trial(double h);
+    double quantize(double h, double remaining) const;
+
+    SimulatorBase *sim_;
+    TextConfigLoader tcl_;
+    double tolerance_;
+    double dt_min_;
+    double dt_max_;
+    double dt_;                     // next step to try.
+    long long accepted_;
+    long long rejected_;
+    double dt_min_used_;
+    double dt_max_used_;
+    SimState start_;
+    SimState full_;
+};
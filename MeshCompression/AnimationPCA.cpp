@@ -0,0 +1,229 @@
+#include "stdafx.h"
+#include "AnimationPCA.h"
+#include <Eigen/QR>
+#include <Eigen/Eigenvalues>
+#include <cstring>
+
+using Eigen::MatrixXf;
+using Eigen::VectorXf;
+using RowMatrixXf = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// Leading k left singular vectors of A (randomized range finder,
+// Halko et al. 2011), so only (k + oversampling) columns are ever factorized.
+static MatrixXf _principal_components(const MatrixXf &A, int k)
+{
+    const int l = std::min(k + 8, static_cast<int>(std::min(A.rows(), A.cols())));
+    MatrixXf Q = A * MatrixXf::Random(A.cols(), l);
+    for (int it = 0; it < 3; ++it)
+    {
+        Eigen::HouseholderQR<MatrixXf> qr(Q);
+        Q = qr.householderQ() * MatrixXf::Identity(A.rows(), l);
+        if (it < 2)
+            Q = A * (A.transpose() * Q);
+    }
+    MatrixXf B = Q.transpose() * A;
+    Eigen::SelfAdjointEigenSolver<MatrixXf> es(B * B.transpose());
+    // eigenvalues are ascending.
+    return Q * es.eigenvectors().rightCols(k).rowwise().reverse();
+}
+
+// value i of a stream of `bits` bit values, least significant bit first.
+// The stream is padded by 2 bytes, so 3 bytes can always be read.
+static void _put_bits(std::vector<uchar> &b, qint64 i, int bits, quint32 v)
+{
+    const qint64 pos = i * bits;
+    for (int k = 0; k < bits; ++k)
+        if (v >> k & 1)
+            b[(pos + k) >> 3] |= static_cast<uchar>(1 << ((pos + k) & 7));
+}
+
+static quint32 _get_bits(const uchar *b, qint64 i, int bits)
+{
+    const qint64 pos = i * bits;
+    const uchar *p = b + (pos >> 3);
+    quint32 w = p[0] | (static_cast<quint32>(p[1]) << 8) | (static_cast<quint32>(p[2]) << 16);
+    return (w >> (pos & 7)) & ((1u << bits) - 1);
+}
+
+static qint64 _packed_size(qint64 n, int bits)
+{
+    return (n * bits + 7) / 8 + 2;
+}
+
+bool CompressAnimation(const QString& trajectory, const QString& output,
+    int n_components, int bits, const ConsoleMessageManager& msg)
+{
+    TrajectoryPlayer player;
+    if (!player.open(trajectory) || player.n_frames() == 0)
+    {
+        msg.log("cannot read trajectory: ", trajectory, ERROR_MSG);
+        return false;
+    }
+    bits = std::min(std::max(bits, 1), 16);
+
+    // STEP 1:  Frames as columns.
+    const int D = 3 * player.n_vertices();
+    const int F = player.n_frames();
+    const int k = std::min(n_components, std::min(D, F));
+    MatrixXf X(D, F);
+    std::vector<double> times(F);
+    std::vector<Vector3f> position;
+    for (int fi = 0; fi < F; ++fi)
+    {
+        player.frame(fi, times[fi], position);
+        for (int vi = 0; vi < player.n_vertices(); ++vi)
+            X.block<3, 1>(3 * vi, fi) = position[vi];
+    }
+    player.close();
+    VectorXf mean = X.rowwise().mean();
+    X.colwise() -= mean;
+
+    // STEP 2:  Basis and coefficients.
+    RowMatrixXf U = _principal_components(X, k);
+    MatrixXf C = U.transpose() * X;     // k * F
+
+    // STEP 3:  Quantize every component over its own range.
+    const float levels = static_cast<float>((1 << bits) - 1);
+    std::vector<float> ranges(2 * k);
+    std::vector<uchar> coeffs(_packed_size(static_cast<qint64>(F) * k, bits), 0);
+    for (int j = 0; j < k; ++j)
+    {
+        float lo = C.row(j).minCoeff();
+        float hi = C.row(j).maxCoeff();
+        float step = hi > lo ? (hi - lo) / levels : 1.0f;
+        ranges[2 * j] = lo;
+        ranges[2 * j + 1] = step;
+        for (int fi = 0; fi < F; ++fi)
+        {
+            float q = std::min(std::max(std::round((C(j, fi) - lo) / step), 0.0f), levels);
+            _put_bits(coeffs, static_cast<qint64>(fi) * k + j, bits, static_cast<quint32>(q));
+            C(j, fi) = lo + q * step;
+        }
+    }
+
+    // error of what the player will show.
+    MatrixXf E = U * C - X;
+    double rms = std::sqrt(E.squaredNorm() / (static_cast<double>(F) * (D / 3)));
+    double max_err = 0.0;
+    for (int fi = 0; fi < F; ++fi)
+        for (int vi = 0; vi < D / 3; ++vi)
+            max_err = std::max(max_err, static_cast<double>(E.block<3, 1>(3 * vi, fi).norm()));
+
+    // STEP 4:  Write.
+    QFile file(output);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        msg.log("cannot write: ", output, ERROR_MSG);
+        return false;
+    }
+    AnimationPCAHeader header;
+    std::memcpy(header.magic, "PCA2", 4);
+    header.n_vertices = D / 3;
+    header.n_frames = F;
+    header.n_components = k;
+    header.bits = bits;
+    header.reserved = 0;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(times.data()), F * sizeof(double));
+    file.write(reinterpret_cast<const char *>(mean.data()), D * sizeof(float));
+    file.write(reinterpret_cast<const char *>(U.data()), static_cast<qint64>(D) * k * sizeof(float));
+    file.write(reinterpret_cast<const char *>(ranges.data()), ranges.size() * sizeof(float));
+    file.write(reinterpret_cast<const char *>(coeffs.data()), coeffs.size());
+    qint64 bytes = file.pos();
+    file.close();
+
+    double raw = static_cast<double>(D) * F * sizeof(float);
+    msg.log(QString("PCA: %0 frames, %1 components, %2 bits, %3 KB -> %4 KB (%5x)")
+        .arg(F).arg(k).arg(bits)
+        .arg(raw / 1024.0, 0, 'f', 1).arg(bytes / 1024.0, 0, 'f', 1)
+        .arg(raw / bytes, 0, 'f', 1), INFO_MSG);
+    msg.log(QString("PCA: error rms %0, max %1").arg(rms, 0, 'g', 4).arg(max_err, 0, 'g', 4), INFO_MSG);
+    return true;
+}
+
+bool AnimationPCAPlayer::open(const QString& filename)
+{
+    close();
+    file_.setFileName(filename);
+    if (!file_.open(QIODevice::ReadOnly))
+        return false;
+    qint64 size = file_.size();
+    if (size < static_cast<qint64>(sizeof(AnimationPCAHeader)))
+    {
+        file_.close();
+        return false;
+    }
+    data_ = file_.map(0, size);
+    if (data_ == nullptr)
+    {
+        file_.close();
+        return false;
+    }
+
+    std::memcpy(&header_, data_, sizeof(header_));
+    const qint64 D = 3 * static_cast<qint64>(header_.n_vertices);
+    const qint64 F = header_.n_frames;
+    const qint64 k = header_.n_components;
+    qint64 offset = sizeof(AnimationPCAHeader);
+    if (std::memcmp(header_.magic, "PCA2", 4) != 0 || F <= 0 || k <= 0 || D < 0 ||
+        header_.bits < 1 || header_.bits > 16)
+    {
+        close();
+        return false;
+    }
+    const qint64 expected = offset + F * sizeof(double) + D * sizeof(float)
+        + D * k * sizeof(float) + 2 * k * sizeof(float) + _packed_size(F * k, header_.bits);
+    if (size < expected)
+    {
+        close();
+        return false;
+    }
+    times_ = reinterpret_cast<const double *>(data_ + offset);
+    offset += F * sizeof(double);
+    mean_ = reinterpret_cast<const float *>(data_ + offset);
+    offset += D * sizeof(float);
+    basis_ = reinterpret_cast<const float *>(data_ + offset);
+    offset += D * k * sizeof(float);
+    ranges_ = reinterpret_cast<const float *>(data_ + offset);
+    offset += 2 * k * sizeof(float);
+    coeffs_ = data_ + offset;
+    c_ = std::vector<float>(k);
+    return true;
+}
+
+void AnimationPCAPlayer::close()
+{
+    if (data_ != nullptr)
+        file_.unmap(data_);
+    data_ = nullptr;
+    if (file_.isOpen())
+        file_.close();
+}
+
+bool AnimationPCAPlayer::frame(int fi, double& t, std::vector<Vector3f>& position)
+{
+    if (!is_open() || fi < 0 || fi >= header_.n_frames)
+        return false;
+
+    const int k = header_.n_components;
+    for (int j = 0; j < k; ++j)
+        c_[j] = ranges_[2 * j] + _get_bits(coeffs_, static_cast<qint64>(fi) * k + j, header_.bits) * ranges_[2 * j + 1];
+
+    // x = mean + U c, rows split among the threads.
+    position.resize(header_.n_vertices);
+#pragma omp parallel for
+    for (int vi = 0; vi < header_.n_vertices; ++vi)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            const qint64 r = 3 * static_cast<qint64>(vi) + i;
+            const float *u = basis_ + r * k;
+            float x = mean_[r];
+            for (int j = 0; j < k; ++j)
+                x += u[j] * c_[j];
+            position[vi][i] = x;
+        }
+    }
+    t = times_[fi];
+    return true;
+}
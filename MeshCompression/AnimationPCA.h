@@ -0,0 +1,54 @@
+#pragma once
+#include "TrajectoryFile.h"
+#include "ConsoleMessageManager.h"
+
+// Compressed animation: the frames x_f of a trajectory are approximated by
+//   x_f = mean + U * c_f,
+// U the leading principal components (3N * k), c_f quantized to `bits` bits
+// per coefficient. A frame then costs a k-wide GEMV to decompress.
+//
+// Layout (native little-endian):
+//   header    AnimationPCAHeader, 24 bytes
+//   times     n_frames doubles
+//   mean      3N floats
+//   basis     3N * k floats, row-major
+//   ranges    k * (min, step) floats
+//   coeffs    n_frames * k values of `bits` bits, packed least significant
+//             bit first, frame by frame, and 2 bytes of padding
+struct AnimationPCAHeader
+{
+    char    magic[4];               // "PCA2"
+    int     n_vertices;
+    int     n_frames;
+    int     n_components;
+    int     bits;
+    int     reserved;
+};
+
+// Offline: trajectory file -> PCA file, reports size and error.
+bool CompressAnimation(const QString &trajectory, const QString &output,
+    int n_components, int bits, const ConsoleMessageManager &msg);
+
+class AnimationPCAPlayer : public FramePlayer
+{
+public:
+    AnimationPCAPlayer() : data_(nullptr) {  }
+    ~AnimationPCAPlayer() override { close(); }
+    bool open(const QString &filename) override;
+    void close() override;
+    bool is_open() const override { return data_ != nullptr; }
+    int  n_frames() const override { return data_ == nullptr ? 0 : header_.n_frames; }
+    int  n_vertices() const override { return header_.n_vertices; }
+    bool frame(int fi, double &t, std::vector<Vector3f> &position) override;
+
+private:
+    QFile file_;
+    uchar *data_;                   // the whole mapped file, the arrays below point in it.
+    AnimationPCAHeader header_;
+    const double *times_;
+    const float *mean_;
+    const float *basis_;
+    const float *ranges_;
+    const uchar *coeffs_;           // packed.
+    std::vector<float> c_;
+};
@@ -0,0 +1,190 @@
+#include "stdafx.h"
+#include "BatchOffset.h"
+#include "OpenGLScene.h"
+#include "OffsetSolution.h"
+#include "TextConfigLoader.h"
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <omp.h>
+#include <mutex>
+#include <sstream>
+
+enum BatchStage
+{
+    STAGE_LOAD = 0,
+    STAGE_VECTORS,                  // offset vectors, bounds and the basis.
+    STAGE_OPTIMIZE,
+    STAGE_EXPORT,
+    N_STAGES
+};
+static const char *_stage_names[N_STAGES] = { "load", "vectors", "optimize", "export" };
+
+// OpenMesh's readers and writers are single global objects: one at a time.
+static std::mutex _io_mutex;
+
+struct BatchJob
+{
+    QString mesh;
+    QString skeleton;
+    QString output;
+    bool ok = false;
+    double ms[N_STAGES] = {};
+    double ms_total = 0.0;
+    OffsetOptimizerResult result{ 0.0, 0.0, 0, 0, false, false };
+    std::string log;                // its messages, printed after the batch.
+};
+
+class BatchRunnable : public QRunnable
+{
+public:
+    BatchRunnable(BatchJob &job, int omp_threads) : job_(job), omp_threads_(omp_threads) {}
+    void run() override;
+
+private:
+    BatchJob &job_;
+    int omp_threads_;
+};
+
+void BatchRunnable::run()
+{
+    omp_set_num_threads(omp_threads_);
+    std::ostringstream out;
+    ConsoleMessageManager msg(out);
+    QElapsedTimer total, timer;
+    total.start();
+
+    // STEP 1:  Load, as "open" and "load_skel".
+    timer.start();
+    OpenGLScene scene(msg);
+    {
+        std::lock_guard<std::mutex> lock(_io_mutex);
+        scene.open_by_obj(job_.mesh);
+        scene.open_by_obj(job_.skeleton, "Skeleton");
+    }
+    job_.ms[STAGE_LOAD] = timer.nsecsElapsed() * 1e-6;
+
+    // STEP 2:  Offset.
+    OffsetSolution offset(scene, msg);
+    job_.ok = offset.offset();
+    job_.ms[STAGE_VECTORS] = offset.timings().ms_prepare;
+    job_.ms[STAGE_OPTIMIZE] = offset.timings().ms_optimize + offset.timings().ms_write_back;
+    job_.result = offset.result();
+
+    // STEP 3:  Export.
+    timer.restart();
+    if (job_.ok)
+    {
+        QByteArray filename = job_.output.toLocal8Bit();
+        std::lock_guard<std::mutex> lock(_io_mutex);
+        job_.ok = OpenMesh::IO::write_mesh(scene.get("Inner")->mesh(), filename.data());
+        if (!job_.ok)
+            msg.log("cannot write ", job_.output, ERROR_MSG);
+    }
+    job_.ms[STAGE_EXPORT] = timer.nsecsElapsed() * 1e-6;
+    job_.ms_total = total.nsecsElapsed() * 1e-6;
+    job_.log = out.str();
+}
+
+static bool _read_manifest(const QString &manifest, std::vector<BatchJob> &jobs, ConsoleMessageManager &msg)
+{
+    QFile file(manifest);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        msg.log("cannot open manifest: ", manifest, ERROR_MSG);
+        return false;
+    }
+    QTextStream in(&file);
+    while (!in.atEnd())
+    {
+        QString line = in.readLine();
+        int comment = line.indexOf(';');
+        if (comment >= 0)
+            line = line.left(comment);
+        line = line.simplified();
+        if (line.isEmpty())
+            continue;
+        auto words = line.split(' ');
+        if (words.size() < 2)
+        {
+            msg.log("no skeleton for ", words[0], ERROR_MSG);
+            continue;
+        }
+        BatchJob job;
+        job.mesh = words[0];
+        job.skeleton = words[1];
+        if (words.size() >= 3)
+            job.output = words[2];
+        else
+            job.output = (job.mesh.endsWith(".obj") ? job.mesh.left(job.mesh.size() - 4) : job.mesh) + ".inner.obj";
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+bool RunBatchOffset(const QString& manifest, ConsoleMessageManager& msg)
+{
+    // STEP 1:  The pairs.
+    std::vector<BatchJob> jobs;
+    if (!_read_manifest(manifest, jobs, msg))
+        return false;
+    if (jobs.empty())
+    {
+        msg.log("no pairs in ", manifest, ERROR_MSG);
+        return false;
+    }
+
+    // STEP 2:  All of them on the pool; the cores split between the pairs.
+    TextConfigLoader tcl{ "./config/offset.config" };
+    const int cores = std::max(QThread::idealThreadCount(), 1);
+    int n_workers = tcl.get_int("Batch_Threads");
+    if (n_workers <= 0)
+        n_workers = cores;
+    n_workers = std::min(n_workers, static_cast<int>(jobs.size()));
+    const int omp_threads = std::max(cores / n_workers, 1);
+
+    QElapsedTimer timer;
+    timer.start();
+    QThreadPool pool;
+    pool.setMaxThreadCount(n_workers);
+    for (auto &job : jobs)
+        pool.start(new BatchRunnable(job, omp_threads));
+    pool.waitForDone();
+    const double ms_wall = timer.nsecsElapsed() * 1e-6;
+
+    // STEP 3:  Report, in the order of the manifest.
+    double sum[N_STAGES] = {};
+    int n_ok = 0;
+    for (auto &job : jobs)
+    {
+        if (!job.log.empty())
+            msg.log(job.log.substr(0, job.log.size() - 1), INFO_MSG);
+        QString stages;
+        for (int s = 0; s < N_STAGES; ++s)
+        {
+            stages += QString(" %0 %1").arg(_stage_names[s]).arg(job.ms[s], 0, 'f', 0);
+            sum[s] += job.ms[s];
+        }
+        if (job.ok)
+        {
+            ++n_ok;
+            msg.log(QString("%0 -> %1: f %2%3,%4 ms")
+                .arg(job.mesh).arg(job.output).arg(job.result.f)
+                .arg(job.result.converged ? "" : " (not converged)").arg(stages), INFO_MSG);
+        }
+        else
+        {
+            msg.log(QString("%0: failed,%1 ms").arg(job.mesh).arg(stages), ERROR_MSG);
+        }
+    }
+    QString stages;
+    for (int s = 0; s < N_STAGES; ++s)
+        stages += QString(" %0 %1").arg(_stage_names[s]).arg(sum[s], 0, 'f', 0);
+    msg.log(QString("batch: %0 of %1 pairs, %2 workers x %3 threads, %4 ms; summed%5 ms")
+        .arg(n_ok).arg(jobs.size()).arg(n_workers).arg(omp_threads)
+        .arg(ms_wall, 0, 'f', 0).arg(stages), INFO_MSG);
+    return n_ok == static_cast<int>(jobs.size());
+}
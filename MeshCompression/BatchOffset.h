@@ -0,0 +1,13 @@
+#pragma once
+#include "ConsoleMessageManager.h"
+#include <QString>
+
+// "batch <manifest>": script/cat.script and the like for many mesh pairs
+// at once. A manifest line is
+//     <mesh> <skeleton> [<output>]
+// (';' starts a comment; output defaults to <mesh>.inner.obj). Each pair is
+// opened into a scene of its own, offset, and its "Inner" written, on a
+// QThreadPool of Batch_Threads (offset.config, 0: one per core) workers; the
+// OpenMP loops of a pair get the cores left over. Logs each pair, in the
+// order of the manifest, and the total time of each stage.
+bool RunBatchOffset(const QString &manifest, ConsoleMessageManager &msg);
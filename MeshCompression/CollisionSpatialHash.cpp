@@ -0,0 +1,296 @@
+#include "stdafx.h"
+#include "CollisionSpatialHash.h"
+#include <Eigen/Geometry>
+
+using Eigen::Vector3f;
+
+// connected component of every vertex, through the tetras and the faces:
+// the separate bodies of the batched mesh.
+static std::vector<int> _components(const TetraMesh &tmesh)
+{
+    std::vector<int> parent(tmesh.n_vertices);
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        parent[vi] = vi;
+    auto find = [&parent](int v)
+    {
+        while (parent[v] != v)
+            v = parent[v] = parent[parent[v]];
+        return v;
+    };
+    auto unite = [&](int a, int b) { parent[find(a)] = find(b); };
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+        for (int j = 1; j < 4; ++j)
+            unite(tmesh.tetra_vertices[ti][0], tmesh.tetra_vertices[ti][j]);
+    for (auto &fvs : tmesh.face_vertices)
+        for (int j = 1; j < 3; ++j)
+            unite(fvs[0], fvs[j]);
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        parent[vi] = find(vi);
+    return parent;
+}
+
+void CollisionSpatialHash::init(const TetraMesh& tmesh, float thickness, float cell_scale)
+{
+    faces_ = tmesh.face_vertices;
+    vertices_.clear();
+    excluded_.clear();
+    for (auto &fvs : faces_)
+        for (auto vi : fvs)
+            vertices_.push_back(vi);
+    std::sort(vertices_.begin(), vertices_.end());
+    vertices_.erase(std::unique(vertices_.begin(), vertices_.end()), vertices_.end());
+    if (faces_.empty())
+        return;
+
+    // cells of about an edge, at least twice the thickness.
+    std::vector<Vector3f> position(tmesh.n_vertices);
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        position[vi] = { tmesh.point[vi][0], tmesh.point[vi][1], tmesh.point[vi][2] };
+    double edge_sum = 0.0;
+    for (auto &fvs : faces_)
+        for (int j = 0; j < 3; ++j)
+            edge_sum += (position[fvs[j]] - position[fvs[(j + 1) % 3]]).norm();
+    thickness_ = thickness;
+    cell_size_ = std::max(static_cast<float>(cell_scale * edge_sum / (3.0 * faces_.size())), 2.0f * thickness);
+
+    const int table_size = std::max(1024, 8 * static_cast<int>(faces_.size()));
+    begin_ = std::vector<int>(table_size + 1, 0);
+    face_entry_begin_ = std::vector<int>(faces_.size() + 1, 0);
+
+    // neighbours on the surface of the same body at rest are not contacts,
+    // separate bodies touching at rest still are.
+    std::vector<VertexTriangleContact> contacts;
+    std::vector<int> component = _components(tmesh);
+    build(position);
+    detect(position, contacts);
+    for (auto &c : contacts)
+        if (component[c.vi] == component[faces_[c.fi][0]])
+            excluded_.push_back(static_cast<quint64>(c.vi) << 32 | static_cast<quint32>(c.fi));
+    std::sort(excluded_.begin(), excluded_.end());
+}
+
+void CollisionSpatialHash::cell_of(const Vector3f& p, int c[3]) const
+{
+    for (int i = 0; i < 3; ++i)
+        c[i] = static_cast<int>(std::floor(p[i] / cell_size_));
+}
+
+unsigned CollisionSpatialHash::hash(int x, int y, int z) const
+{
+    unsigned h = (static_cast<unsigned>(x) * 73856093u) ^
+        (static_cast<unsigned>(y) * 19349663u) ^
+        (static_cast<unsigned>(z) * 83492791u);
+    return h % static_cast<unsigned>(begin_.size() - 1);
+}
+
+// a stretched triangle, or a long move, over more cells than this on an axis
+// is kept out of the table and tested by every query.
+static const int _max_cells = 16;
+
+void CollisionSpatialHash::build(const std::vector<Vector3f>& position)
+{
+    build_swept(position, position);
+}
+
+void CollisionSpatialHash::build_swept(const std::vector<Vector3f>& x0, const std::vector<Vector3f>& x1)
+{
+    if (faces_.empty())
+        return;
+    const int n_faces = static_cast<int>(faces_.size());
+
+    // STEP 1:  Cells of every triangle, counted then filled in parallel.
+    std::vector<std::array<int, 6>> range(n_faces);
+#pragma omp parallel for
+    for (int fi = 0; fi < n_faces; ++fi)
+    {
+        auto &fvs = faces_[fi];
+        Vector3f lo = x0[fvs[0]];
+        Vector3f hi = x0[fvs[0]];
+        for (int j = 0; j < 3; ++j)
+        {
+            lo = lo.cwiseMin(x0[fvs[j]]).cwiseMin(x1[fvs[j]]);
+            hi = hi.cwiseMax(x0[fvs[j]]).cwiseMax(x1[fvs[j]]);
+        }
+        lo.array() -= thickness_;
+        hi.array() += thickness_;
+        int c_lo[3], c_hi[3];
+        cell_of(lo, c_lo);
+        cell_of(hi, c_hi);
+        int count = 1;
+        for (int i = 0; i < 3; ++i)
+        {
+            range[fi][i] = c_lo[i];
+            range[fi][i + 3] = c_hi[i];
+            if (c_hi[i] - c_lo[i] >= _max_cells)
+                count = 0;
+            else
+                count *= c_hi[i] - c_lo[i] + 1;
+        }
+        face_entry_begin_[fi + 1] = count;
+    }
+    oversized_.clear();
+    for (int fi = 0; fi < n_faces; ++fi)
+    {
+        if (face_entry_begin_[fi + 1] == 0)
+            oversized_.push_back(fi);
+        face_entry_begin_[fi + 1] += face_entry_begin_[fi];
+    }
+    face_entry_hash_.resize(face_entry_begin_[n_faces]);
+#pragma omp parallel for
+    for (int fi = 0; fi < n_faces; ++fi)
+    {
+        int e = face_entry_begin_[fi];
+        if (e == face_entry_begin_[fi + 1])
+            continue;
+        auto &r = range[fi];
+        for (int x = r[0]; x <= r[3]; ++x)
+            for (int y = r[1]; y <= r[4]; ++y)
+                for (int z = r[2]; z <= r[5]; ++z)
+                    face_entry_hash_[e++] = hash(x, y, z);
+    }
+
+    // STEP 2:  Counting sort into the buckets, triangles stay in order.
+    const int table_size = static_cast<int>(begin_.size()) - 1;
+    std::fill(begin_.begin(), begin_.end(), 0);
+    for (auto h : face_entry_hash_)
+        ++begin_[h + 1];
+    for (int h = 0; h < table_size; ++h)
+        begin_[h + 1] += begin_[h];
+    entries_.resize(face_entry_hash_.size());
+    std::vector<int> fill(begin_.begin(), begin_.end() - 1);
+    for (int fi = 0; fi < n_faces; ++fi)
+        for (int e = face_entry_begin_[fi]; e < face_entry_begin_[fi + 1]; ++e)
+            entries_[fill[face_entry_hash_[e]]++] = fi;
+}
+
+void CollisionSpatialHash::query(const Vector3f& lo, const Vector3f& hi, std::vector<int>& faces) const
+{
+    faces.clear();
+    if (faces_.empty())
+        return;
+    int c_lo[3], c_hi[3];
+    cell_of(lo, c_lo);
+    cell_of(hi, c_hi);
+    // a box over more cells than the table holds: every triangle.
+    for (int i = 0; i < 3; ++i)
+    {
+        if (c_hi[i] - c_lo[i] >= _max_cells)
+        {
+            faces.resize(faces_.size());
+            for (int fi = 0; fi < static_cast<int>(faces_.size()); ++fi)
+                faces[fi] = fi;
+            return;
+        }
+    }
+    faces = oversized_;
+    for (int x = c_lo[0]; x <= c_hi[0]; ++x)
+        for (int y = c_lo[1]; y <= c_hi[1]; ++y)
+            for (int z = c_lo[2]; z <= c_hi[2]; ++z)
+            {
+                unsigned h = hash(x, y, z);
+                faces.insert(faces.end(), entries_.begin() + begin_[h], entries_.begin() + begin_[h + 1]);
+            }
+    std::sort(faces.begin(), faces.end());
+    faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+}
+
+void CollisionSpatialHash::detect_vertex(const std::vector<Vector3f>& position, int vi,
+    std::vector<VertexTriangleContact>& contacts) const
+{
+    const Vector3f &p = position[vi];
+    int c[3];
+    cell_of(p, c);
+    unsigned h = hash(c[0], c[1], c[2]);
+    const int n_table = begin_[h + 1] - begin_[h];
+    const int n_oversized = static_cast<int>(oversized_.size());
+    int last = -1;
+    for (int e = 0; e < n_table + n_oversized; ++e)
+    {
+        int fi = e < n_table ? entries_[begin_[h] + e] : oversized_[e - n_table];
+        // a triangle over several cells of one bucket.
+        if (fi == last)
+            continue;
+        last = fi;
+        auto &fvs = faces_[fi];
+        if (fvs[0] == vi || fvs[1] == vi || fvs[2] == vi)
+            continue;
+        const Vector3f &a = position[fvs[0]];
+        const Vector3f &b = position[fvs[1]];
+        const Vector3f &cc = position[fvs[2]];
+        Vector3f bary = ClosestBarycentric(p, a, b, cc);
+        Vector3f d = p - (bary[0] * a + bary[1] * b + bary[2] * cc);
+        float dist = d.norm();
+        if (dist >= thickness_)
+            continue;
+        quint64 key = static_cast<quint64>(vi) << 32 | static_cast<quint32>(fi);
+        if (std::binary_search(excluded_.begin(), excluded_.end(), key))
+            continue;
+
+        VertexTriangleContact contact;
+        contact.vi = vi;
+        contact.fi = fi;
+        contact.bary = bary;
+        contact.normal = dist > 1e-9f ? Vector3f(d / dist) : Vector3f((b - a).cross(cc - a).normalized());
+        contact.depth = thickness_ - dist;
+        contacts.push_back(contact);
+    }
+}
+
+void CollisionSpatialHash::detect(const std::vector<Vector3f>& position,
+    std::vector<VertexTriangleContact>& contacts) const
+{
+    contacts.clear();
+    if (faces_.empty())
+        return;
+    const int n = static_cast<int>(vertices_.size());
+#pragma omp parallel
+    {
+        std::vector<VertexTriangleContact> local;
+#pragma omp for nowait
+        for (int i = 0; i < n; ++i)
+            detect_vertex(position, vertices_[i], local);
+#pragma omp critical
+        contacts.insert(contacts.end(), local.begin(), local.end());
+    }
+    // same order for any thread count.
+    std::sort(contacts.begin(), contacts.end(),
+        [](const VertexTriangleContact &a, const VertexTriangleContact &b)
+    {
+        return a.vi != b.vi ? a.vi < b.vi : a.fi < b.fi;
+    });
+}
+
+void ApplyContactPenalty(const TetraMesh& tmesh, const std::vector<VertexTriangleContact>& contacts,
+    float k, std::vector<Vector3f>& force)
+{
+    for (auto &c : contacts)
+    {
+        Vector3f f = k * c.depth * c.normal;
+        force[c.vi] += f;
+        auto &fvs = tmesh.face_vertices[c.fi];
+        for (int j = 0; j < 3; ++j)
+            force[fvs[j]] -= c.bary[j] * f;
+    }
+}
+
+void ProjectContacts(const TetraMesh& tmesh, const std::vector<VertexTriangleContact>& contacts,
+    float thickness, const std::vector<float>& inv_masses, std::vector<Vector3f>& position)
+{
+    for (auto &c : contacts)
+    {
+        auto &fvs = tmesh.face_vertices[c.fi];
+        Vector3f q = c.bary[0] * position[fvs[0]] + c.bary[1] * position[fvs[1]] + c.bary[2] * position[fvs[2]];
+        float depth = thickness - (position[c.vi] - q).dot(c.normal);
+        if (depth <= 0.0f)
+            continue;
+        float w = inv_masses[c.vi];
+        for (int j = 0; j < 3; ++j)
+            w += c.bary[j] * c.bary[j] * inv_masses[fvs[j]];
+        if (w <= 0.0f)
+            continue;
+        float lambda = depth / w;
+        position[c.vi] += lambda * inv_masses[c.vi] * c.normal;
+        for (int j = 0; j < 3; ++j)
+            position[fvs[j]] -= lambda * c.bary[j] * inv_masses[fvs[j]] * c.normal;
+    }
+}
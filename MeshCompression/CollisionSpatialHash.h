@@ -0,0 +1,74 @@
+#pragma once
+#include "OpenGLMesh.h"
+#include "TriangleGeometry.h"
+#include <Eigen/Core>
+
+// A boundary vertex closer than the thickness to a boundary triangle.
+struct VertexTriangleContact
+{
+    int vi;
+    int fi;
+    Eigen::Vector3f bary;           // closest point on the triangle.
+    Eigen::Vector3f normal;         // from the closest point to the vertex.
+    float depth;                    // thickness - distance.
+};
+
+// Broad and narrow phase of the contacts between the boundary triangles of a
+// (batched) tetra mesh, between bodies and of a body with itself.
+//
+// Uniform spatial hash: a triangle goes into every cell its bounding box,
+// inflated by the thickness, overlaps, so a vertex only looks up its own
+// cell. Cells are about the mean edge length, a triangle touches a few;
+// one over more than 16 cells on an axis is kept aside and tested by every
+// query instead.
+// Rebuilt every step, (cell, triangle) pairs are made in parallel and
+// bucketed by a counting sort, vertices are queried in parallel.
+class CollisionSpatialHash
+{
+public:
+    CollisionSpatialHash() : thickness_(0.0f), cell_size_(1.0f) {  }
+    // rest shape pairs of one body already within the thickness are never
+    // contacts, bodies being the connected parts of the mesh.
+    void init(const TetraMesh &tmesh, float thickness, float cell_scale);
+    void build(const std::vector<Eigen::Vector3f> &position);
+    // triangles binned by the box of their move x0 -> x1, for query().
+    void build_swept(const std::vector<Eigen::Vector3f> &x0, const std::vector<Eigen::Vector3f> &x1);
+    // triangles in the cells overlapping [lo, hi], sorted, no duplicates.
+    void query(const Eigen::Vector3f &lo, const Eigen::Vector3f &hi, std::vector<int> &faces) const;
+    void detect(const std::vector<Eigen::Vector3f> &position,
+        std::vector<VertexTriangleContact> &contacts) const;
+    bool empty() const { return faces_.empty(); }
+    float thickness() const { return thickness_; }
+    float cell_size() const { return cell_size_; }
+    const std::vector<std::array<int, 3>> &faces() const { return faces_; }
+    const std::vector<int> &vertices() const { return vertices_; }
+
+private:
+    void cell_of(const Eigen::Vector3f &p, int c[3]) const;
+    unsigned hash(int x, int y, int z) const;
+    void detect_vertex(const std::vector<Eigen::Vector3f> &position, int vi,
+        std::vector<VertexTriangleContact> &contacts) const;
+
+    float thickness_;
+    float cell_size_;
+    std::vector<std::array<int, 3>> faces_;
+    std::vector<int> vertices_;     // boundary vertices, the queries.
+    std::vector<quint64> excluded_; // (vi << 32 | fi), sorted.
+
+    // table: triangles of bucket h are entries_[begin_[h] .. begin_[h + 1]).
+    std::vector<int> begin_;
+    std::vector<int> entries_;
+    std::vector<int> face_entry_begin_;
+    std::vector<unsigned> face_entry_hash_;
+    std::vector<int> oversized_;    // triangles in no bucket, sorted.
+};
+
+// Penalty force k * depth along the normal on the vertex, the opposite force
+// goes to the triangle by the barycentric weights.
+void ApplyContactPenalty(const TetraMesh &tmesh, const std::vector<VertexTriangleContact> &contacts,
+    float k, std::vector<Eigen::Vector3f> &force);
+// Move vertex and triangle apart until they are a thickness away along the
+// contact normal, weighted by the inverse masses. The gap is measured on the
+// current positions, so it can be called in every solver iteration.
+void ProjectContacts(const TetraMesh &tmesh, const std::vector<VertexTriangleContact> &contacts,
+    float thickness, const std::vector<float> &inv_masses, std::vector<Eigen::Vector3f> &position);
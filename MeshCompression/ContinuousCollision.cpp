@@ -0,0 +1,371 @@
+#include "stdafx.h"
+#include "ContinuousCollision.h"
+#include <Eigen/Geometry>
+
+using Eigen::Vector3f;
+using Eigen::Vector3d;
+
+static Vector3d _lerp(const Vector3f &a, const Vector3f &b, double t)
+{
+    return (a.cast<double>() * (1.0 - t) + b.cast<double>() * t);
+}
+
+// Roots in [0, 1] of a + b t + c t^2 + d t^3, ascending.
+// f is monotone between its extrema, each piece with a sign change is bisected.
+static int _cubic_roots_01(double a, double b, double c, double d, double roots[3])
+{
+    auto f = [&](double t) { return a + t * (b + t * (c + t * d)); };
+    double scale = std::max(std::max(std::abs(a), std::abs(b)), std::max(std::abs(c), std::abs(d)));
+    if (scale < 1e-30)
+        return 0;   // coplanar all the time, left to the proximity contacts.
+
+    double ts[4] = { 0.0, 1.0, 1.0, 1.0 };
+    int n_ts = 1;
+    // f' = b + 2c t + 3d t^2
+    double qa = 3.0 * d, qb = 2.0 * c, qc = b;
+    if (std::abs(qa) > 1e-12 * scale)
+    {
+        double disc = qb * qb - 4.0 * qa * qc;
+        if (disc >= 0.0)
+        {
+            double sq = std::sqrt(disc);
+            double r1 = (-qb - sq) / (2.0 * qa);
+            double r2 = (-qb + sq) / (2.0 * qa);
+            if (r1 > r2)
+                std::swap(r1, r2);
+            if (r1 > 0.0 && r1 < 1.0)
+                ts[n_ts++] = r1;
+            if (r2 > 0.0 && r2 < 1.0)
+                ts[n_ts++] = r2;
+        }
+    }
+    else if (std::abs(qb) > 1e-12 * scale)
+    {
+        double r = -qc / qb;
+        if (r > 0.0 && r < 1.0)
+            ts[n_ts++] = r;
+    }
+    ts[n_ts++] = 1.0;
+
+    int n_roots = 0;
+    for (int i = 0; i + 1 < n_ts; ++i)
+    {
+        double lo = ts[i], hi = ts[i + 1];
+        double f_lo = f(lo), f_hi = f(hi);
+        if (f_lo == 0.0)
+        {
+            if (n_roots == 0 || roots[n_roots - 1] < lo)
+                roots[n_roots++] = lo;
+            continue;
+        }
+        if (f_lo * f_hi > 0.0)
+            continue;
+        for (int it = 0; it < 50; ++it)
+        {
+            double mid = 0.5 * (lo + hi);
+            double f_mid = f(mid);
+            if ((f_mid < 0.0) == (f_lo < 0.0))
+            {
+                lo = mid;
+                f_lo = f_mid;
+            }
+            else
+                hi = mid;
+        }
+        roots[n_roots++] = hi;
+    }
+    return n_roots;
+}
+
+// Coefficients of (a x b) . c, a b c moving linearly from 0 to 1.
+static void _coplanar_cubic(const Vector3d &a0, const Vector3d &da, const Vector3d &b0, const Vector3d &db,
+    const Vector3d &c0, const Vector3d &dc, double coef[4])
+{
+    Vector3d ab0 = a0.cross(b0);
+    Vector3d ab1 = da.cross(b0) + a0.cross(db);
+    Vector3d ab2 = da.cross(db);
+    coef[0] = ab0.dot(c0);
+    coef[1] = ab1.dot(c0) + ab0.dot(dc);
+    coef[2] = ab2.dot(c0) + ab1.dot(dc);
+    coef[3] = ab2.dot(dc);
+}
+
+void ContinuousCollision::init(const TetraMesh& tmesh, float cell_scale, float safety, float restitution,
+    int max_passes)
+{
+    safety_ = safety;
+    restitution_ = restitution;
+    max_passes_ = std::max(max_passes, 1);
+    hash_.init(tmesh, 0.0f, cell_scale);
+    tolerance_ = 1e-3f * hash_.cell_size() / std::max(cell_scale, 1e-6f);
+
+    // unique edges of the boundary triangles.
+    auto &faces = hash_.faces();
+    std::vector<std::array<int, 3>> all;    // (v0, v1, face * 3 + j)
+    for (int fi = 0; fi < static_cast<int>(faces.size()); ++fi)
+        for (int j = 0; j < 3; ++j)
+        {
+            int a = faces[fi][j], b = faces[fi][(j + 1) % 3];
+            all.push_back({ std::min(a, b), std::max(a, b), 3 * fi + j });
+        }
+    std::sort(all.begin(), all.end());
+    edges_.clear();
+    face_edges_ = std::vector<std::array<int, 3>>(faces.size());
+    for (size_t i = 0; i < all.size(); ++i)
+    {
+        if (i == 0 || all[i][0] != all[i - 1][0] || all[i][1] != all[i - 1][1])
+            edges_.push_back({ all[i][0], all[i][1] });
+        face_edges_[all[i][2] / 3][all[i][2] % 3] = static_cast<int>(edges_.size()) - 1;
+    }
+}
+
+void ContinuousCollision::vertex_triangle(const std::vector<Vector3f>& x0, const std::vector<Vector3f>& x1,
+    int vi, std::vector<int>& faces, std::vector<Impact>& impacts) const
+{
+    Vector3f lo = (x0[vi].cwiseMin(x1[vi]).array() - tolerance_).matrix();
+    Vector3f hi = (x0[vi].cwiseMax(x1[vi]).array() + tolerance_).matrix();
+    hash_.query(lo, hi, faces);
+    for (auto fi : faces)
+    {
+        auto &fvs = hash_.faces()[fi];
+        if (fvs[0] == vi || fvs[1] == vi || fvs[2] == vi)
+            continue;
+        // (b - a) x (c - a) . (p - a) = 0
+        Vector3d a0 = x0[fvs[0]].cast<double>();
+        Vector3d da = (x1[fvs[0]] - x0[fvs[0]]).cast<double>();
+        double coef[4];
+        _coplanar_cubic(
+            x0[fvs[1]].cast<double>() - a0, (x1[fvs[1]] - x0[fvs[1]]).cast<double>() - da,
+            x0[fvs[2]].cast<double>() - a0, (x1[fvs[2]] - x0[fvs[2]]).cast<double>() - da,
+            x0[vi].cast<double>() - a0, (x1[vi] - x0[vi]).cast<double>() - da, coef);
+        double roots[3];
+        int n_roots = _cubic_roots_01(coef[0], coef[1], coef[2], coef[3], roots);
+        for (int r = 0; r < n_roots; ++r)
+        {
+            double t = roots[r];
+            Vector3f p = _lerp(x0[vi], x1[vi], t).cast<float>();
+            Vector3f a = _lerp(x0[fvs[0]], x1[fvs[0]], t).cast<float>();
+            Vector3f b = _lerp(x0[fvs[1]], x1[fvs[1]], t).cast<float>();
+            Vector3f c = _lerp(x0[fvs[2]], x1[fvs[2]], t).cast<float>();
+            Vector3f bary = ClosestBarycentric(p, a, b, c);
+            if ((p - (bary[0] * a + bary[1] * b + bary[2] * c)).norm() > tolerance_)
+                continue;
+            Vector3f n = (b - a).cross(c - a);
+            if (n.norm() < 1e-12f)
+                continue;
+            n.normalize();
+            // the side the vertex came from.
+            Vector3f s0 = x0[vi] - (bary[0] * x0[fvs[0]] + bary[1] * x0[fvs[1]] + bary[2] * x0[fvs[2]]);
+            if (s0.dot(n) < 0.0f)
+                n = -n;
+            impacts.push_back({ static_cast<float>(t), { vi, fvs[0], fvs[1], fvs[2] },
+                { 1.0f, -bary[0], -bary[1], -bary[2] }, n });
+            break;
+        }
+    }
+}
+
+void ContinuousCollision::edge_edge(const std::vector<Vector3f>& x0, const std::vector<Vector3f>& x1,
+    int ei, std::vector<int>& faces, std::vector<Impact>& impacts) const
+{
+    int p0 = edges_[ei][0], p1 = edges_[ei][1];
+    Vector3f lo = (x0[p0].cwiseMin(x1[p0]).cwiseMin(x0[p1]).cwiseMin(x1[p1]).array() - tolerance_).matrix();
+    Vector3f hi = (x0[p0].cwiseMax(x1[p0]).cwiseMax(x0[p1]).cwiseMax(x1[p1]).array() + tolerance_).matrix();
+    hash_.query(lo, hi, faces);
+    // edges of the candidate triangles, each pair tested once.
+    std::vector<int> others;
+    for (auto fi : faces)
+        for (int j = 0; j < 3; ++j)
+            if (face_edges_[fi][j] > ei)
+                others.push_back(face_edges_[fi][j]);
+    std::sort(others.begin(), others.end());
+    others.erase(std::unique(others.begin(), others.end()), others.end());
+
+    for (auto ej : others)
+    {
+        int q0 = edges_[ej][0], q1 = edges_[ej][1];
+        if (q0 == p0 || q0 == p1 || q1 == p0 || q1 == p1)
+            continue;
+        // (p1 - p0) x (q0 - p0) . (q1 - p0) = 0
+        Vector3d a0 = x0[p0].cast<double>();
+        Vector3d da = (x1[p0] - x0[p0]).cast<double>();
+        double coef[4];
+        _coplanar_cubic(
+            x0[p1].cast<double>() - a0, (x1[p1] - x0[p1]).cast<double>() - da,
+            x0[q0].cast<double>() - a0, (x1[q0] - x0[q0]).cast<double>() - da,
+            x0[q1].cast<double>() - a0, (x1[q1] - x0[q1]).cast<double>() - da, coef);
+        double roots[3];
+        int n_roots = _cubic_roots_01(coef[0], coef[1], coef[2], coef[3], roots);
+        for (int r = 0; r < n_roots; ++r)
+        {
+            double t = roots[r];
+            Vector3d a = _lerp(x0[p0], x1[p0], t);
+            Vector3d b = _lerp(x0[p1], x1[p1], t);
+            Vector3d c = _lerp(x0[q0], x1[q0], t);
+            Vector3d d = _lerp(x0[q1], x1[q1], t);
+            Vector3d e1 = b - a, e2 = d - c;
+            Vector3d n = e1.cross(e2);
+            double nn = n.norm();
+            if (nn < 1e-12 * e1.norm() * e2.norm() || nn == 0.0)
+                continue;   // parallel edges, the vertex-triangle tests see them.
+            // closest points of the two lines, inside both segments.
+            Vector3d w = a - c;
+            double aa = e1.dot(e1), bb = e1.dot(e2), cc = e2.dot(e2);
+            double dd = e1.dot(w), ee = e2.dot(w);
+            double den = aa * cc - bb * bb;
+            double s = (bb * ee - cc * dd) / den;
+            double u = (aa * ee - bb * dd) / den;
+            if (s < 0.0 || s > 1.0 || u < 0.0 || u > 1.0)
+                continue;
+            if ((a + s * e1 - c - u * e2).norm() > tolerance_)
+                continue;
+            Vector3f nf = (n / nn).cast<float>();
+            Vector3f sep0 = (1.0f - s) * x0[p0] + s * x0[p1] - (1.0f - u) * x0[q0] - u * x0[q1];
+            if (sep0.dot(nf) < 0.0f)
+                nf = -nf;
+            impacts.push_back({ static_cast<float>(t), { p0, p1, q0, q1 },
+                { static_cast<float>(1.0 - s), static_cast<float>(s), static_cast<float>(u - 1.0), static_cast<float>(-u) }, nf });
+            break;
+        }
+    }
+}
+
+void ContinuousCollision::detect(const std::vector<Vector3f>& x0, const std::vector<Vector3f>& x1,
+    std::vector<Impact>& impacts)
+{
+    impacts.clear();
+    if (hash_.empty())
+        return;
+    hash_.build_swept(x0, x1);
+    auto &vertices = hash_.vertices();
+    const int n_vertices = static_cast<int>(vertices.size());
+    const int n_edges = static_cast<int>(edges_.size());
+#pragma omp parallel
+    {
+        std::vector<Impact> local;
+        std::vector<int> faces;
+        // ground, z = 0 crossed from above.
+#pragma omp for nowait
+        for (int i = 0; i < n_vertices; ++i)
+        {
+            int vi = vertices[i];
+            if (x0[vi][2] >= 0.0f && x1[vi][2] < 0.0f)
+            {
+                float t = x0[vi][2] / (x0[vi][2] - x1[vi][2]);
+                local.push_back({ t, { vi, -1, -1, -1 }, { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } });
+            }
+        }
+#pragma omp for nowait
+        for (int i = 0; i < n_vertices; ++i)
+            vertex_triangle(x0, x1, vertices[i], faces, local);
+#pragma omp for nowait
+        for (int ei = 0; ei < n_edges; ++ei)
+            edge_edge(x0, x1, ei, faces, local);
+#pragma omp critical
+        impacts.insert(impacts.end(), local.begin(), local.end());
+    }
+    // earliest first, same order for any thread count.
+    std::sort(impacts.begin(), impacts.end(), [](const Impact &a, const Impact &b)
+    {
+        return a.toi != b.toi ? a.toi < b.toi : a.v < b.v;
+    });
+}
+
+int ContinuousCollision::resolve(const std::vector<Vector3f>& x0, std::vector<Vector3f>& x1,
+    std::vector<Vector3f>& velocity, const std::vector<float>& masses, float h)
+{
+    const int n = static_cast<int>(x1.size());
+    std::vector<Impact> impacts;
+    std::vector<Impact> resolved;   // of every pass, for the impulses.
+    std::vector<float> vert_toi(n);
+    std::vector<char> moved(n, 0);
+    int n_first = 0;
+
+    // STEP 1:  Stop every vertex short of its first impact. That changes
+    //          the moves of its neighbours, so detect again.
+    for (int pass = 0; pass < max_passes_; ++pass)
+    {
+        detect(x0, x1, impacts);
+        if (pass == 0)
+            n_first = static_cast<int>(impacts.size());
+        if (impacts.empty())
+            break;
+        std::fill(vert_toi.begin(), vert_toi.end(), 1.0f);
+        for (auto &imp : impacts)
+            for (int j = 0; j < 4; ++j)
+                if (imp.v[j] >= 0 && imp.w[j] != 0.0f)
+                    vert_toi[imp.v[j]] = std::min(vert_toi[imp.v[j]], imp.toi);
+#pragma omp parallel for
+        for (int vi = 0; vi < n; ++vi)
+        {
+            if (vert_toi[vi] < 1.0f)
+            {
+                x1[vi] = x0[vi] + safety_ * vert_toi[vi] * (x1[vi] - x0[vi]);
+                moved[vi] = 1;
+            }
+        }
+        resolved.insert(resolved.end(), impacts.begin(), impacts.end());
+    }
+    if (n_first == 0)
+        return 0;
+
+    // STEP 2:  Impacts left after the passes: their vertices go back to x0,
+    //          until none is left. All at x0 has none, if x0 had none.
+    for (;;)
+    {
+        detect(x0, x1, impacts);
+        bool reverted = false;
+        for (auto &imp : impacts)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                int vi = imp.v[j];
+                if (vi >= 0 && x1[vi] != x0[vi])
+                {
+                    x1[vi] = x0[vi];
+                    moved[vi] = 1;
+                    reverted = true;
+                }
+            }
+        }
+        resolved.insert(resolved.end(), impacts.begin(), impacts.end());
+        // none left, or only what already touched at x0.
+        if (!reverted)
+            break;
+    }
+
+    // STEP 3:  Velocities of the moved vertices from where they ended, then
+    //          the approaching relative velocity taken out of every impact
+    //          (inelastic, or bounced by the restitution).
+    if (h > 0.0f)
+    {
+#pragma omp parallel for
+        for (int vi = 0; vi < n; ++vi)
+            if (moved[vi])
+                velocity[vi] = (x1[vi] - x0[vi]) / h;
+    }
+    for (auto &imp : resolved)
+    {
+        float v_rel = 0.0f;
+        float w_sum = 0.0f;
+        for (int j = 0; j < 4; ++j)
+        {
+            if (imp.v[j] < 0 || imp.w[j] == 0.0f)
+                continue;
+            int vi = imp.v[j];
+            v_rel += imp.w[j] * velocity[vi].dot(imp.n);
+            if (masses[vi] > 0.0f)
+                w_sum += imp.w[j] * imp.w[j] / masses[vi];
+        }
+        if (v_rel >= 0.0f || w_sum <= 0.0f)
+            continue;
+        float lambda = -(1.0f + restitution_) * v_rel / w_sum;
+        for (int j = 0; j < 4; ++j)
+        {
+            int vi = imp.v[j];
+            if (vi >= 0 && masses[vi] > 0.0f)
+                velocity[vi] += lambda * imp.w[j] / masses[vi] * imp.n;
+        }
+    }
+    return n_first;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "CollisionSpatialHash.h"
+
+// An impact of the move x0 -> x1. At toi (fraction of the move) the points
+// v touch, and sum w_i x_i is their separation along n, so
+// sum w_i v_i . n < 0 means they approach. Unused points have v = -1.
+struct Impact
+{
+    float toi;
+    std::array<int, 4> v;
+    std::array<float, 4> w;
+    Eigen::Vector3f n;
+};
+
+// Continuous collision detection of the boundary of a (batched) tetra mesh,
+// against itself and against the ground z = 0.
+//
+// Points move linearly over a step, vertex-triangle and edge-edge pairs are
+// coplanar at the roots of a cubic in t, a root is an impact if the points
+// actually meet there. Candidates come from a spatial hash of the swept
+// triangles. Vertices in an impact are put back to a fraction of their first
+// time of impact; that changes the moves around them, so detection runs
+// again, up to a number of passes. After them the vertices of any impact
+// left go back to where they started, detected again until no impact is
+// left; all at the start has none, so nothing tunnels if nothing
+// intersected at the start of the step.
+class ContinuousCollision
+{
+public:
+    ContinuousCollision() : safety_(0.9f), restitution_(0.0f), tolerance_(0.0f), max_passes_(1) {  }
+    void init(const TetraMesh &tmesh, float cell_scale, float safety, float restitution, int max_passes);
+    bool empty() const { return hash_.empty(); }
+    void detect(const std::vector<Eigen::Vector3f> &x0, const std::vector<Eigen::Vector3f> &x1,
+        std::vector<Impact> &impacts);
+    // Clamps x1 of the vertices in an impact to safety * their first toi,
+    // pass after pass, then reverts those of impacts still left to x0. The
+    // moved vertices get the velocity (x1 - x0) / h, and the approaching
+    // relative velocity is taken out of every impact (inelastic, or bounced
+    // by the restitution). Returns the impact count of the first pass.
+    int resolve(const std::vector<Eigen::Vector3f> &x0, std::vector<Eigen::Vector3f> &x1,
+        std::vector<Eigen::Vector3f> &velocity, const std::vector<float> &masses, float h);
+
+private:
+    void vertex_triangle(const std::vector<Eigen::Vector3f> &x0, const std::vector<Eigen::Vector3f> &x1,
+        int vi, std::vector<int> &faces, std::vector<Impact> &impacts) const;
+    void edge_edge(const std::vector<Eigen::Vector3f> &x0, const std::vector<Eigen::Vector3f> &x1,
+        int ei, std::vector<int> &faces, std::vector<Impact> &impacts) const;
+
+    float safety_;
+    float restitution_;
+    float tolerance_;               // distance counted as touching.
+    int max_passes_;
+    CollisionSpatialHash hash_;
+    std::vector<std::array<int, 2>> edges_;
+    std::vector<std::array<int, 3>> face_edges_;
+};
@@ -0,0 +1,150 @@
+#include "stdafx.h"
+#include "EmbeddedSurface.h"
+#include <Eigen/Dense>
+
+using Eigen::Vector3f;
+using Eigen::Matrix3f;
+
+void BindEmbeddedSurface(EmbeddedSurface& e, const TetraMesh& cage)
+{
+    auto &mesh = e.model->mesh();
+    const int n = static_cast<int>(mesh.n_vertices());
+    const int n_tetras = cage.n_tetras;
+    e.tetra = std::vector<int>(n, 0);
+    e.bary = std::vector<std::array<float, 4>>(n, { 1.0f, 0.0f, 0.0f, 0.0f });
+    if (n_tetras <= 0)
+        return;
+
+    auto point = [&cage](int vi) { return Vector3f{ cage.point[vi][0], cage.point[vi][1], cage.point[vi][2] }; };
+    // w1..3 = Dm^-1 (x - x0), degenerated tetras are never chosen.
+    std::vector<Matrix3f> Dm_inv(n_tetras, Matrix3f::Zero());
+    std::vector<bool> valid(n_tetras, false);
+    for (int ti = 0; ti < n_tetras; ++ti)
+    {
+        auto tvs = cage.tetra_vertices[ti];
+        Matrix3f Dm;
+        Dm << (point(tvs[1]) - point(tvs[0])), (point(tvs[2]) - point(tvs[0])), (point(tvs[3]) - point(tvs[0]));
+        if (std::abs(Dm.determinant()) < 1e-15f)
+            continue;
+        Dm_inv[ti] = Dm.inverse();
+        valid[ti] = true;
+    }
+    auto barycentric = [&](int ti, const Vector3f &x, std::array<float, 4> &w)
+    {
+        Vector3f l = Dm_inv[ti] * (x - point(cage.tetra_vertices[ti][0]));
+        w = { 1.0f - l.sum(), l[0], l[1], l[2] };
+        return std::min(std::min(w[0], w[1]), std::min(w[2], w[3]));
+    };
+
+    // uniform grid of the tetras' bounding boxes, about one tetra a cell.
+    Vector3f lo = point(0);
+    Vector3f hi = point(0);
+    for (int vi = 1; vi < cage.n_vertices; ++vi)
+    {
+        lo = lo.cwiseMin(point(vi));
+        hi = hi.cwiseMax(point(vi));
+    }
+    Vector3f extent = (hi - lo).cwiseMax(1e-6f);
+    float cell = std::cbrt(extent.prod() / n_tetras) * 2.0f;
+    std::array<int, 3> res;
+    for (int i = 0; i < 3; ++i)
+        res[i] = std::min(std::max(static_cast<int>(extent[i] / cell) + 1, 1), 128);
+    auto cell_of = [&](const Vector3f &x, int i)
+    {
+        int c = static_cast<int>((x[i] - lo[i]) / extent[i] * res[i]);
+        return std::min(std::max(c, 0), res[i] - 1);
+    };
+    std::vector<std::vector<int>> cells(res[0] * res[1] * res[2]);
+    for (int ti = 0; ti < n_tetras; ++ti)
+    {
+        if (!valid[ti])
+            continue;
+        auto tvs = cage.tetra_vertices[ti];
+        Vector3f tlo = point(tvs[0]);
+        Vector3f thi = point(tvs[0]);
+        for (int j = 1; j < 4; ++j)
+        {
+            tlo = tlo.cwiseMin(point(tvs[j]));
+            thi = thi.cwiseMax(point(tvs[j]));
+        }
+        for (int x = cell_of(tlo, 0); x <= cell_of(thi, 0); ++x)
+            for (int y = cell_of(tlo, 1); y <= cell_of(thi, 1); ++y)
+                for (int z = cell_of(tlo, 2); z <= cell_of(thi, 2); ++z)
+                    cells[(x * res[1] + y) * res[2] + z].push_back(ti);
+    }
+
+    const Vector3f offset{ e.model->position_[0], e.model->position_[1], e.model->position_[2] };
+#pragma omp parallel for
+    for (int vi = 0; vi < n; ++vi)
+    {
+        auto p = mesh.point(mesh.vertex_handle(vi));
+        Vector3f x = Vector3f{ p[0], p[1], p[2] } + offset;
+        std::array<float, 4> w;
+        float best = -INF;
+        auto visit = [&](int c)
+        {
+            for (int ti : cells[c])
+            {
+                float score = barycentric(ti, x, w);
+                if (score > best)
+                {
+                    best = score;
+                    e.tetra[vi] = ti;
+                    e.bary[vi] = w;
+                }
+            }
+            return !cells[c].empty();
+        };
+        const int cx = cell_of(x, 0), cy = cell_of(x, 1), cz = cell_of(x, 2);
+        // a tetra holding x is always in its own cell.
+        bool found = visit((cx * res[1] + cy) * res[2] + cz);
+        if (best >= -1e-4f)
+            continue;
+        // outside the cage, or a cell of only far tetras: the rings of
+        // cells around it, up to one past the first ring with any tetra.
+        const int max_ring = std::max(std::max(res[0], res[1]), res[2]);
+        int last = found ? 1 : max_ring;
+        for (int r = 1; r <= last; ++r)
+        {
+            bool hit = false;
+            for (int i = std::max(cx - r, 0); i <= std::min(cx + r, res[0] - 1); ++i)
+                for (int j = std::max(cy - r, 0); j <= std::min(cy + r, res[1] - 1); ++j)
+                {
+                    // the shell only: all of k on its x and y faces, else its two ends.
+                    if (std::abs(i - cx) == r || std::abs(j - cy) == r)
+                    {
+                        for (int k = std::max(cz - r, 0); k <= std::min(cz + r, res[2] - 1); ++k)
+                            hit |= visit((i * res[1] + j) * res[2] + k);
+                        continue;
+                    }
+                    if (cz - r >= 0)
+                        hit |= visit((i * res[1] + j) * res[2] + cz - r);
+                    if (cz + r < res[2])
+                        hit |= visit((i * res[1] + j) * res[2] + cz + r);
+                }
+            if (hit && last == max_ring)
+                last = std::min(r + 1, max_ring);
+        }
+    }
+}
+
+void SkinEmbeddedSurface(EmbeddedSurface& e, const TetraMesh& cage,
+    const std::vector<Vector3f>& p, int vertex_offset)
+{
+    auto &model = *e.model;
+    const int n = static_cast<int>(e.tetra.size());
+#pragma omp parallel for
+    for (int vi = 0; vi < n; ++vi)
+    {
+        auto tvs = cage.tetra_vertices[e.tetra[vi]];
+        auto &w = e.bary[vi];
+        Vector3f x = w[0] * p[vertex_offset + tvs[0]] + w[1] * p[vertex_offset + tvs[1]]
+            + w[2] * p[vertex_offset + tvs[2]] + w[3] * p[vertex_offset + tvs[3]];
+        model.set_point(vi, { x[0], x[1], x[2] });
+    }
+    model.tag_change();
+    auto &mesh = model.mesh();
+    if (mesh.has_face_normals() && mesh.has_vertex_normals())
+        mesh.update_normals();
+    model.update();
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "OpenGLMesh.h"
+#include <Eigen/Core>
+#include <array>
+#include <memory>
+
+// A render surface driven by the tetra mesh of a cage body ("EmbedIn" in
+// the scene), instead of sharing its boundary vertices: every surface
+// vertex keeps the cage tetra it lies in and its barycentric coordinates
+// there, so the cage can be much coarser than the surface.
+//
+// Vertices outside the cage are bound to the tetra they are least outside
+// of among the nearest ones, with negative coordinates, and follow its
+// affine motion.
+struct EmbeddedSurface
+{
+    std::shared_ptr<OpenGLMesh> model;
+    std::vector<int> tetra;                     // cage tetra, local index.
+    std::vector<std::array<float, 4>> bary;
+};
+
+// Bind the surface of `model` to the current shape of `cage`
+// (tetra points in world space, as the simulators write them).
+void BindEmbeddedSurface(EmbeddedSurface &e, const TetraMesh &cage);
+// Move the surface with the cage vertices p[vertex_offset + ...],
+// in parallel over the surface vertices.
+void SkinEmbeddedSurface(EmbeddedSurface &e, const TetraMesh &cage,
+    const std::vector<Eigen::Vector3f> &p, int vertex_offset);
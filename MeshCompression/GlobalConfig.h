@@ -21,4 +21,13 @@
 #define SCREEN_SHOT_FRAME_STEP  10
 #define SCREEN_SHOT_FRAME_END   1000
 
-#define NEED_TETRA              false
\ No newline at end of file
+#define NEED_TETRA              false
+// TetGen linked in (tetgen.h, tetgen.lib, both configurations): with
+// NEED_TETRA a ShowTetra model without tetra/ files is tetrahedralized on
+// load, with these switches (Y keeps the surface points first and unsplit,
+// as ReadTetra expects). 0 builds without TetGen: only the cache is read.
+#define USE_TETGEN              1
+#define TETRA_SWITCHES          "pq2.5Y"
+// Morton order of the loaded tetra meshes, off to keep TetGen's order
+// (compare both with "tetra_order <model>").
+#define TETRA_REORDER           false
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "stdafx.h"
+#include "HeadlessRunner.h"
+#include "SimulatorSimpleSpring_Midpoint.h"
+#include "SimulatorProjectiveDynamics.h"
+#include "SimulatorCorotationalFEM.h"
+#include "SimulatorXPBD.h"
+#include "SimulatorModal.h"
+#include "AdaptiveStepper.h"
+#include "TextConfigLoader.h"
+#include <QCoreApplication>
+#include <iostream>
+
+SimulatorBase *CreateSimulator(const QString &name, OpenGLScene &scene)
+{
+    if (name == "SimulatorSimpleSpring")
+        return new SimulatorSimpleSpring(scene);
+    if (name == "SimulatorSimpleFED")
+        return new SimulatorSimpleFED(scene);
+    if (name == "SimulatorSimpleSpring_Midpoint")
+        return new SimulatorSimpleSpring_Midpoint(scene);
+    if (name == "SimulatorProjectiveDynamics")
+        return new SimulatorProjectiveDynamics(scene);
+    if (name == "SimulatorCorotationalFEM")
+        return new SimulatorCorotationalFEM(scene);
+    if (name == "SimulatorXPBD")
+        return new SimulatorXPBD(scene);
+    if (name == "SimulatorModal")
+        return new SimulatorModal(scene);
+    return nullptr;
+}
+
+// FNV-1a of the vertex positions and velocities, equal for identical runs.
+static quint64 StateHash(const SimulatorBase &sim)
+{
+    SimState s;
+    sim.get_state(s);
+    quint64 h = 14695981039346656037ULL;
+    for (auto *v : { &s.position, &s.velocity })
+    {
+        auto p = reinterpret_cast<const uchar *>(v->data());
+        for (size_t i = 0; i < v->size() * sizeof(Vector3f); ++i)
+        {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+int RunHeadless(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    ConsoleMessageManager msg(std::cout);
+
+    if (argc < 6)
+    {
+        msg.log("usage: --headless <file.scene> <Simulator> <steps> <dt>"
+            " [--restore <checkpoint>] [--checkpoint <checkpoint>]", ERROR_MSG);
+        return 1;
+    }
+    QString scene_file = argv[2];
+    QString sim_name = argv[3];
+    long long steps = QString(argv[4]).toLongLong();
+    double dt = QString(argv[5]).toDouble();
+    if (steps <= 0 || dt <= 0.0)
+    {
+        msg.log("steps and dt must be positive.", ERROR_MSG);
+        return 1;
+    }
+    QString restore_file;
+    QString checkpoint_file;
+    for (int i = 6; i + 1 < argc; i += 2)
+    {
+        if (QString(argv[i]) == "--restore")
+            restore_file = argv[i + 1];
+        else if (QString(argv[i]) == "--checkpoint")
+            checkpoint_file = argv[i + 1];
+    }
+
+    OpenGLScene scene(msg);
+    if (!scene.open(scene_file))
+    {
+        msg.log("cannot open scene: ", scene_file, ERROR_MSG);
+        return 1;
+    }
+    auto bodies = _gather_bodies(scene);
+    if (bodies.empty())
+    {
+        msg.log("no tetra body in the scene (is NEED_TETRA / ShowTetra set?)", ERROR_MSG);
+        return 1;
+    }
+    int n_vertices = 0;
+    int n_tetras = 0;
+    for (auto &body : bodies)
+    {
+        n_vertices += body.model->tmesh().n_vertices;
+        n_tetras += body.model->tmesh().n_tetras;
+    }
+
+    std::unique_ptr<SimulatorBase> sim(CreateSimulator(sim_name, scene));
+    if (sim == nullptr)
+    {
+        msg.log("unknown simulator: ", sim_name, ERROR_MSG);
+        return 1;
+    }
+    sim->init(0.0);
+    TextConfigLoader tcl{ "./config/simulator.config" };
+    const bool deterministic = tcl.get_bool("Deterministic");
+    _set_deterministic(deterministic);
+    if (!restore_file.isEmpty())
+    {
+        if (!sim->load_checkpoint(restore_file))
+        {
+            msg.log("cannot restore checkpoint: ", restore_file, ERROR_MSG);
+            return 1;
+        }
+        msg.log(QString("restored at t = %0s, step %1.").arg(sim->get_time()).arg(sim->step_count()), INFO_MSG);
+    }
+
+    msg.log(QString("%0 on %1: %2 bodies, %3 vertices, %4 tetras, %5 steps of %6s")
+        .arg(sim_name).arg(scene_file).arg(static_cast<int>(bodies.size()))
+        .arg(n_vertices).arg(n_tetras)
+        .arg(steps).arg(dt), INFO_MSG);
+
+    double e_0 = sim->energy();
+    QElapsedTimer timer;
+    timer.start();
+    // with Adaptive_Enable, dt is the interval of a step of the output,
+    // covered in steps of the controller's choice. Deterministic runs keep dt.
+    std::unique_ptr<AdaptiveStepper> stepper;
+    if (tcl.get_bool("Adaptive_Enable") && !deterministic)
+        stepper.reset(new AdaptiveStepper(sim.get()));
+    for (long long i = 0; i < steps; ++i)
+    {
+        if (stepper != nullptr)
+            stepper->advance(dt);
+        else
+            sim->step(dt);
+    }
+    double ns = static_cast<double>(timer.nsecsElapsed());
+    double e_1 = sim->energy();
+
+    msg.log(QString("steps/s:             %0").arg(steps / (ns * 1e-9), 0, 'f', 1), INFO_MSG);
+    msg.log(QString("ns per tetra-step:   %0").arg(ns / steps / n_tetras, 0, 'f', 2), INFO_MSG);
+    msg.log(QString("energy:              %0 -> %1 J").arg(e_0, 0, 'g', 8).arg(e_1, 0, 'g', 8), INFO_MSG);
+    msg.log(QString("energy drift:        %0 %").arg(
+        e_0 != 0.0 ? (e_1 - e_0) / std::abs(e_0) * 100.0 : 0.0, 0, 'f', 4), INFO_MSG);
+    msg.log(QString("contacts (last):     %0").arg(sim->n_contacts()), INFO_MSG);
+    msg.log(QString("impacts (last):      %0").arg(sim->n_impacts()), INFO_MSG);
+    msg.log(QString("state hash:          %0").arg(StateHash(*sim), 16, 16, QChar('0')), INFO_MSG);
+    if (stepper != nullptr)
+    {
+        msg.log(QString("adaptive steps:      %0 accepted, %1 rejected")
+            .arg(stepper->accepted()).arg(stepper->rejected()), INFO_MSG);
+        msg.log(QString("adaptive dt:         %0 .. %1 s")
+            .arg(stepper->dt_min_used()).arg(stepper->dt_max_used()), INFO_MSG);
+    }
+    if (!checkpoint_file.isEmpty())
+    {
+        if (!sim->save_checkpoint(checkpoint_file))
+        {
+            msg.log("cannot write checkpoint: ", checkpoint_file, ERROR_MSG);
+            return 1;
+        }
+        msg.log(QString("checkpoint at t = %0s, step %1.").arg(sim->get_time()).arg(sim->step_count()), INFO_MSG);
+    }
+    return 0;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "SimulatorBase.h"
+
+// Simulator by its class name, nullptr if unknown.
+SimulatorBase *CreateSimulator(const QString &name, OpenGLScene &scene);
+
+// Run a simulator without any window:
+//   MeshCompression --headless <file.scene> <Simulator> <steps> <dt>
+// and report steps/s, ns per tetra per step and energy drift.
+int RunHeadless(int argc, char *argv[]);
@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "ManifoldHarmonics.h"
+#include "MeshLaplacian.h"
+#include "SparseEigenSolver.h"
+#include <QDir>
+#include <QFileInfo>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+#define HARMONICS_CACHE_SIZE 4
+
+struct HarmonicsCacheHeader
+{
+    char magic[4];                  // "MHA1"
+    qint32 n_vertices;
+    qint32 n_harmonics;
+    qint32 reserved;
+};
+
+static bool _load_harmonics(const QString &filename, int n, int k, ManifoldHarmonics &mh)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    HarmonicsCacheHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, "MHA1", 4) != 0
+        || header.n_vertices != n || header.n_harmonics != k)
+        return false;
+    mh.values.resize(k);
+    mh.vectors.resize(n, k);
+    const qint64 bytes_values = k * sizeof(double);
+    const qint64 bytes_vectors = static_cast<qint64>(mh.vectors.size()) * sizeof(double);
+    return file.read(reinterpret_cast<char *>(mh.values.data()), bytes_values) == bytes_values
+        && file.read(reinterpret_cast<char *>(mh.vectors.data()), bytes_vectors) == bytes_vectors;
+}
+
+static void _save_harmonics(const QString &filename, const ManifoldHarmonics &mh)
+{
+    QDir().mkpath(QFileInfo(filename).path());
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+    HarmonicsCacheHeader header;
+    std::memcpy(header.magic, "MHA1", 4);
+    header.n_vertices = static_cast<qint32>(mh.vectors.rows());
+    header.n_harmonics = static_cast<qint32>(mh.vectors.cols());
+    header.reserved = 0;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(mh.values.data()), mh.values.size() * sizeof(double));
+    file.write(reinterpret_cast<const char *>(mh.vectors.data()), static_cast<qint64>(mh.vectors.size()) * sizeof(double));
+}
+
+static bool _solve_harmonics(const TriMesh &mesh, int k, ManifoldHarmonics &mh)
+{
+    auto lap = CachedMeshLaplacian(mesh);
+    Eigen::SparseMatrix<double> K = -lap->L;
+    // a vertex without faces has no mass: keep M positive.
+    Eigen::VectorXd M = lap->mass.cwiseMax(1e-12 * lap->mass.maxCoeff());
+    if (!SmallestEigenpairs(K, M, k, mh.values, mh.vectors))
+        return false;
+    mh.values = mh.values.cwiseMax(0.0);
+    for (int i = 0; i < k; ++i)
+        mh.vectors.col(i).normalize();
+    return true;
+}
+
+std::shared_ptr<const ManifoldHarmonics> CachedManifoldHarmonics(const TriMesh& mesh, int k)
+{
+    static std::mutex mutex;
+    static std::vector<std::pair<quint64, std::shared_ptr<const ManifoldHarmonics>>> cache;  // most recent last.
+
+    const int n = static_cast<int>(mesh.n_vertices());
+    k = std::min(k, n - 1);
+    if (k <= 0)
+        return nullptr;
+    quint64 key = MeshHash(mesh);
+    key = (key ^ static_cast<quint64>(k)) * 1099511628211ULL;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            if (cache[i].first != key)
+                continue;
+            auto hit = cache[i];
+            cache.erase(cache.begin() + i);
+            cache.push_back(hit);
+            return hit.second;
+        }
+    }
+
+    auto mh = std::make_shared<ManifoldHarmonics>();
+    QString filename = QString("./cache/harmonics_%0.bin").arg(key, 16, 16, QChar('0'));
+    if (!_load_harmonics(filename, n, k, *mh))
+    {
+        if (!_solve_harmonics(mesh, k, *mh))
+            return nullptr;
+        _save_harmonics(filename, *mh);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.emplace_back(key, mh);
+    if (cache.size() > HARMONICS_CACHE_SIZE)
+        cache.erase(cache.begin());
+    return mh;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "OpenMeshBasic.h"
+#include <Eigen/Core>
+#include <memory>
+
+// The lowest manifold harmonics of a triangle mesh: -L phi = lambda mass phi
+// with the cotangent Laplacian and the lumped mass of MeshLaplacian, the
+// smooth per-vertex functions the offset is spanned by (DdDa).
+//
+// Solved by shift-invert Lanczos (SmallestEigenpairs), the constant one
+// first; each vector scaled to unit length, as eigs returns them. Kept in
+// memory for the last few shapes and in ./cache/ by the hash of the shape and
+// the count, so a mesh is only ever solved once.
+struct ManifoldHarmonics
+{
+    Eigen::VectorXd values;         // ascending.
+    Eigen::MatrixXd vectors;        // n x k.
+};
+
+// nullptr if the eigen solver fails.
+std::shared_ptr<const ManifoldHarmonics> CachedManifoldHarmonics(const TriMesh &mesh, int k);
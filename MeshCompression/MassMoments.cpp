@@ -0,0 +1,704 @@
+#include "stdafx.h"
+#include "MassMoments.h"
+#include <Eigen/Geometry>
+
+using Eigen::Vector3d;
+
+// integral k of a triangle is P_k(p0, p1, p2) n[axis_k] / denominator_k,
+// n = (p1 - p0) x (p2 - p0); the terms of the MEX, factored.
+static const int _axis[N_MOMENTS] = { 0, 0, 1, 2, 0, 1, 2, 0, 1, 2 };
+static const double _denominator[N_MOMENTS] = { 6, 24, 24, 24, 60, 60, 60, 120, 120, 120 };
+
+// the sum, all quadratic and all cubic monomials of u0, u1, u2, with their
+// derivatives by u_i.
+struct _Symmetric
+{
+    double S, Q, C;
+    double dQ[3], dC[3];
+};
+
+static inline _Symmetric _symmetric(const Vector3d p[3], int c)
+{
+    const double u0 = p[0][c], u1 = p[1][c], u2 = p[2][c];
+    _Symmetric r;
+    r.S = u0 + u1 + u2;
+    r.Q = u0 * u0 + u1 * u1 + u2 * u2 + u0 * u1 + u0 * u2 + u1 * u2;
+    r.C = u0 * u0 * u0 + u1 * u1 * u1 + u2 * u2 * u2
+        + u0 * u0 * (u1 + u2) + u1 * u1 * (u0 + u2) + u2 * u2 * (u0 + u1) + u0 * u1 * u2;
+    for (int i = 0; i < 3; ++i)
+    {
+        const double ui = p[i][c];
+        r.dQ[i] = ui + r.S;
+        r.dC[i] = ui * (ui + r.S) + r.Q;
+    }
+    return r;
+}
+
+// sum_i u_i^2 (Sv + 2 v_i) + sum_i<j u_i u_j (Sv + v_i + v_j), the xy, yz, zx
+// integrand, with its derivatives by u_i and v_i.
+static inline double _mixed(const _Symmetric &u, const _Symmetric &v,
+    const Vector3d p[3], int cu, int cv, double du[3], double dv[3])
+{
+    double uv = 0.0;
+    double value = 0.0;
+    for (int i = 0; i < 3; ++i)
+    {
+        const double ui = p[i][cu], vi = p[i][cv];
+        uv += ui * vi;
+        value += ui * ui * (v.S + 2.0 * vi);
+        for (int j = i + 1; j < 3; ++j)
+            value += ui * p[j][cu] * (v.S + vi + p[j][cv]);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        const double ui = p[i][cu], vi = p[i][cv];
+        du[i] = ui * v.S + 2.0 * ui * vi + u.S * v.S + u.S * vi + uv;
+        dv[i] = u.Q + ui * (ui + u.S);
+    }
+    return value;
+}
+
+// Mass, center and inertia about it from the integrals s, DsDd by the
+// Jacobian of that map.
+static void _derive(const MomentVector &s, const MomentMatrix *DsDd, MassMoments &moments)
+{
+    const double m = s[0];
+    auto &M = moments.M;
+    M[MOMENT_VOLUME] = m;
+    M[MOMENT_CX] = s[1] / m;
+    M[MOMENT_CY] = s[2] / m;
+    M[MOMENT_CZ] = s[3] / m;
+    M[MOMENT_IXX] = s[5] + s[6] - (s[2] * s[2] + s[3] * s[3]) / m;
+    M[MOMENT_IYY] = s[4] + s[6] - (s[3] * s[3] + s[1] * s[1]) / m;
+    M[MOMENT_IZZ] = s[4] + s[5] - (s[1] * s[1] + s[2] * s[2]) / m;
+    M[MOMENT_IXY] = -(s[7] - s[1] * s[2] / m);
+    M[MOMENT_IYZ] = -(s[8] - s[2] * s[3] / m);
+    M[MOMENT_IZX] = -(s[9] - s[3] * s[1] / m);
+
+    if (DsDd == nullptr)
+    {
+        moments.DmDd.resize(N_MOMENTS, 0);
+        return;
+    }
+
+    Eigen::Matrix<double, N_MOMENTS, N_MOMENTS> J = Eigen::Matrix<double, N_MOMENTS, N_MOMENTS>::Zero();
+    const double m2 = m * m;
+    J(0, 0) = 1.0;
+    for (int c = 1; c <= 3; ++c)
+    {
+        J(c, c) = 1.0 / m;
+        J(c, 0) = -s[c] / m2;
+    }
+    // I_cc = s_aa + s_bb - (s_a^2 + s_b^2) / m, a, b the other two axes.
+    for (int c = 0; c < 3; ++c)
+    {
+        const int a = (c + 1) % 3, b = (c + 2) % 3;
+        J(4 + c, 4 + a) = 1.0;
+        J(4 + c, 4 + b) = 1.0;
+        J(4 + c, 1 + a) = -2.0 * s[1 + a] / m;
+        J(4 + c, 1 + b) = -2.0 * s[1 + b] / m;
+        J(4 + c, 0) = (s[1 + a] * s[1 + a] + s[1 + b] * s[1 + b]) / m2;
+    }
+    // I_ab = -(s_ab - s_a s_b / m), ab = xy, yz, zx.
+    for (int c = 0; c < 3; ++c)
+    {
+        const int a = c, b = (c + 1) % 3;
+        J(7 + c, 7 + c) = -1.0;
+        J(7 + c, 1 + a) = s[1 + b] / m;
+        J(7 + c, 1 + b) = s[1 + a] / m;
+        J(7 + c, 0) = -s[1 + a] * s[1 + b] / m2;
+    }
+    moments.DmDd.noalias() = J * *DsDd;
+}
+
+void ComputeMassMomentsReference(const Eigen::MatrixX3d& points, const std::vector<std::array<int, 3>>& triangles,
+    const Eigen::MatrixX3d* directions, MassMoments& moments)
+{
+    const int n = static_cast<int>(points.rows());
+    const int n_triangles = static_cast<int>(triangles.size());
+
+    // STEP 1:  Integrals s and, along the directions, their derivatives.
+    MomentVector s = MomentVector::Zero();
+    MomentMatrix DsDd;
+    if (directions != nullptr)
+        DsDd = MomentMatrix::Zero(N_MOMENTS, n);
+
+    for (int t = 0; t < n_triangles; ++t)
+    {
+        const auto &tri = triangles[t];
+        const Vector3d p[3] = { points.row(tri[0]), points.row(tri[1]), points.row(tri[2]) };
+        const Vector3d normal = (p[1] - p[0]).cross(p[2] - p[0]);
+        const _Symmetric x = _symmetric(p, 0), y = _symmetric(p, 1), z = _symmetric(p, 2);
+
+        // P_k, and dP[k][i] its gradient by vertex i.
+        double P[N_MOMENTS];
+        Vector3d dP[N_MOMENTS][3];
+        double du[3], dv[3];
+        P[0] = x.S;
+        P[1] = x.Q;
+        P[2] = y.Q;
+        P[3] = z.Q;
+        P[4] = x.C;
+        P[5] = y.C;
+        P[6] = z.C;
+        for (int i = 0; i < 3; ++i)
+        {
+            dP[0][i] = { 1.0, 0.0, 0.0 };
+            dP[1][i] = { x.dQ[i], 0.0, 0.0 };
+            dP[2][i] = { 0.0, y.dQ[i], 0.0 };
+            dP[3][i] = { 0.0, 0.0, z.dQ[i] };
+            dP[4][i] = { x.dC[i], 0.0, 0.0 };
+            dP[5][i] = { 0.0, y.dC[i], 0.0 };
+            dP[6][i] = { 0.0, 0.0, z.dC[i] };
+        }
+        P[7] = _mixed(x, y, p, 0, 1, du, dv);
+        for (int i = 0; i < 3; ++i)
+            dP[7][i] = { du[i], dv[i], 0.0 };
+        P[8] = _mixed(y, z, p, 1, 2, du, dv);
+        for (int i = 0; i < 3; ++i)
+            dP[8][i] = { 0.0, du[i], dv[i] };
+        P[9] = _mixed(z, x, p, 2, 0, du, dv);
+        for (int i = 0; i < 3; ++i)
+            dP[9][i] = { dv[i], 0.0, du[i] };
+
+        for (int k = 0; k < N_MOMENTS; ++k)
+            s[k] += P[k] * normal[_axis[k]] / _denominator[k];
+
+        if (directions == nullptr)
+            continue;
+        for (int i = 0; i < 3; ++i)
+        {
+            // d normal[a] / d p_i = (p_i+1 - p_i-1) x e_a, along dir: (dir x (p_i+1 - p_i-1))[a].
+            const Vector3d dir = directions->row(tri[i]);
+            const Vector3d dn = dir.cross(p[(i + 1) % 3] - p[(i + 2) % 3]);
+            for (int k = 0; k < N_MOMENTS; ++k)
+            {
+                const int a = _axis[k];
+                DsDd(k, tri[i]) += (dP[k][i].dot(dir) * normal[a] + P[k] * dn[a]) / _denominator[k];
+            }
+        }
+    }
+
+    _derive(s, directions != nullptr ? &DsDd : nullptr, moments);
+}
+
+#define MOMENT_BLOCK 256        // triangles of a parallel block.
+#define LANES 4
+
+using Lane = Eigen::Array<double, LANES, 1>;
+static const double _inv_denominator[N_MOMENTS] = {
+    1.0 / 6, 1.0 / 24, 1.0 / 24, 1.0 / 24, 1.0 / 60, 1.0 / 60, 1.0 / 60, 1.0 / 120, 1.0 / 120, 1.0 / 120
+};
+
+// The integrals s of a triangle (T = double) or of LANES of them at once
+// (T = Lane), p[i][c] coordinate c of corner i, and with dir, ds[i] their
+// derivatives along dir[i] at corner i. The terms of _symmetric / _mixed,
+// written out so that every operation is one on packets.
+template <typename T>
+static inline void _kernel(const T p[3][3], const T (*dir)[3], T s[N_MOMENTS], T ds[3][N_MOMENTS])
+{
+    const T e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+    const T e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+    const T n[3] = {
+        e1[1] * e2[2] - e1[2] * e2[1],
+        e1[2] * e2[0] - e1[0] * e2[2],
+        e1[0] * e2[1] - e1[1] * e2[0]
+    };
+
+    T S[3], Q[3], C[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        const T &u0 = p[0][c], &u1 = p[1][c], &u2 = p[2][c];
+        S[c] = u0 + u1 + u2;
+        Q[c] = u0 * u0 + u1 * u1 + u2 * u2 + u0 * u1 + u0 * u2 + u1 * u2;
+        C[c] = u0 * u0 * u0 + u1 * u1 * u1 + u2 * u2 * u2
+            + u0 * u0 * (u1 + u2) + u1 * u1 * (u0 + u2) + u2 * u2 * (u0 + u1) + u0 * u1 * u2;
+    }
+    // xy, yz, zx: u = j, v = j + 1.
+    T X[3], UV[3];
+    for (int j = 0; j < 3; ++j)
+    {
+        const int cu = j, cv = (j + 1) % 3;
+        const T &u0 = p[0][cu], &u1 = p[1][cu], &u2 = p[2][cu];
+        const T &v0 = p[0][cv], &v1 = p[1][cv], &v2 = p[2][cv];
+        const T &Sv = S[cv];
+        X[j] = u0 * u0 * (Sv + 2.0 * v0) + u1 * u1 * (Sv + 2.0 * v1) + u2 * u2 * (Sv + 2.0 * v2)
+            + u0 * u1 * (Sv + v0 + v1) + u0 * u2 * (Sv + v0 + v2) + u1 * u2 * (Sv + v1 + v2);
+        UV[j] = u0 * v0 + u1 * v1 + u2 * v2;
+    }
+
+    const T *P[N_MOMENTS] = { &S[0], &Q[0], &Q[1], &Q[2], &C[0], &C[1], &C[2], &X[0], &X[1], &X[2] };
+    for (int k = 0; k < N_MOMENTS; ++k)
+        s[k] = *P[k] * n[_axis[k]] * _inv_denominator[k];
+    if (dir == nullptr)
+        return;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const T *d = dir[i];
+        const T *a = p[(i + 1) % 3];
+        const T *b = p[(i + 2) % 3];
+        const T r[3] = { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+        // d normal along d: d x (p_i+1 - p_i+2).
+        const T dn[3] = {
+            d[1] * r[2] - d[2] * r[1],
+            d[2] * r[0] - d[0] * r[2],
+            d[0] * r[1] - d[1] * r[0]
+        };
+        T g[N_MOMENTS];
+        g[0] = d[0];
+        for (int c = 0; c < 3; ++c)
+        {
+            const T &ui = p[i][c];
+            g[1 + c] = (ui + S[c]) * d[c];
+            g[4 + c] = (ui * (ui + S[c]) + Q[c]) * d[c];
+        }
+        for (int j = 0; j < 3; ++j)
+        {
+            const int cu = j, cv = (j + 1) % 3;
+            const T &ui = p[i][cu], &vi = p[i][cv];
+            T du = ui * S[cv] + 2.0 * ui * vi + S[cu] * S[cv] + S[cu] * vi + UV[j];
+            T dv = Q[cu] + ui * (ui + S[cu]);
+            g[7 + j] = du * d[cu] + dv * d[cv];
+        }
+        for (int k = 0; k < N_MOMENTS; ++k)
+            ds[i][k] = (g[k] * n[_axis[k]] + *P[k] * dn[_axis[k]]) * _inv_denominator[k];
+    }
+}
+
+// One surface of a pass: its points, the sign of the directions, and out
+// the integrals and the derivative of each corner, column 3 t + i.
+struct _Surface
+{
+    const Eigen::MatrixX3d *points;
+    double direction_sign;
+    MomentVector s;
+    MomentMatrix corners;
+};
+
+// All surfaces share triangles (and directions): one pass over the
+// triangles, LANES at a time, blocks in parallel, block sums added in order.
+static void _integrate(const std::vector<std::array<int, 3>> &triangles, const Eigen::MatrixX3d *directions,
+    std::vector<_Surface> &surfaces)
+{
+    const int n_triangles = static_cast<int>(triangles.size());
+    const int n_blocks = (n_triangles + MOMENT_BLOCK - 1) / MOMENT_BLOCK;
+    const int n_surfaces = static_cast<int>(surfaces.size());
+    std::vector<MomentMatrix> partial(n_surfaces, MomentMatrix::Zero(N_MOMENTS, n_blocks));
+    for (auto &surface : surfaces)
+    {
+        if (directions != nullptr)
+            surface.corners.resize(N_MOMENTS, 3 * n_triangles);
+        else
+            surface.corners.resize(N_MOMENTS, 0);
+    }
+
+#pragma omp parallel for
+    for (int b = 0; b < n_blocks; ++b)
+    {
+        const int begin = b * MOMENT_BLOCK;
+        const int end = std::min(begin + MOMENT_BLOCK, n_triangles);
+        for (int si = 0; si < n_surfaces; ++si)
+        {
+            auto &surface = surfaces[si];
+            const auto &points = *surface.points;
+            Lane acc[N_MOMENTS];
+            for (int k = 0; k < N_MOMENTS; ++k)
+                acc[k].setZero();
+            int t = begin;
+            for (; t + LANES <= end; t += LANES)
+            {
+                Lane p[3][3], d[3][3];
+                for (int l = 0; l < LANES; ++l)
+                {
+                    const auto &tri = triangles[t + l];
+                    for (int i = 0; i < 3; ++i)
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            p[i][c][l] = points(tri[i], c);
+                            if (directions != nullptr)
+                                d[i][c][l] = surface.direction_sign * (*directions)(tri[i], c);
+                        }
+                }
+                Lane s[N_MOMENTS], ds[3][N_MOMENTS];
+                _kernel<Lane>(p, directions != nullptr ? d : nullptr, s, ds);
+                for (int k = 0; k < N_MOMENTS; ++k)
+                    acc[k] += s[k];
+                if (directions == nullptr)
+                    continue;
+                for (int l = 0; l < LANES; ++l)
+                    for (int i = 0; i < 3; ++i)
+                        for (int k = 0; k < N_MOMENTS; ++k)
+                            surface.corners(k, 3 * (t + l) + i) = ds[i][k][l];
+            }
+            for (int k = 0; k < N_MOMENTS; ++k)
+                partial[si](k, b) = acc[k].sum();
+            for (; t < end; ++t)
+            {
+                const auto &tri = triangles[t];
+                double p[3][3], d[3][3];
+                for (int i = 0; i < 3; ++i)
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        p[i][c] = points(tri[i], c);
+                        if (directions != nullptr)
+                            d[i][c] = surface.direction_sign * (*directions)(tri[i], c);
+                    }
+                double s[N_MOMENTS], ds[3][N_MOMENTS];
+                _kernel<double>(p, directions != nullptr ? d : nullptr, s, ds);
+                for (int k = 0; k < N_MOMENTS; ++k)
+                    partial[si](k, b) += s[k];
+                if (directions == nullptr)
+                    continue;
+                for (int i = 0; i < 3; ++i)
+                    for (int k = 0; k < N_MOMENTS; ++k)
+                        surface.corners(k, 3 * t + i) = ds[i][k];
+            }
+        }
+    }
+
+    for (int si = 0; si < n_surfaces; ++si)
+    {
+        surfaces[si].s.setZero();
+        for (int b = 0; b < n_blocks; ++b)
+            surfaces[si].s += partial[si].col(b);
+    }
+}
+
+// corners of each vertex, in triangle order: vertex v owns ids[offset[v]..offset[v+1]).
+static void _vertex_corners(const std::vector<std::array<int, 3>> &triangles, int n,
+    std::vector<int> &offset, std::vector<int> &ids)
+{
+    const int n_corners = 3 * static_cast<int>(triangles.size());
+    offset.assign(n + 1, 0);
+    for (int c = 0; c < n_corners; ++c)
+        ++offset[triangles[c / 3][c % 3] + 1];
+    for (int v = 0; v < n; ++v)
+        offset[v + 1] += offset[v];
+    ids.resize(n_corners);
+    std::vector<int> fill(offset.begin(), offset.end() - 1);
+    for (int c = 0; c < n_corners; ++c)
+        ids[fill[triangles[c / 3][c % 3]]++] = c;
+}
+
+// DsDd.col(v) = sum of the corners of v; no two threads write a column.
+static void _gather(const std::vector<int> &offset, const std::vector<int> &ids,
+    const MomentMatrix &corners, double sign, MomentMatrix &DsDd)
+{
+    const int n = static_cast<int>(offset.size()) - 1;
+    DsDd = MomentMatrix::Zero(N_MOMENTS, n);
+#pragma omp parallel for
+    for (int v = 0; v < n; ++v)
+    {
+        for (int j = offset[v]; j < offset[v + 1]; ++j)
+            DsDd.col(v) += corners.col(ids[j]);
+        DsDd.col(v) *= sign;
+    }
+}
+
+void ComputeMassMoments(const Eigen::MatrixX3d& points, const std::vector<std::array<int, 3>>& triangles,
+    const Eigen::MatrixX3d* directions, MassMoments& moments)
+{
+    std::vector<_Surface> surfaces(1);
+    surfaces[0].points = &points;
+    surfaces[0].direction_sign = 1.0;
+    _integrate(triangles, directions, surfaces);
+    if (directions == nullptr)
+    {
+        _derive(surfaces[0].s, nullptr, moments);
+        return;
+    }
+
+    std::vector<int> offset, ids;
+    _vertex_corners(triangles, static_cast<int>(points.rows()), offset, ids);
+    MomentMatrix DsDd;
+    _gather(offset, ids, surfaces[0].corners, 1.0, DsDd);
+    _derive(surfaces[0].s, &DsDd, moments);
+}
+
+void ComputeShellMoments(const Eigen::MatrixX3d& inner, const Eigen::MatrixX3d& outer,
+    const std::vector<std::array<int, 3>>& triangles, const Eigen::MatrixX3d& directions, ShellMoments& moments)
+{
+    const int n = static_cast<int>(inner.rows());
+
+    // STEP 1:  Both surfaces in one pass, the outer one against the directions.
+    std::vector<_Surface> surfaces(2);
+    surfaces[0].points = &inner;
+    surfaces[0].direction_sign = 1.0;
+    surfaces[1].points = &outer;
+    surfaces[1].direction_sign = -1.0;
+    _integrate(triangles, &directions, surfaces);
+
+    // STEP 2:  Per vertex; the shell is the outer surface and the inner one
+    //          reversed, its integrals outer minus inner.
+    std::vector<int> offset, ids;
+    _vertex_corners(triangles, n, offset, ids);
+    MomentMatrix DsDd_in, DsDd_out, DsDd_shell(N_MOMENTS, 2 * n);
+    _gather(offset, ids, surfaces[0].corners, 1.0, DsDd_in);
+    _gather(offset, ids, surfaces[1].corners, 1.0, DsDd_out);
+    DsDd_shell << -DsDd_in, DsDd_out;
+
+    _derive(surfaces[0].s, &DsDd_in, moments.in);
+    _derive(surfaces[1].s, &DsDd_out, moments.out);
+    MomentVector s_shell = surfaces[1].s - surfaces[0].s;
+    _derive(s_shell, &DsDd_shell, moments.shell);
+}
+
+// Triangles list[0..count), each one's integrals to column t of triangle_s
+// and the derivatives at its corners to corners; blocks in parallel, no two
+// write a column.
+static void _evaluate(const std::vector<std::array<int, 3>> &triangles, const int *list, int count,
+    const Eigen::MatrixX3d &points, const Eigen::MatrixX3d &directions,
+    MomentMatrix &triangle_s, MomentMatrix &corners)
+{
+    const int n_blocks = (count + MOMENT_BLOCK - 1) / MOMENT_BLOCK;
+#pragma omp parallel for
+    for (int b = 0; b < n_blocks; ++b)
+    {
+        const int begin = b * MOMENT_BLOCK;
+        const int end = std::min(begin + MOMENT_BLOCK, count);
+        int j = begin;
+        for (; j + LANES <= end; j += LANES)
+        {
+            Lane p[3][3], d[3][3];
+            for (int l = 0; l < LANES; ++l)
+            {
+                const auto &tri = triangles[list[j + l]];
+                for (int i = 0; i < 3; ++i)
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        p[i][c][l] = points(tri[i], c);
+                        d[i][c][l] = directions(tri[i], c);
+                    }
+            }
+            Lane s[N_MOMENTS], ds[3][N_MOMENTS];
+            _kernel<Lane>(p, d, s, ds);
+            for (int l = 0; l < LANES; ++l)
+            {
+                const int t = list[j + l];
+                for (int k = 0; k < N_MOMENTS; ++k)
+                    triangle_s(k, t) = s[k][l];
+                for (int i = 0; i < 3; ++i)
+                    for (int k = 0; k < N_MOMENTS; ++k)
+                        corners(k, 3 * t + i) = ds[i][k][l];
+            }
+        }
+        for (; j < end; ++j)
+        {
+            const int t = list[j];
+            const auto &tri = triangles[t];
+            double p[3][3], d[3][3];
+            for (int i = 0; i < 3; ++i)
+                for (int c = 0; c < 3; ++c)
+                {
+                    p[i][c] = points(tri[i], c);
+                    d[i][c] = directions(tri[i], c);
+                }
+            double s[N_MOMENTS], ds[3][N_MOMENTS];
+            _kernel<double>(p, d, s, ds);
+            for (int k = 0; k < N_MOMENTS; ++k)
+                triangle_s(k, t) = s[k];
+            for (int i = 0; i < 3; ++i)
+                for (int k = 0; k < N_MOMENTS; ++k)
+                    corners(k, 3 * t + i) = ds[i][k];
+        }
+    }
+}
+
+MassMomentsCache::MassMomentsCache(const std::vector<std::array<int, 3>>& triangles,
+    const Eigen::MatrixX3d& directions, double direction_sign) :
+    triangles_(triangles), directions_(direction_sign * directions), recomputed_(0)
+{
+    _vertex_corners(triangles_, static_cast<int>(directions_.rows()), offset_, ids_);
+}
+
+int MassMomentsCache::update(const Eigen::MatrixX3d& points, double tolerance)
+{
+    const int n = static_cast<int>(directions_.rows());
+    const int n_triangles = static_cast<int>(triangles_.size());
+
+    // STEP 1:  The triangles to recompute: all of them the first time, then
+    //          those with a vertex moved beyond tolerance.
+    changed_.clear();
+    if (points_.rows() != n)
+    {
+        points_ = points;
+        triangle_s_.resize(N_MOMENTS, n_triangles);
+        corners_.resize(N_MOMENTS, 3 * n_triangles);
+        DsDd_ = MomentMatrix::Zero(N_MOMENTS, n);
+        for (int t = 0; t < n_triangles; ++t)
+            changed_.push_back(t);
+    }
+    else
+    {
+        mark_.assign(n, 0);
+        const double tolerance2 = tolerance * tolerance;
+        for (int v = 0; v < n; ++v)
+        {
+            if ((points.row(v) - points_.row(v)).squaredNorm() > tolerance2)
+            {
+                points_.row(v) = points.row(v);
+                mark_[v] = 1;
+            }
+        }
+        for (int t = 0; t < n_triangles; ++t)
+        {
+            const auto &tri = triangles_[t];
+            if (mark_[tri[0]] || mark_[tri[1]] || mark_[tri[2]])
+                changed_.push_back(t);
+        }
+    }
+    const int n_changed = static_cast<int>(changed_.size());
+    if (n_changed == 0)
+        return 0;
+    recomputed_ += n_changed;
+
+    // STEP 2:  Recompute them; the totals by their difference.
+    const bool full = 8 * static_cast<long long>(n_changed) > n_triangles;
+    MomentVector before = MomentVector::Zero();
+    if (!full)
+        for (int t : changed_)
+            before += triangle_s_.col(t);
+    _evaluate(triangles_, changed_.data(), n_changed, points_, directions_, triangle_s_, corners_);
+    if (full)
+    {
+        s_ = triangle_s_.rowwise().sum();
+    }
+    else
+    {
+        MomentVector after = MomentVector::Zero();
+        for (int t : changed_)
+            after += triangle_s_.col(t);
+        s_ += after - before;
+    }
+
+    // STEP 3:  Gather the vertices of the recomputed triangles again, the
+    //          projection by the change of their columns.
+    mark_.assign(n, 0);
+    for (int t : changed_)
+        for (int v : triangles_[t])
+            mark_[v] = 1;
+    changed_.clear();
+    for (int v = 0; v < n; ++v)
+        if (mark_[v])
+            changed_.push_back(v);
+    const int n_gather = static_cast<int>(changed_.size());
+    const bool project = basis_.size() > 0 && !full;
+    MomentMatrix change(N_MOMENTS, project ? n_gather : 0);
+#pragma omp parallel for
+    for (int j = 0; j < n_gather; ++j)
+    {
+        const int v = changed_[j];
+        MomentVector column = MomentVector::Zero();
+        for (int c = offset_[v]; c < offset_[v + 1]; ++c)
+            column += corners_.col(ids_[c]);
+        if (project)
+            change.col(j) = column - DsDd_.col(v);
+        DsDd_.col(v) = column;
+    }
+    if (project)
+    {
+        for (int j = 0; j < n_gather; ++j)
+            projected_.noalias() += change.col(j) * basis_.row(changed_[j]);
+    }
+    else if (basis_.size() > 0)
+    {
+        projected_.noalias() = DsDd_ * basis_;
+    }
+    return n_changed;
+}
+
+void MassMomentsCache::set_basis(const Eigen::MatrixXd& basis)
+{
+    basis_ = basis;
+    if (basis_.size() > 0 && points_.rows() > 0)
+        projected_.noalias() = DsDd_ * basis_;
+    else
+        projected_.resize(N_MOMENTS, basis_.cols());
+}
+
+void MassMomentsCache::moments(MassMoments& moments) const
+{
+    _derive(s_, &DsDd_, moments);
+}
+
+void CombineShellMoments(const MassMomentsCache& inner, const MassMomentsCache& outer, ShellMoments& moments)
+{
+    const int n = static_cast<int>(inner.derivatives().cols());
+    MomentMatrix DsDd_shell(N_MOMENTS, 2 * n);
+    DsDd_shell << -inner.derivatives(), outer.derivatives();
+
+    inner.moments(moments.in);
+    outer.moments(moments.out);
+    MomentVector s_shell = outer.integrals() - inner.integrals();
+    _derive(s_shell, &DsDd_shell, moments.shell);
+}
+
+void ProjectedShellMoments(const MassMomentsCache& inner, const MassMomentsCache& outer, MassMoments& shell)
+{
+    MomentVector s_shell = outer.integrals() - inner.integrals();
+    MomentMatrix DsDa = -inner.projected();
+    _derive(s_shell, &DsDa, shell);
+}
+
+MassMomentsBenchmark MeasureMassMoments(const Eigen::MatrixX3d& inner, const Eigen::MatrixX3d& outer,
+    const std::vector<std::array<int, 3>>& triangles, const Eigen::MatrixX3d& directions, int repeat)
+{
+    const int n = static_cast<int>(inner.rows());
+    MassMomentsBenchmark result{ 0.0, 0.0, 0.0, 0.0, 0.0 };
+    repeat = std::max(repeat, 1);
+
+    // the three calls of CompPhyProperty.m, the shell concatenated there.
+    Eigen::MatrixX3d shell_points(2 * n, 3), shell_directions(2 * n, 3);
+    shell_points << inner, outer;
+    shell_directions << directions, -directions;
+    Eigen::MatrixX3d negative = -directions;
+    std::vector<std::array<int, 3>> shell_triangles;
+    shell_triangles.reserve(2 * triangles.size());
+    for (auto &t : triangles)
+        shell_triangles.push_back({ t[1], t[0], t[2] });
+    for (auto &t : triangles)
+        shell_triangles.push_back({ t[0] + n, t[1] + n, t[2] + n });
+
+    ShellMoments reference, parallel, fused;
+    QElapsedTimer timer;
+    timer.start();
+    for (int r = 0; r < repeat; ++r)
+    {
+        ComputeMassMomentsReference(inner, triangles, &directions, reference.in);
+        ComputeMassMomentsReference(outer, triangles, &negative, reference.out);
+        ComputeMassMomentsReference(shell_points, shell_triangles, &shell_directions, reference.shell);
+    }
+    result.ms_reference = timer.nsecsElapsed() * 1e-6 / repeat;
+
+    timer.restart();
+    for (int r = 0; r < repeat; ++r)
+    {
+        ComputeMassMoments(inner, triangles, &directions, parallel.in);
+        ComputeMassMoments(outer, triangles, &negative, parallel.out);
+        ComputeMassMoments(shell_points, shell_triangles, &shell_directions, parallel.shell);
+    }
+    result.ms_parallel = timer.nsecsElapsed() * 1e-6 / repeat;
+
+    timer.restart();
+    for (int r = 0; r < repeat; ++r)
+        ComputeShellMoments(inner, outer, triangles, directions, fused);
+    result.ms_fused = timer.nsecsElapsed() * 1e-6 / repeat;
+
+    auto compare = [&result](const MassMoments &a, const MassMoments &b)
+    {
+        const double scale_M = b.M.cwiseAbs().maxCoeff();
+        for (int k = 0; k < N_MOMENTS; ++k)
+            result.max_error_M = std::max(result.max_error_M,
+                std::abs(a.M[k] - b.M[k]) / std::max(std::abs(b.M[k]), 1e-6 * scale_M));
+        const double scale_D = std::max(b.DmDd.cwiseAbs().maxCoeff(), 1e-300);
+        result.max_error_DmDd = std::max(result.max_error_DmDd, (a.DmDd - b.DmDd).cwiseAbs().maxCoeff() / scale_D);
+    };
+    for (auto *fast : { &parallel, &fused })
+    {
+        compare(fast->in, reference.in);
+        compare(fast->out, reference.out);
+        compare(fast->shell, reference.shell);
+    }
+    return result;
+}
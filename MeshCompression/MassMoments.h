@@ -0,0 +1,120 @@
+#pragma once
+#include <Eigen/Core>
+#include <vector>
+#include <array>
+
+// The 10 volume integrals of 1, x, y, z, xx, yy, zz, xy, yz, zx over a
+// closed triangle mesh (outward oriented), by the divergence theorem, and
+// what script/comp_moments_grad_3d.cpp makes of them:
+//     M = volume, center x y z, inertia about the center Ixx Iyy Izz Ixy Iyz Izx
+// (density 1), and DmDd, column i the derivative of M when vertex i moves
+// along directions.row(i), the offset direction of the optimization.
+//
+// The per-triangle kernel runs on 4 triangles at once (one per SIMD lane
+// of an Eigen packet), blocks of triangles in parallel; block sums are
+// added in order and each vertex gathers its corners' derivatives, so the
+// result does not depend on the thread count.
+#define N_MOMENTS 10
+
+enum MomentIndex
+{
+    MOMENT_VOLUME = 0,
+    MOMENT_CX, MOMENT_CY, MOMENT_CZ,
+    MOMENT_IXX, MOMENT_IYY, MOMENT_IZZ,
+    MOMENT_IXY, MOMENT_IYZ, MOMENT_IZX
+};
+
+using MomentVector = Eigen::Matrix<double, N_MOMENTS, 1>;
+using MomentMatrix = Eigen::Matrix<double, N_MOMENTS, Eigen::Dynamic>;
+
+struct MassMoments
+{
+    MomentVector M;
+    MomentMatrix DmDd;              // empty without directions.
+};
+
+// CompPhyProperty.m in one pass over the triangles: the inner surface, the
+// outer one and the shell between them (outer minus inner). shell.DmDd has
+// 2n columns as there, the inner vertices along directions, then the outer
+// ones against them; out.DmDd is along -directions.
+struct ShellMoments
+{
+    MassMoments in;
+    MassMoments out;
+    MassMoments shell;
+};
+
+// Same arguments as the MEX: the points, the triangles and one direction per
+// point (nullptr: no gradient).
+void ComputeMassMoments(const Eigen::MatrixX3d &points, const std::vector<std::array<int, 3>> &triangles,
+    const Eigen::MatrixX3d *directions, MassMoments &moments);
+// inner and outer share the triangles (and vertex i).
+void ComputeShellMoments(const Eigen::MatrixX3d &inner, const Eigen::MatrixX3d &outer,
+    const std::vector<std::array<int, 3>> &triangles, const Eigen::MatrixX3d &directions, ShellMoments &moments);
+
+// One surface over fixed triangles and directions, kept between calls: the
+// integrals of each triangle and the derivatives at its corners. update()
+// recomputes the triangles with a corner moved more than tolerance from where
+// it was last integrated, and the columns of their vertices; the others stay
+// as they were (tolerance 0: exact). The totals take the difference of the
+// recomputed triangles, summed again in full when more than 1/8 of them moved.
+// With a basis B (vertex displacements d = B a), DsDd B is kept the same way,
+// so a caller working in a never touches all n columns.
+class MassMomentsCache
+{
+public:
+    // direction_sign -1: along -directions, the outer surface of a shell.
+    MassMomentsCache(const std::vector<std::array<int, 3>> &triangles, const Eigen::MatrixX3d &directions,
+        double direction_sign = 1.0);
+
+    // returns the number of triangles recomputed.
+    int update(const Eigen::MatrixX3d &points, double tolerance);
+    void moments(MassMoments &moments) const;
+    // n rows; empty: none.
+    void set_basis(const Eigen::MatrixXd &basis);
+
+    const MomentVector &integrals() const { return s_; }
+    const MomentMatrix &derivatives() const { return DsDd_; }
+    const MomentMatrix &projected() const { return projected_; }
+    // all of them on the first update().
+    long long recomputed() const { return recomputed_; }
+
+private:
+    std::vector<std::array<int, 3>> triangles_;
+    Eigen::MatrixX3d directions_;   // signed.
+    std::vector<int> offset_, ids_; // corners of each vertex.
+
+    Eigen::MatrixX3d points_;       // where each vertex was integrated; empty: never.
+    MomentMatrix triangle_s_;       // column t.
+    MomentMatrix corners_;          // column 3 t + i.
+    MomentVector s_;
+    MomentMatrix DsDd_;
+    Eigen::MatrixXd basis_;
+    MomentMatrix projected_;        // DsDd B.
+    long long recomputed_;
+
+    std::vector<int> changed_;      // triangles, then vertices, of an update().
+    std::vector<char> mark_;
+};
+
+// The shell of an inner and an outer cache over the same triangles, as
+// ComputeShellMoments; outer built with direction_sign -1.
+void CombineShellMoments(const MassMomentsCache &inner, const MassMomentsCache &outer, ShellMoments &moments);
+// Only the shell, DmDd by a of the inner basis: DmDd_shell(:, 1:n) B.
+void ProjectedShellMoments(const MassMomentsCache &inner, const MassMomentsCache &outer, MassMoments &shell);
+
+// Straight scalar loop of the MEX, serial: the reference the fast path is
+// checked against.
+void ComputeMassMomentsReference(const Eigen::MatrixX3d &points, const std::vector<std::array<int, 3>> &triangles,
+    const Eigen::MatrixX3d *directions, MassMoments &moments);
+
+struct MassMomentsBenchmark
+{
+    double ms_reference;            // ComputeMassMomentsReference, 3 calls as CompPhyProperty.m.
+    double ms_parallel;             // ComputeMassMoments, 3 calls.
+    double ms_fused;                // ComputeShellMoments.
+    double max_error_M;             // relative, fast against reference, over in, out and shell.
+    double max_error_DmDd;          // relative to the largest entry.
+};
+MassMomentsBenchmark MeasureMassMoments(const Eigen::MatrixX3d &inner, const Eigen::MatrixX3d &outer,
+    const std::vector<std::array<int, 3>> &triangles, const Eigen::MatrixX3d &directions, int repeat);
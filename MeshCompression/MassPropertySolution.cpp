@@ -0,0 +1,437 @@
+#include "stdafx.h"
+#include "MassPropertySolution.h"
+#include "TextConfigLoader.h"
+#include <algorithm>
+#include <numeric>
+
+using Eigen::Vector3d;
+
+#define N_SECTION 10
+#define LANES 4
+
+// integrals of n_z g over a triangle, g in this order.
+enum SectionIndex
+{
+    SECTION_1 = 0,
+    SECTION_X, SECTION_Y, SECTION_Z,
+    SECTION_XX, SECTION_YY, SECTION_XY,
+    SECTION_XZ, SECTION_YZ, SECTION_ZZ
+};
+
+using Lane = Eigen::Array<double, LANES, 1>;
+using SectionVector = Eigen::Matrix<double, N_SECTION, 1>;
+
+// The integrals q of a triangle (T = double) or LANES of them (T = Lane),
+// p[i][c] coordinate c of corner i: n_z dA is N_z / 2 over the triangle, and
+// the edge midpoint rule is exact for g of degree 2.
+template <typename T>
+static inline void _section_kernel(const T p[3][3], T q[N_SECTION])
+{
+    const T w = ((p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0])) * (1.0 / 6);
+    for (int k = 0; k < N_SECTION; ++k)
+        q[k] = 0.0 * p[0][0];
+    for (int i = 0; i < 3; ++i)
+    {
+        const int j = (i + 1) % 3;
+        const T x = 0.5 * (p[i][0] + p[j][0]);
+        const T y = 0.5 * (p[i][1] + p[j][1]);
+        const T z = 0.5 * (p[i][2] + p[j][2]);
+        q[SECTION_1] += 1.0;
+        q[SECTION_X] += x;
+        q[SECTION_Y] += y;
+        q[SECTION_Z] += z;
+        q[SECTION_XX] += x * x;
+        q[SECTION_YY] += y * y;
+        q[SECTION_XY] += x * y;
+        q[SECTION_XZ] += x * z;
+        q[SECTION_YZ] += y * z;
+        q[SECTION_ZZ] += z * z;
+    }
+    for (int k = 0; k < N_SECTION; ++k)
+        q[k] *= w;
+}
+
+// The part of triangle tri below h, fanned from its first corner below,
+// added to q; its waterline segment, if asked, to segments.
+static void _clip(const Eigen::MatrixX3d &points, const std::array<int, 3> &tri, double h,
+    SectionVector &q, std::vector<Vector3d> *segments)
+{
+    double polygon[4][3];
+    int n = 0;
+    Vector3d crossing[2];
+    int n_crossing = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        const Vector3d a = points.row(tri[i]);
+        const Vector3d b = points.row(tri[(i + 1) % 3]);
+        if (a[2] < h)
+        {
+            for (int c = 0; c < 3; ++c)
+                polygon[n][c] = a[c];
+            ++n;
+        }
+        if ((a[2] < h) != (b[2] < h))
+        {
+            const Vector3d x = a + (h - a[2]) / (b[2] - a[2]) * (b - a);
+            for (int c = 0; c < 3; ++c)
+                polygon[n][c] = x[c];
+            ++n;
+            crossing[n_crossing++] = x;
+        }
+    }
+    for (int k = 1; k + 1 < n; ++k)
+    {
+        const double p[3][3] = {
+            { polygon[0][0], polygon[0][1], polygon[0][2] },
+            { polygon[k][0], polygon[k][1], polygon[k][2] },
+            { polygon[k + 1][0], polygon[k + 1][1], polygon[k + 1][2] }
+        };
+        double s[N_SECTION];
+        _section_kernel<double>(p, s);
+        for (int j = 0; j < N_SECTION; ++j)
+            q[j] += s[j];
+    }
+    if (segments != nullptr && n_crossing == 2)
+    {
+        segments->push_back(crossing[0]);
+        segments->push_back(crossing[1]);
+    }
+}
+
+SubmergedVolume::SubmergedVolume(const Eigen::MatrixX3d& points, const std::vector<std::array<int, 3>>& triangles) :
+    points_(points), triangles_(triangles), volume_(0.0), bottom_(0.0), top_(0.0)
+{
+    const int n = static_cast<int>(triangles.size());
+    Eigen::Matrix<double, N_SECTION, Eigen::Dynamic> q(N_SECTION, n);
+    std::vector<double> low(n), high(n);
+
+    // STEP 1:  Integrals of every triangle, LANES at a time.
+    const int n_packs = n / LANES;
+#pragma omp parallel for
+    for (int b = 0; b < n_packs; ++b)
+    {
+        Lane p[3][3];
+        for (int l = 0; l < LANES; ++l)
+        {
+            const auto &tri = triangles[b * LANES + l];
+            for (int i = 0; i < 3; ++i)
+                for (int c = 0; c < 3; ++c)
+                    p[i][c][l] = points(tri[i], c);
+        }
+        Lane s[N_SECTION];
+        _section_kernel<Lane>(p, s);
+        for (int l = 0; l < LANES; ++l)
+        {
+            const int t = b * LANES + l;
+            for (int k = 0; k < N_SECTION; ++k)
+                q(k, t) = s[k][l];
+            low[t] = std::min({ p[0][2][l], p[1][2][l], p[2][2][l] });
+            high[t] = std::max({ p[0][2][l], p[1][2][l], p[2][2][l] });
+        }
+    }
+    for (int t = n_packs * LANES; t < n; ++t)
+    {
+        const auto &tri = triangles[t];
+        double p[3][3];
+        for (int i = 0; i < 3; ++i)
+            for (int c = 0; c < 3; ++c)
+                p[i][c] = points(tri[i], c);
+        double s[N_SECTION];
+        _section_kernel<double>(p, s);
+        for (int k = 0; k < N_SECTION; ++k)
+            q(k, t) = s[k];
+        low[t] = std::min({ p[0][2], p[1][2], p[2][2] });
+        high[t] = std::max({ p[0][2], p[1][2], p[2][2] });
+    }
+
+    // STEP 2:  By the highest corner, and the prefix sums in that order.
+    order_.resize(n);
+    std::iota(order_.begin(), order_.end(), 0);
+    std::sort(order_.begin(), order_.end(), [&high](int a, int b) { return high[a] < high[b]; });
+    low_.resize(n);
+    high_.resize(n);
+    prefix_.resize(N_SECTION, n + 1);
+    prefix_.col(0).setZero();
+    for (int i = 0; i < n; ++i)
+    {
+        low_[i] = low[order_[i]];
+        high_[i] = high[order_[i]];
+        prefix_.col(i + 1) = prefix_.col(i) + q.col(order_[i]);
+    }
+
+    if (n > 0)
+    {
+        bottom_ = *std::min_element(low_.begin(), low_.end());
+        top_ = high_.back();
+    }
+    volume_ = prefix_(SECTION_Z, n) - top_ * prefix_(SECTION_1, n);
+}
+
+void SubmergedVolume::evaluate(double h, Submerged& submerged) const
+{
+    const int n = static_cast<int>(order_.size());
+    const int below = static_cast<int>(std::upper_bound(high_.begin(), high_.end(), h) - high_.begin());
+    SectionVector q = prefix_.col(below);
+    for (int i = below; i < n; ++i)
+        if (low_[i] < h)
+            _clip(points_, triangles_[order_[i]], h, q, nullptr);
+
+    // volume: F = (0, 0, z - h); first moments: x (z - h), y (z - h),
+    // (z^2 - h^2) / 2; none of them through the cap. The cap itself is
+    // minus the rest of the flux of (0, 0, g(x, y)).
+    const double V = q[SECTION_Z] - h * q[SECTION_1];
+    submerged.volume = V;
+    if (V > 0.0)
+        submerged.center = Vector3d{
+            q[SECTION_XZ] - h * q[SECTION_X],
+            q[SECTION_YZ] - h * q[SECTION_Y],
+            0.5 * (q[SECTION_ZZ] - h * h * q[SECTION_1])
+        } / V;
+    else
+        submerged.center = Vector3d{ 0.0, 0.0, h };
+
+    const double A = -q[SECTION_1];
+    submerged.area = A;
+    if (A > 0.0)
+    {
+        const Eigen::Vector2d c{ -q[SECTION_X] / A, -q[SECTION_Y] / A };
+        submerged.area_center = c;
+        submerged.area_inertia <<
+            -q[SECTION_XX] - A * c[0] * c[0], -q[SECTION_XY] - A * c[0] * c[1],
+            -q[SECTION_XY] - A * c[0] * c[1], -q[SECTION_YY] - A * c[1] * c[1];
+    }
+    else
+    {
+        submerged.area_center.setZero();
+        submerged.area_inertia.setZero();
+    }
+}
+
+int SubmergedVolume::solve(double target, double tolerance, double& h, Submerged& submerged) const
+{
+    double lo = bottom_, hi = top_;
+    h = lo + (hi - lo) * target / volume_;
+    int iteration = 0;
+    while (iteration < 64)
+    {
+        ++iteration;
+        evaluate(h, submerged);
+        const double f = submerged.volume - target;
+        if (std::abs(f) <= tolerance * volume_)
+            break;
+        if (f < 0.0)
+            lo = h;
+        else
+            hi = h;
+        if (hi - lo <= 1e-12 * (top_ - bottom_))
+            break;
+        // Newton, d volume / d h = area; halving where it leaves [lo, hi].
+        double next = submerged.area > 0.0 ? h - f / submerged.area : lo - 1.0;
+        if (!(next > lo && next < hi))
+            next = 0.5 * (lo + hi);
+        h = next;
+    }
+    return iteration;
+}
+
+void SubmergedVolume::waterline(double h, std::vector<Eigen::Vector3d>& segments) const
+{
+    const int n = static_cast<int>(order_.size());
+    const int below = static_cast<int>(std::upper_bound(high_.begin(), high_.end(), h) - high_.begin());
+    SectionVector q = SectionVector::Zero();
+    for (int i = below; i < n; ++i)
+        if (low_[i] < h)
+            _clip(points_, triangles_[order_[i]], h, q, &segments);
+}
+
+// points and triangles of a mesh; false if it has none or is not closed.
+static bool _surface(const TriMesh &mesh, Eigen::MatrixX3d &points, std::vector<std::array<int, 3>> &triangles)
+{
+    if (mesh.n_faces() == 0)
+        return false;
+    for (auto vh : mesh.vertices())
+        if (mesh.is_boundary(vh))
+            return false;
+    const int n = static_cast<int>(mesh.n_vertices());
+    points.resize(n, 3);
+    for (int vi = 0; vi < n; ++vi)
+    {
+        auto p = mesh.point(mesh.vertex_handle(vi));
+        points.row(vi) = Vector3d{ p[0], p[1], p[2] };
+    }
+    triangles.clear();
+    triangles.reserve(mesh.n_faces());
+    for (auto fh : mesh.faces())
+    {
+        std::array<int, 3> face_idx;
+        int i = 0;
+        for (auto fvit = mesh.cfv_iter(fh); fvit.is_valid(); ++fvit)
+            face_idx[i++] = fvit->idx();
+        triangles.push_back(face_idx);
+    }
+    return true;
+}
+
+static RegionProperties _region(const MomentVector &M)
+{
+    RegionProperties region;
+    region.volume = M[MOMENT_VOLUME];
+    region.center = Vector3d{ M[MOMENT_CX], M[MOMENT_CY], M[MOMENT_CZ] };
+    region.inertia <<
+        M[MOMENT_IXX], M[MOMENT_IXY], M[MOMENT_IZX],
+        M[MOMENT_IXY], M[MOMENT_IYY], M[MOMENT_IYZ],
+        M[MOMENT_IZX], M[MOMENT_IYZ], M[MOMENT_IZZ];
+    return region;
+}
+
+// inertia about the origin of a region, by the parallel axis theorem.
+static Eigen::Matrix3d _about_origin(const RegionProperties &region, double sign)
+{
+    const Vector3d &c = region.center;
+    const Eigen::Matrix3d shift = c.squaredNorm() * Eigen::Matrix3d::Identity() - c * c.transpose();
+    return region.inertia + sign * region.volume * shift;
+}
+
+// outer less inner, about the shell's own center.
+static RegionProperties _shell(const RegionProperties &outer, const RegionProperties &inner)
+{
+    RegionProperties shell;
+    shell.volume = outer.volume - inner.volume;
+    shell.center = (outer.volume * outer.center - inner.volume * inner.center) / shell.volume;
+    shell.inertia = _about_origin(outer, 1.0) - _about_origin(inner, 1.0);
+    shell.inertia = _about_origin(shell, -1.0);
+    return shell;
+}
+
+MassPropertySolution::MassPropertySolution(OpenGLScene& scene, ConsoleMessageManager& msg) :
+    msg_(msg), scene_(scene)
+{
+}
+
+bool MassPropertySolution::analyze(const QString& name)
+{
+    auto model = scene_.get(name);
+    Eigen::MatrixX3d outer;
+    std::vector<std::array<int, 3>> triangles;
+    if (model == nullptr || !_surface(model->mesh(), outer, triangles))
+    {
+        msg_.log("no closed surface mesh: ", name, ERROR_MSG);
+        // nothing of the last model is shown for this one.
+        properties_ = MassProperties();
+        return false;
+    }
+    TextConfigLoader tcl{ "./config/offset.config" };
+    const double rho_material = tcl.get_value("Rho_Material");
+    const double rho_water = tcl.get_value("Rho_Water");
+
+    auto &prop = properties_;
+    prop.name = name;
+
+    // STEP 1:  The regions, the shell between "Inner" and the model.
+    QElapsedTimer timer;
+    timer.start();
+    MassMoments moments;
+    ComputeMassMoments(outer, triangles, nullptr, moments);
+    prop.outer = _region(moments.M);
+    prop.hollow = false;
+    prop.inner = RegionProperties{ 0.0, Vector3d::Zero(), Eigen::Matrix3d::Zero() };
+    auto inner_model = scene_.get("Inner");
+    if (name != "Inner" && inner_model != nullptr)
+    {
+        Eigen::MatrixX3d inner;
+        std::vector<std::array<int, 3>> inner_triangles;
+        if (_surface(inner_model->mesh(), inner, inner_triangles))
+        {
+            ComputeMassMoments(inner, inner_triangles, nullptr, moments);
+            prop.inner = _region(moments.M);
+            prop.hollow = prop.inner.volume > 0.0 && prop.inner.volume < prop.outer.volume;
+            if (!prop.hollow)
+                msg_.log("\"Inner\" is not inside the model, taken solid.", ERROR_MSG);
+        }
+    }
+    prop.shell = prop.hollow ? _shell(prop.outer, prop.inner) : prop.outer;
+    prop.mass = rho_material * prop.shell.volume;
+    prop.ms_moments = timer.nsecsElapsed() * 1e-6;
+
+    // STEP 2:  The waterline of the outer surface carrying the shell, the
+    //          metacentric heights there.
+    timer.restart();
+    SubmergedVolume water(outer, triangles);
+    auto &floating = prop.floating;
+    const double target = prop.mass / rho_water;
+    floating.floats = target < water.volume();
+    if (floating.floats)
+    {
+        floating.iterations = water.solve(target, 1e-10, floating.waterline, floating.submerged);
+    }
+    else
+    {
+        floating.iterations = 0;
+        floating.waterline = water.top();
+        water.evaluate(floating.waterline, floating.submerged);
+    }
+    const auto &sub = floating.submerged;
+    const double rise = prop.shell.center[2] - sub.center[2];
+    if (sub.volume > 0.0)
+        floating.metacentric_height = Eigen::Vector2d{
+            sub.area_inertia(1, 1) / sub.volume - rise,
+            sub.area_inertia(0, 0) / sub.volume - rise
+        };
+    else
+        floating.metacentric_height.setZero();
+    prop.waterline.clear();
+    if (floating.floats)
+        water.waterline(floating.waterline, prop.waterline);
+    int lowest = 0;
+    outer.col(2).minCoeff(&lowest);
+    prop.support = outer.row(lowest);
+    prop.ms_floating = timer.nsecsElapsed() * 1e-6;
+
+    Log();
+    return true;
+}
+
+void MassPropertySolution::Log() const
+{
+    const auto &prop = properties_;
+    auto region = [this](const char *label, const RegionProperties &r)
+    {
+        msg_.log(QString("%0: volume %1, center (%2, %3, %4)").arg(label)
+            .arg(r.volume, 0, 'g', 6)
+            .arg(r.center[0], 0, 'f', 4).arg(r.center[1], 0, 'f', 4).arg(r.center[2], 0, 'f', 4), INFO_MSG);
+        msg_.log(QString("    inertia Ixx %0 Iyy %1 Izz %2 Ixy %3 Iyz %4 Izx %5")
+            .arg(r.inertia(0, 0), 0, 'g', 5).arg(r.inertia(1, 1), 0, 'g', 5).arg(r.inertia(2, 2), 0, 'g', 5)
+            .arg(r.inertia(0, 1), 0, 'g', 5).arg(r.inertia(1, 2), 0, 'g', 5).arg(r.inertia(2, 0), 0, 'g', 5), INFO_MSG);
+    };
+    region("outer", prop.outer);
+    if (prop.hollow)
+    {
+        region("inner", prop.inner);
+        region("shell", prop.shell);
+    }
+    msg_.log(QString("mass %0, %1").arg(prop.mass, 0, 'g', 6)
+        .arg(prop.hollow ? "hollow" : "solid"), INFO_MSG);
+
+    const auto &floating = prop.floating;
+    const auto &sub = floating.submerged;
+    if (floating.floats)
+        msg_.log(QString("floats: waterline z = %0 (%1 iterations), %2% under water")
+            .arg(floating.waterline, 0, 'f', 4).arg(floating.iterations)
+            .arg(100.0 * sub.volume / prop.outer.volume, 0, 'f', 1), INFO_MSG);
+    else
+        msg_.log("sinks: heavier than the water it displaces.", INFO_MSG);
+    const Vector3d offset = prop.shell.center - sub.center;
+    msg_.log(QString("buoyancy center (%0, %1, %2), gravity off it by (%3, %4) horizontally")
+        .arg(sub.center[0], 0, 'f', 4).arg(sub.center[1], 0, 'f', 4).arg(sub.center[2], 0, 'f', 4)
+        .arg(offset[0], 0, 'f', 4).arg(offset[1], 0, 'f', 4), INFO_MSG);
+    if (floating.floats)
+        msg_.log(QString("metacentric height: roll %0, pitch %1, %2")
+            .arg(floating.metacentric_height[0], 0, 'f', 4)
+            .arg(floating.metacentric_height[1], 0, 'f', 4)
+            .arg(floating.metacentric_height.minCoeff() > 0.0 ? "stable" : "capsizes"), INFO_MSG);
+    const Vector3d stand = prop.shell.center - prop.support;
+    msg_.log(QString("standing: gravity %0 above the lowest point, (%1, %2) off it")
+        .arg(stand[2], 0, 'f', 4).arg(stand[0], 0, 'f', 4).arg(stand[1], 0, 'f', 4), INFO_MSG);
+    msg_.log(QString("moments %0 ms, waterline %1 ms")
+        .arg(prop.ms_moments, 0, 'f', 2).arg(prop.ms_floating, 0, 'f', 2), INFO_MSG);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "OpenGLScene.h"
+#include "ConsoleMessageManager.h"
+#include "MassMoments.h"
+#include <vector>
+#include <array>
+#include <Eigen/Dense>
+
+// The part of a closed surface below a plane z = h.
+struct Submerged
+{
+    double volume;
+    Eigen::Vector3d center;         // of buoyancy.
+    double area;                    // of the waterplane section,
+    Eigen::Vector2d area_center;    // its center,
+    Eigen::Matrix2d area_inertia;   // and second moments about it.
+};
+
+// Submerged of a closed surface (outward oriented) for any h, by the
+// divergence theorem with fields that vanish on the plane: the cap the plane
+// cuts never has to be built.
+//
+// Every triangle's integrals of n_z {1, x, y, z, xx, yy, xy, xz, yz, zz} are
+// taken once (LANES triangles at a time); ordered by their highest corner,
+// the triangles all below h are a prefix and count through prefix sums. Only
+// those the plane crosses are clipped for each h. points and triangles are
+// kept by reference.
+class SubmergedVolume
+{
+public:
+    SubmergedVolume(const Eigen::MatrixX3d &points, const std::vector<std::array<int, 3>> &triangles);
+
+    void evaluate(double h, Submerged &submerged) const;
+    // h with volume below it target (0 < target < volume()), safeguarded
+    // Newton, the waterplane area its derivative; returns the iterations.
+    int solve(double target, double tolerance, double &h, Submerged &submerged) const;
+    // the waterline at h, segments as pairs of points.
+    void waterline(double h, std::vector<Eigen::Vector3d> &segments) const;
+
+    double volume() const { return volume_; }
+    double bottom() const { return bottom_; }
+    double top() const { return top_; }
+
+private:
+    const Eigen::MatrixX3d &points_;
+    const std::vector<std::array<int, 3>> &triangles_;
+    std::vector<int> order_;        // by the highest corner.
+    std::vector<double> low_, high_;    // of order_[i].
+    Eigen::Matrix<double, 10, Eigen::Dynamic> prefix_;  // column i: of order_[0..i).
+    double volume_, bottom_, top_;
+};
+
+// Volume, center and inertia tensor about it, density 1.
+struct RegionProperties
+{
+    double volume;
+    Eigen::Vector3d center;
+    Eigen::Matrix3d inertia;
+};
+
+// How the shell of Rho_Material floats in Rho_Water (offset.config), z up as
+// script/Optimize.m: a metacentric height > 0 rights a small heel about that
+// axis. Standing, as fish_static, it rests on its lowest point.
+struct FloatingProperties
+{
+    bool floats;                    // false: sinks, the rest of it fully under water.
+    double waterline;
+    Submerged submerged;
+    Eigen::Vector2d metacentric_height;     // roll (about x), pitch (about y).
+    int iterations;
+};
+
+struct MassProperties
+{
+    QString name;
+    RegionProperties outer, inner, shell;   // inner zero if not hollow.
+    bool hollow;
+    double mass;                    // of the shell.
+    FloatingProperties floating;
+    Eigen::Vector3d support;        // the lowest point.
+    std::vector<Eigen::Vector3d> waterline;
+    double ms_moments, ms_floating;
+};
+
+// Mass properties of a model, hollowed by "Inner" if that is in the scene:
+// CompPhyProperty.m and the fish_buo / fish_static figures, in process. The
+// moments are those of MassMoments, the shell the outer region less the
+// inner one, so the two need not share triangles.
+class MassPropertySolution
+{
+public:
+    MassPropertySolution(OpenGLScene &scene, ConsoleMessageManager &msg);
+
+    // false if name is no closed surface, properties() are then cleared.
+    bool analyze(const QString &name);
+    bool valid() const { return !properties_.name.isEmpty(); }
+    const MassProperties &properties() const { return properties_; }
+
+private:
+    ConsoleMessageManager &msg_;
+    OpenGLScene &scene_;
+    MassProperties properties_;
+
+    void Log() const;
+};
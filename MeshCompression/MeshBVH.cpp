@@ -0,0 +1,733 @@
+#include "stdafx.h"
+#include "MeshBVH.h"
+#include "TriangleGeometry.h"
+#include <Eigen/Geometry>
+#include <omp.h>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+
+using Eigen::Vector3f;
+
+#define BVH_BINS            16
+#define BVH_LEAF            4       // triangles a leaf is never split below.
+#define BVH_MAX_LEAF        16      // nor left above.
+#define BVH_SAH_DEPTH       48      // deeper: median splits, the depth stays bounded.
+#define BVH_STACK           128
+#define BVH_SUBTREE_MIN     4096    // triangles of a subtree worth a thread.
+
+struct _Bounds
+{
+    Vector3f lo, hi;
+
+    void reset()
+    {
+        lo.setConstant(std::numeric_limits<float>::max());
+        hi.setConstant(-std::numeric_limits<float>::max());
+    }
+    void grow(const Vector3f &p) { lo = lo.cwiseMin(p); hi = hi.cwiseMax(p); }
+    void grow(const _Bounds &b) { lo = lo.cwiseMin(b.lo); hi = hi.cwiseMax(b.hi); }
+    // half the surface area.
+    float area() const
+    {
+        if (hi[0] < lo[0])
+            return 0.0f;
+        const Vector3f e = hi - lo;
+        return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+    }
+};
+
+static inline void _set_bounds(BVHNode &node, const _Bounds &b)
+{
+    for (int c = 0; c < 3; ++c)
+    {
+        node.lo[c] = b.lo[c];
+        node.hi[c] = b.hi[c];
+    }
+}
+
+static inline _Bounds _bounds(const BVHNode &node)
+{
+    return{ Vector3f{ node.lo[0], node.lo[1], node.lo[2] }, Vector3f{ node.hi[0], node.hi[1], node.hi[2] } };
+}
+
+// what the splits of a build read: bounds and centroid of each triangle, and
+// the order they permute.
+struct _Builder
+{
+    const std::vector<_Bounds> &boxes;
+    const std::vector<Vector3f> &centroids;
+    std::vector<int> &order;
+};
+
+// Bounds node, a leaf over its range of order, and splits it if that pays:
+// the two children are appended to nodes. Disjoint ranges never touch the
+// same part of order, so subtrees can be split at the same time.
+static bool _split(const _Builder &b, std::vector<BVHNode> &nodes, int ni, int depth)
+{
+    const int first = nodes[ni].first;
+    const int count = nodes[ni].count;
+    int *order = b.order.data();
+    _Bounds box, centers;
+    box.reset();
+    centers.reset();
+    for (int i = first; i < first + count; ++i)
+    {
+        box.grow(b.boxes[order[i]]);
+        centers.grow(b.centroids[order[i]]);
+    }
+    _set_bounds(nodes[ni], box);
+    if (count <= BVH_LEAF)
+        return false;
+
+    int axis = 0;
+    const Vector3f extent = centers.hi - centers.lo;
+    extent.maxCoeff(&axis);
+    int mid = first + count / 2;
+    bool median = depth >= BVH_SAH_DEPTH;
+    if (extent[axis] <= 0.0f)
+    {
+        // every centroid in one point: any split is as good.
+        if (count <= BVH_MAX_LEAF)
+            return false;
+        median = false;
+    }
+    else if (!median)
+    {
+        // STEP 1:  Bin the centroids, sweep for the cheapest of the BVH_BINS - 1
+        //          planes: traversal 1, triangles 1 each, by area.
+        const float lo = centers.lo[axis];
+        const float scale = BVH_BINS / extent[axis];
+        auto bin_of = [&](int t)
+        {
+            return std::min(BVH_BINS - 1, static_cast<int>((b.centroids[t][axis] - lo) * scale));
+        };
+        _Bounds bin_box[BVH_BINS];
+        int bin_count[BVH_BINS] = { 0 };
+        for (auto &bb : bin_box)
+            bb.reset();
+        for (int i = first; i < first + count; ++i)
+        {
+            const int k = bin_of(order[i]);
+            bin_box[k].grow(b.boxes[order[i]]);
+            ++bin_count[k];
+        }
+        float right_area[BVH_BINS];
+        int right_count[BVH_BINS];
+        _Bounds acc;
+        acc.reset();
+        int n = 0;
+        for (int k = BVH_BINS - 1; k > 0; --k)
+        {
+            acc.grow(bin_box[k]);
+            n += bin_count[k];
+            right_area[k] = acc.area();
+            right_count[k] = n;
+        }
+        acc.reset();
+        n = 0;
+        float best = std::numeric_limits<float>::max();
+        int best_plane = -1;
+        for (int k = 1; k < BVH_BINS; ++k)
+        {
+            acc.grow(bin_box[k - 1]);
+            n += bin_count[k - 1];
+            if (n == 0 || right_count[k] == 0)
+                continue;
+            const float cost = acc.area() * n + right_area[k] * right_count[k];
+            if (cost < best)
+            {
+                best = cost;
+                best_plane = k;
+            }
+        }
+        if (box.area() + best >= box.area() * count && count <= BVH_MAX_LEAF)
+            return false;
+
+        // STEP 2:  Partition the range by the plane.
+        if (best_plane > 0)
+            mid = static_cast<int>(std::partition(order + first, order + first + count,
+                [&](int t) { return bin_of(t) < best_plane; }) - order);
+        else
+            median = true;
+    }
+    if (median)
+    {
+        std::nth_element(order + first, order + mid, order + first + count,
+            [&](int s, int t) { return b.centroids[s][axis] < b.centroids[t][axis]; });
+    }
+
+    const int left = static_cast<int>(nodes.size());
+    BVHNode child = nodes[ni];
+    child.first = first;
+    child.count = mid - first;
+    nodes.push_back(child);
+    child.first = mid;
+    child.count = first + count - mid;
+    nodes.push_back(child);
+    nodes[ni].first = left;
+    nodes[ni].count = 0;
+    return true;
+}
+
+// the whole subtree under nodes[0], depth first.
+static void _build_subtree(const _Builder &b, std::vector<BVHNode> &nodes, int root_depth)
+{
+    std::vector<std::pair<int, int>> stack{ { 0, root_depth } };
+    while (!stack.empty())
+    {
+        const auto top = stack.back();
+        stack.pop_back();
+        if (!_split(b, nodes, top.first, top.second))
+            continue;
+        const int left = nodes[top.first].first;
+        stack.push_back({ left + 1, top.second + 1 });
+        stack.push_back({ left, top.second + 1 });
+    }
+}
+
+void MeshBVH::build(const std::vector<Eigen::Vector3f>& position, const std::vector<std::array<int, 3>>& faces)
+{
+    faces_ = faces;
+    nodes_.clear();
+    const int n = static_cast<int>(faces.size());
+    order_.resize(n);
+    std::iota(order_.begin(), order_.end(), 0);
+    corners_.resize(n);
+    if (n == 0)
+        return;
+
+    // STEP 1:  Bounds and centroid of every triangle.
+    std::vector<_Bounds> boxes(n);
+    std::vector<Vector3f> centroids(n);
+#pragma omp parallel for
+    for (int t = 0; t < n; ++t)
+    {
+        const auto &f = faces[t];
+        boxes[t].reset();
+        for (int i = 0; i < 3; ++i)
+            boxes[t].grow(position[f[i]]);
+        centroids[t] = (position[f[0]] + position[f[1]] + position[f[2]]) / 3.0f;
+    }
+    _Builder builder{ boxes, centroids, order_ };
+
+    // STEP 2:  The top of the tree in order, the largest pending node split
+    //          first, until there are about 4 subtrees a thread.
+    nodes_.push_back(BVHNode{ { 0.0f, 0.0f, 0.0f }, 0, { 0.0f, 0.0f, 0.0f }, n });
+    std::vector<std::pair<int, int>> pending{ { 0, 0 } };  // node, depth.
+    const int wanted = omp_get_max_threads() > 1 ? 4 * omp_get_max_threads() : 1;
+    while (static_cast<int>(pending.size()) < wanted)
+    {
+        auto largest = std::max_element(pending.begin(), pending.end(),
+            [this](const std::pair<int, int> &s, const std::pair<int, int> &t)
+            { return nodes_[s.first].count < nodes_[t.first].count; });
+        if (nodes_[largest->first].count < BVH_SUBTREE_MIN)
+            break;
+        const auto top = *largest;
+        pending.erase(largest);
+        if (!_split(builder, nodes_, top.first, top.second))
+            continue;
+        const int left = nodes_[top.first].first;
+        pending.push_back({ left, top.second + 1 });
+        pending.push_back({ left + 1, top.second + 1 });
+    }
+
+    // STEP 3:  The subtrees in parallel, spliced in after the top: a local
+    //          node j > 0 goes to base + j - 1, the root back in its place.
+    const int n_pending = static_cast<int>(pending.size());
+    std::vector<std::vector<BVHNode>> subtrees(n_pending);
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < n_pending; ++i)
+    {
+        subtrees[i].push_back(nodes_[pending[i].first]);
+        _build_subtree(builder, subtrees[i], pending[i].second);
+    }
+    for (int i = 0; i < n_pending; ++i)
+    {
+        const int base = static_cast<int>(nodes_.size());
+        const auto &sub = subtrees[i];
+        for (int j = 0; j < static_cast<int>(sub.size()); ++j)
+        {
+            BVHNode node = sub[j];
+            if (node.count == 0)
+                node.first += base - 1;
+            if (j == 0)
+                nodes_[pending[i].first] = node;
+            else
+                nodes_.push_back(node);
+        }
+    }
+
+    // STEP 4:  Corners in leaf order; the bounds again from them.
+    refit(position);
+}
+
+void MeshBVH::build(const TriMesh& mesh)
+{
+    std::vector<Vector3f> position(mesh.n_vertices());
+    for (auto vh : mesh.vertices())
+    {
+        auto p = mesh.point(vh);
+        position[vh.idx()] = Vector3f{ p[0], p[1], p[2] };
+    }
+    std::vector<std::array<int, 3>> faces;
+    faces.reserve(mesh.n_faces());
+    for (auto fh : mesh.faces())
+    {
+        std::array<int, 3> face_idx;
+        int i = 0;
+        for (auto fvit = mesh.cfv_iter(fh); fvit.is_valid(); ++fvit)
+            face_idx[i++] = fvit->idx();
+        faces.push_back(face_idx);
+    }
+    build(position, faces);
+}
+
+void MeshBVH::refit(const std::vector<Eigen::Vector3f>& position)
+{
+    const int n = static_cast<int>(order_.size());
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i)
+    {
+        const auto &f = faces_[order_[i]];
+        corners_[i] = { position[f[0]], position[f[1]], position[f[2]] };
+    }
+    // leaves in parallel, then inner nodes after both their children.
+    const int n_nodes = static_cast<int>(nodes_.size());
+#pragma omp parallel for
+    for (int k = 0; k < n_nodes; ++k)
+    {
+        auto &node = nodes_[k];
+        if (node.count == 0)
+            continue;
+        _Bounds box;
+        box.reset();
+        for (int i = node.first; i < node.first + node.count; ++i)
+            for (int c = 0; c < 3; ++c)
+                box.grow(corners_[i][c]);
+        _set_bounds(node, box);
+    }
+    for (int k = n_nodes - 1; k >= 0; --k)
+    {
+        auto &node = nodes_[k];
+        if (node.count != 0)
+            continue;
+        const auto &l = nodes_[node.first];
+        const auto &r = nodes_[node.first + 1];
+        for (int c = 0; c < 3; ++c)
+        {
+            node.lo[c] = std::min(l.lo[c], r.lo[c]);
+            node.hi[c] = std::max(l.hi[c], r.hi[c]);
+        }
+    }
+}
+
+void MeshBVH::refit(const TriMesh& mesh)
+{
+    std::vector<Vector3f> position(mesh.n_vertices());
+    for (auto vh : mesh.vertices())
+    {
+        auto p = mesh.point(vh);
+        position[vh.idx()] = Vector3f{ p[0], p[1], p[2] };
+    }
+    refit(position);
+}
+
+// entry of the ray into the box, if before t_max; inv the reciprocal of the
+// direction (an infinite slab for a 0 component, NaN never wins min/max).
+static inline bool _ray_box(const BVHNode &node, const Vector3f &o, const Vector3f &inv, float t_max, float &t_enter)
+{
+    float t0 = 0.0f, t1 = t_max;
+    for (int c = 0; c < 3; ++c)
+    {
+        float a = (node.lo[c] - o[c]) * inv[c];
+        float b = (node.hi[c] - o[c]) * inv[c];
+        if (a > b)
+            std::swap(a, b);
+        t0 = a > t0 ? a : t0;
+        t1 = b < t1 ? b : t1;
+    }
+    t_enter = t0;
+    return t0 <= t1;
+}
+
+// Moller-Trumbore; t > 0 on the triangle, (u, v) the weights of corners 1, 2.
+static inline bool _ray_triangle(const std::array<Vector3f, 3> &tri, const Vector3f &o, const Vector3f &d,
+    float &t, float &u, float &v)
+{
+    const Vector3f e1 = tri[1] - tri[0];
+    const Vector3f e2 = tri[2] - tri[0];
+    const Vector3f p = d.cross(e2);
+    const float det = e1.dot(p);
+    if (std::abs(det) < 1e-12f)
+        return false;
+    const float inv_det = 1.0f / det;
+    const Vector3f s = o - tri[0];
+    u = s.dot(p) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    const Vector3f q = s.cross(e1);
+    v = d.dot(q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = e2.dot(q) * inv_det;
+    return t > 0.0f;
+}
+
+static inline float _box_distance2(const BVHNode &node, const Vector3f &p)
+{
+    float d2 = 0.0f;
+    for (int c = 0; c < 3; ++c)
+    {
+        const float d = std::max({ node.lo[c] - p[c], 0.0f, p[c] - node.hi[c] });
+        d2 += d * d;
+    }
+    return d2;
+}
+
+static inline bool _box_overlap(const float alo[3], const float ahi[3], const float blo[3], const float bhi[3])
+{
+    for (int c = 0; c < 3; ++c)
+        if (ahi[c] < blo[c] || bhi[c] < alo[c])
+            return false;
+    return true;
+}
+
+static inline void _triangle_bounds(const std::array<Vector3f, 3> &tri, float lo[3], float hi[3])
+{
+    for (int c = 0; c < 3; ++c)
+    {
+        lo[c] = std::min({ tri[0][c], tri[1][c], tri[2][c] });
+        hi[c] = std::max({ tri[0][c], tri[1][c], tri[2][c] });
+    }
+}
+
+bool MeshBVH::raycast(const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, float t_max, RayHit& hit) const
+{
+    if (nodes_.empty())
+        return false;
+    const Vector3f inv = direction.cwiseInverse();
+    float best = t_max;
+    int found = -1;
+    float found_u = 0.0f, found_v = 0.0f;
+    int stack[BVH_STACK];
+    int top = 0;
+    float t_enter;
+    if (_ray_box(nodes_[0], origin, inv, best, t_enter))
+        stack[top++] = 0;
+    while (top > 0)
+    {
+        const BVHNode &node = nodes_[stack[--top]];
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+            {
+                float t, u, v;
+                if (_ray_triangle(corners_[i], origin, direction, t, u, v) && t <= best)
+                {
+                    best = t;
+                    found = i;
+                    found_u = u;
+                    found_v = v;
+                }
+            }
+            continue;
+        }
+        // the nearer child on top.
+        float tl, tr;
+        const bool hl = _ray_box(nodes_[node.first], origin, inv, best, tl);
+        const bool hr = _ray_box(nodes_[node.first + 1], origin, inv, best, tr);
+        if (hl && hr)
+        {
+            stack[top++] = tl < tr ? node.first + 1 : node.first;
+            stack[top++] = tl < tr ? node.first : node.first + 1;
+        }
+        else if (hl)
+            stack[top++] = node.first;
+        else if (hr)
+            stack[top++] = node.first + 1;
+    }
+    if (found < 0)
+        return false;
+    hit.fi = order_[found];
+    hit.t = best;
+    hit.bary = Vector3f{ 1.0f - found_u - found_v, found_u, found_v };
+    return true;
+}
+
+int MeshBVH::crossings(const Eigen::Vector3f& origin, const Eigen::Vector3f& direction) const
+{
+    const Vector3f inv = direction.cwiseInverse();
+    const float t_max = std::numeric_limits<float>::max();
+    int n = 0;
+    int stack[BVH_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BVHNode &node = nodes_[stack[--top]];
+        float t_enter;
+        if (!_ray_box(node, origin, inv, t_max, t_enter))
+            continue;
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+            {
+                float t, u, v;
+                if (_ray_triangle(corners_[i], origin, direction, t, u, v))
+                    ++n;
+            }
+            continue;
+        }
+        stack[top++] = node.first;
+        stack[top++] = node.first + 1;
+    }
+    return n;
+}
+
+bool MeshBVH::inside(const Eigen::Vector3f& p) const
+{
+    if (nodes_.empty())
+        return false;
+    // off every axis and diagonal, so it hardly ever grazes an edge of a
+    // mesh aligned with them.
+    static const Vector3f direction = Vector3f{ 0.5377f, 0.6188f, 0.5726f }.normalized();
+    return crossings(p, direction) % 2 == 1;
+}
+
+bool MeshBVH::closest(const Eigen::Vector3f& p, float max_distance, ClosestHit& hit) const
+{
+    if (nodes_.empty())
+        return false;
+    float best = max_distance * max_distance;
+    int found = -1;
+    Vector3f found_bary = Vector3f::Zero();
+    int stack[BVH_STACK];
+    int top = 0;
+    if (_box_distance2(nodes_[0], p) <= best)
+        stack[top++] = 0;
+    while (top > 0)
+    {
+        const BVHNode &node = nodes_[stack[--top]];
+        if (_box_distance2(node, p) > best)
+            continue;
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+            {
+                const auto &tri = corners_[i];
+                const Vector3f bary = ClosestBarycentric(p, tri[0], tri[1], tri[2]);
+                const Vector3f q = bary[0] * tri[0] + bary[1] * tri[1] + bary[2] * tri[2];
+                const float d2 = (q - p).squaredNorm();
+                if (d2 <= best)
+                {
+                    best = d2;
+                    found = i;
+                    found_bary = bary;
+                }
+            }
+            continue;
+        }
+        const float dl = _box_distance2(nodes_[node.first], p);
+        const float dr = _box_distance2(nodes_[node.first + 1], p);
+        if (dl <= best && dr <= best)
+        {
+            stack[top++] = dl < dr ? node.first + 1 : node.first;
+            stack[top++] = dl < dr ? node.first : node.first + 1;
+        }
+        else if (dl <= best)
+            stack[top++] = node.first;
+        else if (dr <= best)
+            stack[top++] = node.first + 1;
+    }
+    if (found < 0)
+        return false;
+    const auto &tri = corners_[found];
+    hit.fi = order_[found];
+    hit.bary = found_bary;
+    hit.point = found_bary[0] * tri[0] + found_bary[1] * tri[1] + found_bary[2] * tri[2];
+    hit.distance = std::sqrt(best);
+    return true;
+}
+
+void MeshBVH::overlap(const Eigen::Vector3f& lo, const Eigen::Vector3f& hi, std::vector<int>& faces) const
+{
+    if (nodes_.empty())
+        return;
+    const float blo[3] = { lo[0], lo[1], lo[2] };
+    const float bhi[3] = { hi[0], hi[1], hi[2] };
+    int stack[BVH_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const BVHNode &node = nodes_[stack[--top]];
+        if (!_box_overlap(node.lo, node.hi, blo, bhi))
+            continue;
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+            {
+                float tlo[3], thi[3];
+                _triangle_bounds(corners_[i], tlo, thi);
+                if (_box_overlap(tlo, thi, blo, bhi))
+                    faces.push_back(order_[i]);
+            }
+            continue;
+        }
+        stack[top++] = node.first;
+        stack[top++] = node.first + 1;
+    }
+}
+
+void MeshBVH::overlap(const MeshBVH& other, std::vector<std::pair<int, int>>& pairs) const
+{
+    if (nodes_.empty() || other.nodes_.empty())
+        return;
+    std::vector<std::pair<int, int>> stack{ { 0, 0 } };
+    while (!stack.empty())
+    {
+        const auto top = stack.back();
+        stack.pop_back();
+        const BVHNode &a = nodes_[top.first];
+        const BVHNode &b = other.nodes_[top.second];
+        if (!_box_overlap(a.lo, a.hi, b.lo, b.hi))
+            continue;
+        if (a.count > 0 && b.count > 0)
+        {
+            for (int i = a.first; i < a.first + a.count; ++i)
+            {
+                float alo[3], ahi[3];
+                _triangle_bounds(corners_[i], alo, ahi);
+                for (int j = b.first; j < b.first + b.count; ++j)
+                {
+                    float blo[3], bhi[3];
+                    _triangle_bounds(other.corners_[j], blo, bhi);
+                    if (_box_overlap(alo, ahi, blo, bhi))
+                        pairs.push_back({ order_[i], other.order_[j] });
+                }
+            }
+            continue;
+        }
+        // down the larger one.
+        if (b.count > 0 || (a.count == 0 && _bounds(a).area() >= _bounds(b).area()))
+        {
+            stack.push_back({ a.first, top.second });
+            stack.push_back({ a.first + 1, top.second });
+        }
+        else
+        {
+            stack.push_back({ top.first, b.first });
+            stack.push_back({ top.first, b.first + 1 });
+        }
+    }
+}
+
+int MeshBVH::depth() const
+{
+    if (nodes_.empty())
+        return 0;
+    std::vector<int> level(nodes_.size(), 0);
+    int deepest = 0;
+    for (int k = 0; k < static_cast<int>(nodes_.size()); ++k)
+    {
+        deepest = std::max(deepest, level[k]);
+        if (nodes_[k].count == 0)
+            level[nodes_[k].first] = level[nodes_[k].first + 1] = level[k] + 1;
+    }
+    return deepest + 1;
+}
+
+double MeshBVH::sah_cost() const
+{
+    if (nodes_.empty())
+        return 0.0;
+    const double root = _bounds(nodes_[0]).area();
+    if (root <= 0.0)
+        return static_cast<double>(order_.size());
+    double cost = 0.0;
+    for (const auto &node : nodes_)
+        cost += _bounds(node).area() / root * (node.count == 0 ? 1.0 : node.count);
+    return cost;
+}
+
+MeshBVHBenchmark MeasureMeshBVH(const std::vector<Eigen::Vector3f>& position,
+    const std::vector<std::array<int, 3>>& faces, int n_queries)
+{
+    MeshBVHBenchmark stat;
+    MeshBVH bvh;
+    QElapsedTimer timer;
+    timer.start();
+    bvh.build(position, faces);
+    stat.ms_build = timer.nsecsElapsed() * 1e-6;
+    timer.restart();
+    bvh.refit(position);
+    stat.ms_refit = timer.nsecsElapsed() * 1e-6;
+
+    stat.n_nodes = static_cast<int>(bvh.nodes().size());
+    stat.n_leaves = 0;
+    for (const auto &node : bvh.nodes())
+        stat.n_leaves += node.count > 0 ? 1 : 0;
+    stat.depth = bvh.depth();
+    stat.sah_cost = bvh.sah_cost();
+    stat.ns_per_ray = stat.ns_per_closest = stat.ns_per_ray_brute = 0.0;
+    if (bvh.empty() || n_queries <= 0)
+        return stat;
+
+    // rays from a sphere around the bounds to points in them.
+    const auto &root = bvh.nodes()[0];
+    const Vector3f lo{ root.lo[0], root.lo[1], root.lo[2] };
+    const Vector3f hi{ root.hi[0], root.hi[1], root.hi[2] };
+    const Vector3f center = 0.5f * (lo + hi);
+    const float radius = (hi - lo).norm();
+    std::mt19937 rng(5489u);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<Vector3f> origins(n_queries), targets(n_queries);
+    for (int q = 0; q < n_queries; ++q)
+    {
+        Vector3f s{ normal(rng), normal(rng), normal(rng) };
+        origins[q] = center + radius * s.normalized();
+        targets[q] = lo + Vector3f{ unit(rng), unit(rng), unit(rng) }.cwiseProduct(hi - lo);
+    }
+
+    int hits = 0;
+    timer.restart();
+    for (int q = 0; q < n_queries; ++q)
+    {
+        RayHit hit;
+        hits += bvh.raycast(origins[q], targets[q] - origins[q], 2.0f, hit) ? 1 : 0;
+    }
+    stat.ns_per_ray = static_cast<double>(timer.nsecsElapsed()) / n_queries;
+
+    float sum = 0.0f;
+    timer.restart();
+    for (int q = 0; q < n_queries; ++q)
+    {
+        ClosestHit hit;
+        if (bvh.closest(targets[q], radius, hit))
+            sum += hit.distance;
+    }
+    stat.ns_per_closest = static_cast<double>(timer.nsecsElapsed()) / n_queries;
+
+    // every triangle for a few of the rays.
+    const int n_brute = std::min(n_queries, 16);
+    timer.restart();
+    for (int q = 0; q < n_brute; ++q)
+    {
+        const Vector3f d = targets[q] - origins[q];
+        for (const auto &f : faces)
+        {
+            const std::array<Vector3f, 3> tri = { position[f[0]], position[f[1]], position[f[2]] };
+            float t, u, v;
+            if (_ray_triangle(tri, origins[q], d, t, u, v))
+                sum += t;
+        }
+    }
+    stat.ns_per_ray_brute = static_cast<double>(timer.nsecsElapsed()) / n_brute;
+    // keep the loops.
+    volatile float keep = sum + hits;
+    (void)keep;
+    return stat;
+}
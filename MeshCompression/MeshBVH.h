@@ -0,0 +1,91 @@
+#pragma once
+#include "OpenMeshBasic.h"
+#include <Eigen/Core>
+#include <vector>
+#include <array>
+#include <utility>
+
+// 32 bytes, two to a cache line; children are allocated in pairs, so the
+// right one is always first + 1.
+struct BVHNode
+{
+    float lo[3];
+    int first;                      // leaf: into the triangle order, else the left child.
+    float hi[3];
+    int count;                      // triangles of a leaf, 0 for an inner node.
+};
+
+struct RayHit
+{
+    int fi;
+    float t;                        // along the direction as given.
+    Eigen::Vector3f bary;
+};
+
+struct ClosestHit
+{
+    int fi;
+    float distance;
+    Eigen::Vector3f point;
+    Eigen::Vector3f bary;
+};
+
+// Bounding volume hierarchy over the triangles of a surface, for picking,
+// inside tests and distances between surfaces, and overlaps for collision.
+//
+// Split by the surface area heuristic over BVH_BINS bins of the centroids
+// along the widest axis. The top of the tree is split in order until there
+// are a few subtrees per thread, those are built in parallel and spliced in
+// after it. Leaves hold their triangles' corners in tree order, so no query
+// goes through an index to reach them. refit() keeps the tree and takes the
+// bounds of moved vertices bottom up (children always come after their
+// parent), for meshes that deform but keep their triangles.
+class MeshBVH
+{
+public:
+    MeshBVH() {  }
+    void build(const std::vector<Eigen::Vector3f> &position, const std::vector<std::array<int, 3>> &faces);
+    void build(const TriMesh &mesh);
+    void refit(const std::vector<Eigen::Vector3f> &position);
+    void refit(const TriMesh &mesh);
+
+    // nearest hit in (0, t_max].
+    bool raycast(const Eigen::Vector3f &origin, const Eigen::Vector3f &direction, float t_max, RayHit &hit) const;
+    // nearest point within max_distance.
+    bool closest(const Eigen::Vector3f &p, float max_distance, ClosestHit &hit) const;
+    // by the parity of the crossings of a ray; the surface closed.
+    bool inside(const Eigen::Vector3f &p) const;
+    // triangles whose bounds overlap [lo, hi], in no order.
+    void overlap(const Eigen::Vector3f &lo, const Eigen::Vector3f &hi, std::vector<int> &faces) const;
+    // (this, other) triangle pairs whose bounds overlap.
+    void overlap(const MeshBVH &other, std::vector<std::pair<int, int>> &pairs) const;
+
+    bool empty() const { return nodes_.empty(); }
+    const std::vector<BVHNode> &nodes() const { return nodes_; }
+    int depth() const;
+    // expected cost of a query, inner nodes 1 and triangles 1 each.
+    double sah_cost() const;
+
+private:
+    int crossings(const Eigen::Vector3f &origin, const Eigen::Vector3f &direction) const;
+
+    std::vector<BVHNode> nodes_;
+    std::vector<int> order_;        // triangle of each leaf slot.
+    std::vector<std::array<Eigen::Vector3f, 3>> corners_;  // of order_[i].
+    std::vector<std::array<int, 3>> faces_;
+};
+
+struct MeshBVHBenchmark
+{
+    double ms_build;
+    double ms_refit;
+    int n_nodes;
+    int n_leaves;
+    int depth;
+    double sah_cost;
+    double ns_per_ray;              // random rays through the bounds.
+    double ns_per_closest;          // random points in the bounds.
+    double ns_per_ray_brute;        // every triangle, a few rays.
+};
+MeshBVHBenchmark MeasureMeshBVH(const std::vector<Eigen::Vector3f> &position,
+    const std::vector<std::array<int, 3>> &faces, int n_queries);
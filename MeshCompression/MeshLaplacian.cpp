@@ -0,0 +1,141 @@
+#include "stdafx.h"
+#include "MeshLaplacian.h"
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+using Eigen::Vector3d;
+
+#define LAPLACIAN_CACHE_SIZE 4
+
+// cot of the angle at the corner opposite to h, 0 without a face.
+static double _cot_opposite(const TriMesh &mesh, const Eigen::MatrixX3d &p, OpenMesh::HalfedgeHandle h)
+{
+    if (!h.is_valid() || mesh.is_boundary(h))
+        return 0.0;
+    int i = mesh.from_vertex_handle(h).idx();
+    int j = mesh.to_vertex_handle(h).idx();
+    int k = mesh.to_vertex_handle(mesh.next_halfedge_handle(h)).idx();
+    Vector3d a = p.row(i) - p.row(k);
+    Vector3d b = p.row(j) - p.row(k);
+    double s = a.cross(b).norm();
+    return s > 1e-20 ? a.dot(b) / s : 0.0;
+}
+
+void BuildMeshLaplacian(const TriMesh& mesh, MeshLaplacian& lap)
+{
+    const int n = static_cast<int>(mesh.n_vertices());
+    lap.points.resize(n, 3);
+    for (int vi = 0; vi < n; ++vi)
+    {
+        auto q = mesh.point(mesh.vertex_handle(vi));
+        lap.points.row(vi) = Vector3d{ q[0], q[1], q[2] };
+    }
+    const auto &p = lap.points;
+
+    // STEP 1:  Row sizes: the neighbors and the diagonal.
+    std::vector<int> outer(n + 1, 0);
+#pragma omp parallel for
+    for (int vi = 0; vi < n; ++vi)
+    {
+        int valence = 0;
+        for (auto voh = mesh.cvoh_iter(mesh.vertex_handle(vi)); voh.is_valid(); ++voh)
+            ++valence;
+        outer[vi + 1] = valence + 1;
+    }
+    for (int vi = 0; vi < n; ++vi)
+        outer[vi + 1] += outer[vi];
+
+    // STEP 2:  Rows, columns sorted, and the mass.
+    std::vector<int> inner(outer[n]);
+    std::vector<double> values(outer[n]);
+    lap.mass = Eigen::VectorXd::Zero(n);
+#pragma omp parallel for
+    for (int vi = 0; vi < n; ++vi)
+    {
+        auto vh = mesh.vertex_handle(vi);
+        std::vector<std::pair<int, double>> row;
+        row.emplace_back(vi, 0.0);
+        double diagonal = 0.0;
+        double area = 0.0;
+        for (auto voh = mesh.cvoh_iter(vh); voh.is_valid(); ++voh)
+        {
+            OpenMesh::HalfedgeHandle h = *voh;
+            int vj = mesh.to_vertex_handle(h).idx();
+            double w = _cot_opposite(mesh, p, h) + _cot_opposite(mesh, p, mesh.opposite_halfedge_handle(h));
+            row.emplace_back(vj, w);
+            diagonal -= w;
+            if (!mesh.is_boundary(h))
+            {
+                int vk = mesh.to_vertex_handle(mesh.next_halfedge_handle(h)).idx();
+                Vector3d a = p.row(vj) - p.row(vi);
+                Vector3d b = p.row(vk) - p.row(vi);
+                area += 0.5 * a.cross(b).norm();
+            }
+        }
+        row[0].second = diagonal;
+        std::sort(row.begin(), row.end());
+        int k = outer[vi];
+        for (auto &e : row)
+        {
+            inner[k] = e.first;
+            values[k] = e.second;
+            ++k;
+        }
+        lap.mass[vi] = area / 3.0;
+    }
+
+    lap.L = Eigen::Map<const MeshLaplacian::SpMatR>(n, n, outer[n], outer.data(), inner.data(), values.data());
+}
+
+quint64 MeshHash(const TriMesh& mesh)
+{
+    quint64 h = 14695981039346656037ULL;
+    auto feed = [&h](const void *data, size_t size)
+    {
+        auto c = static_cast<const uchar *>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            h ^= c[i];
+            h *= 1099511628211ULL;
+        }
+    };
+    for (auto vh : mesh.vertices())
+        feed(mesh.point(vh).data(), 3 * sizeof(float));
+    for (auto fh : mesh.faces())
+        for (auto fv = mesh.cfv_iter(fh); fv.is_valid(); ++fv)
+        {
+            int idx = fv->idx();
+            feed(&idx, sizeof(idx));
+        }
+    return h;
+}
+
+std::shared_ptr<const MeshLaplacian> CachedMeshLaplacian(const TriMesh& mesh)
+{
+    static std::mutex mutex;
+    static std::vector<std::pair<quint64, std::shared_ptr<const MeshLaplacian>>> cache;   // most recent last.
+
+    const quint64 key = MeshHash(mesh);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            if (cache[i].first != key)
+                continue;
+            auto hit = cache[i];
+            cache.erase(cache.begin() + i);
+            cache.push_back(hit);
+            return hit.second;
+        }
+    }
+
+    auto lap = std::make_shared<MeshLaplacian>();
+    BuildMeshLaplacian(mesh, *lap);
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.emplace_back(key, lap);
+    if (cache.size() > LAPLACIAN_CACHE_SIZE)
+        cache.erase(cache.begin());
+    return lap;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "OpenMeshBasic.h"
+#include <QtGlobal>
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+#include <memory>
+
+// Cotangent Laplacian and lumped mass of a triangle mesh.
+//
+// L_ij = cot a_ij + cot b_ij for an edge ij (the angles opposite to it,
+// one on a boundary edge), L_ii = -sum_j L_ij: the weights the skeleton and
+// offset scripts always used. mass_i is a third of the area of the faces
+// around i. L is built row by row straight into CSR from the outgoing
+// half-edges of each vertex, in parallel, so memory is O(V + E).
+struct MeshLaplacian
+{
+    using SpMatR = Eigen::SparseMatrix<double, Eigen::RowMajor>;
+
+    SpMatR L;
+    Eigen::VectorXd mass;
+    Eigen::MatrixX3d points;        // the shape it was built for, row i vertex i.
+};
+
+void BuildMeshLaplacian(const TriMesh &mesh, MeshLaplacian &lap);
+// FNV-1a of the points and the faces: the key of the caches of a shape.
+quint64 MeshHash(const TriMesh &mesh);
+// The Laplacian of the current shape of `mesh`, built once: the last few
+// are kept, keyed by a hash of the points and faces.
+std::shared_ptr<const MeshLaplacian> CachedMeshLaplacian(const TriMesh &mesh);
@@ -0,0 +1,217 @@
+#include "stdafx.h"
+#include "OffsetOptimizer.h"
+#include <deque>
+#include <limits>
+
+using Eigen::VectorXd;
+
+// the phase one box: each side moved in by this of its width.
+#define FEASIBLE_MARGIN 1e-3
+// a warm start backs the barrier weight off by this.
+#define WARM_BACKOFF 10.0
+
+using MaxStep = std::function<double(const VectorXd &x, const VectorXd &d)>;
+
+// L-BFGS from x, Armijo backtracking from min(1, max_step(x, d)), an
+// infinite value is rejected as well; returns the number of evaluations.
+static int _lbfgs(const OffsetOptimizer::Objective &f, const MaxStep &max_step, VectorXd &x, double &fx,
+    int max_iter, int memory, double tol_function, double tol_step)
+{
+    VectorXd g(x.size());
+    fx = f(x, g);
+    int evaluations = 1;
+
+    std::deque<VectorXd> S, Y;
+    std::deque<double> rho;
+    VectorXd x_new(x.size()), g_new(x.size()), d(x.size());
+    std::vector<double> alpha(memory);
+    for (int it = 0; it < max_iter; ++it)
+    {
+        if (g.lpNorm<Eigen::Infinity>() < 1e-12)
+            break;
+
+        // two-loop recursion, the newest pair scaling the initial Hessian.
+        d = -g;
+        for (int i = static_cast<int>(S.size()) - 1; i >= 0; --i)
+        {
+            alpha[i] = rho[i] * S[i].dot(d);
+            d -= alpha[i] * Y[i];
+        }
+        if (!S.empty())
+            d *= S.back().dot(Y.back()) / Y.back().squaredNorm();
+        else
+            d /= std::max(1.0, g.norm());
+        for (int i = 0; i < static_cast<int>(S.size()); ++i)
+        {
+            double beta = rho[i] * Y[i].dot(d);
+            d += (alpha[i] - beta) * S[i];
+        }
+        double slope = g.dot(d);
+        if (slope >= 0.0)
+        {
+            // not a descent direction any more: restart from steepest descent.
+            S.clear();
+            Y.clear();
+            rho.clear();
+            d = -g / std::max(1.0, g.norm());
+            slope = g.dot(d);
+        }
+
+        double step = max_step ? std::min(1.0, max_step(x, d)) : 1.0;
+        double f_new = 0.0;
+        bool accepted = false;
+        for (int ls = 0; ls < 40 && step > 0.0; ++ls)
+        {
+            x_new = x + step * d;
+            f_new = f(x_new, g_new);
+            ++evaluations;
+            if (f_new <= fx + 1e-4 * step * slope)
+            {
+                accepted = true;
+                break;
+            }
+            step *= 0.5;
+        }
+        if (!accepted)
+            break;
+
+        VectorXd s = x_new - x;
+        VectorXd y = g_new - g;
+        const double decrease = fx - f_new;
+        x = x_new;
+        g = g_new;
+        fx = f_new;
+
+        const double sy = s.dot(y);
+        if (sy > 1e-10 * y.squaredNorm())
+        {
+            if (static_cast<int>(S.size()) == memory)
+            {
+                S.pop_front();
+                Y.pop_front();
+                rho.pop_front();
+            }
+            S.push_back(s);
+            Y.push_back(y);
+            rho.push_back(1.0 / sy);
+        }
+
+        if (decrease <= tol_function * (1.0 + std::abs(fx))
+            || s.lpNorm<Eigen::Infinity>() <= tol_step * (1.0 + x.lpNorm<Eigen::Infinity>()))
+            break;
+    }
+    return evaluations;
+}
+
+OffsetOptimizer::OffsetOptimizer(const Eigen::MatrixXd& B, const Eigen::VectorXd& lower, const Eigen::VectorXd& upper) :
+    B_(B), lower_(lower), upper_(upper)
+{
+    reset();
+}
+
+void OffsetOptimizer::reset()
+{
+    t_ = 0.0;
+}
+
+double OffsetOptimizer::violation(const Eigen::VectorXd& a) const
+{
+    VectorXd z = B_ * a;
+    return std::max(0.0, std::max((z - upper_).maxCoeff(), (lower_ - z).maxCoeff()));
+}
+
+// Phase one: min 1/2 |z - P(z)|^2 for the shrunk box, convex; true if a
+// ends strictly inside.
+bool OffsetOptimizer::Feasible_Start(Eigen::VectorXd& a, int& evaluations, const OffsetOptimizerOptions& options) const
+{
+    const VectorXd margin = FEASIBLE_MARGIN * (upper_ - lower_).cwiseMax(0.0);
+    const VectorXd lo = lower_ + margin, hi = upper_ - margin;
+    auto excess = [&](const VectorXd &x, VectorXd &grad)
+    {
+        VectorXd z = B_ * x;
+        VectorXd e = z - z.cwiseMax(lo).cwiseMin(hi);
+        grad.noalias() = B_.transpose() * e;
+        return 0.5 * e.squaredNorm();
+    };
+    for (int it = 0; it < options.max_iter; ++it)
+    {
+        VectorXd z = B_ * a;
+        if ((z - lower_).minCoeff() > 0.0 && (upper_ - z).minCoeff() > 0.0)
+            return true;
+        double e = 0.0;
+        evaluations += _lbfgs(excess, nullptr, a, e, options.max_inner, options.memory, 0.0, 1e-14);
+    }
+    VectorXd z = B_ * a;
+    return (z - lower_).minCoeff() > 0.0 && (upper_ - z).minCoeff() > 0.0;
+}
+
+OffsetOptimizerResult OffsetOptimizer::minimize(const Objective& f, Eigen::VectorXd& a, const OffsetOptimizerOptions& options)
+{
+    OffsetOptimizerResult result{ 0.0, 0.0, 0, 0, false, false };
+    const int m = static_cast<int>(B_.rows());
+    VectorXd grad(a.size());
+
+    // STEP 1:  Strictly feasible start.
+    if (!Feasible_Start(a, result.evaluations, options))
+    {
+        result.f = f(a, grad);
+        result.violation = violation(a);
+        ++result.evaluations;
+        return result;
+    }
+    result.feasible = true;
+
+    // STEP 2:  Barrier weight: cold, the objective and the barrier weigh the same.
+    const double f0 = f(a, grad);
+    ++result.evaluations;
+    if (t_ <= 0.0)
+        t_ = std::max(1e-12, (1.0 + std::abs(f0)) / (2.0 * m));
+    else
+        t_ *= WARM_BACKOFF;
+
+    auto barrier = [&](const VectorXd &x, VectorXd &g)
+    {
+        VectorXd z = B_ * x;
+        VectorXd up = upper_ - z, lo = z - lower_;
+        if (up.minCoeff() <= 0.0 || lo.minCoeff() <= 0.0)
+            return std::numeric_limits<double>::infinity();
+        double fx = f(x, g);
+        g.noalias() += t_ * (B_.transpose() * (up.cwiseInverse() - lo.cwiseInverse()));
+        return fx - t_ * (up.array().log().sum() + lo.array().log().sum());
+    };
+    // fraction to the boundary: 0.99 of the largest step staying inside.
+    auto max_step = [&](const VectorXd &x, const VectorXd &d)
+    {
+        VectorXd z = B_ * x, dz = B_ * d;
+        double step = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < m; ++i)
+        {
+            if (dz[i] > 0.0)
+                step = std::min(step, (upper_[i] - z[i]) / dz[i]);
+            else if (dz[i] < 0.0)
+                step = std::min(step, (lower_[i] - z[i]) / dz[i]);
+        }
+        return 0.99 * step;
+    };
+
+    // STEP 3:  Outer iterations, t down by 10 each.
+    for (int it = 0; it < options.max_iter; ++it)
+    {
+        double phi = 0.0;
+        result.evaluations += _lbfgs(barrier, max_step, a, phi, options.max_inner, options.memory,
+            options.tol_function * 1e-2, options.tol_step);
+        ++result.iterations;
+
+        result.f = f(a, grad);
+        ++result.evaluations;
+        const double tol = options.tol_function * (1.0 + std::abs(result.f));
+        if (2.0 * m * t_ <= tol)
+        {
+            result.converged = true;
+            break;
+        }
+        t_ *= 0.1;
+    }
+    result.violation = violation(a);
+    return result;
+}
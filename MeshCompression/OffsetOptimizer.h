@@ -0,0 +1,58 @@
+#pragma once
+#include <Eigen/Core>
+#include <functional>
+
+// min f(a)  s.t.  lower <= B a <= upper, B dense with a few columns: the
+// problem script/Optimize.m gave fmincon (A = [DdDa; -DdDa]).
+//
+// Interior point: the iterates stay strictly feasible, as fmincon's
+// active-set ones did; the shell objectives are not bounded outside (the
+// center of a vanishing shell runs off), so a penalty method cannot be used.
+// Phase one pulls a into the box shrunk by a small margin (least squares on
+// the excess), then each outer iteration minimizes
+//     f(a) - t sum_i log(upper_i - z_i) + log(z_i - lower_i),  z = B a,
+// with L-BFGS, steps cut to stay inside, and divides t by 10; done when the
+// barrier's bound on the gap, 2 m t, is below tol_function |f|.
+// t is kept between minimize() calls, so re-optimizing after changing only
+// the objective weights starts from the last solution, near its end.
+struct OffsetOptimizerOptions
+{
+    int max_iter = 40;              // outer iterations.
+    int max_inner = 100;            // L-BFGS iterations in each.
+    int memory = 8;
+    double tol_function = 1e-5;
+    double tol_step = 1e-7;
+};
+
+struct OffsetOptimizerResult
+{
+    double f;
+    double violation;               // largest over the rows, 0 once feasible.
+    int iterations;
+    int evaluations;
+    bool converged;
+    bool feasible;                  // false if no strictly feasible start was found.
+};
+
+class OffsetOptimizer
+{
+public:
+    // value at a, its gradient written to grad.
+    using Objective = std::function<double(const Eigen::VectorXd &a, Eigen::VectorXd &grad)>;
+
+    OffsetOptimizer(const Eigen::MatrixXd &B, const Eigen::VectorXd &lower, const Eigen::VectorXd &upper);
+
+    OffsetOptimizerResult minimize(const Objective &f, Eigen::VectorXd &a, const OffsetOptimizerOptions &options);
+    // forget the barrier weight: the next minimize() starts cold.
+    void reset();
+
+    double violation(const Eigen::VectorXd &a) const;
+
+private:
+    Eigen::MatrixXd B_;
+    Eigen::VectorXd lower_;
+    Eigen::VectorXd upper_;
+    double t_;                      // <= 0: cold.
+
+    bool Feasible_Start(Eigen::VectorXd &a, int &evaluations, const OffsetOptimizerOptions &options) const;
+};
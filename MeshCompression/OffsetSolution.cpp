@@ -1,301 +1,313 @@
 #include "stdafx.h"
-//#include "OffsetSolution.h"
-//
-//#define SPLIT(v) (v)[0], (v)[1], (v)[2]
-//#define VERBOSE verbose_
-//#define MOD(x, m) (((x) + (m)) % (m))
-//#define lout() {if (VERBOSE) printf("\n");}
-//#define dout(d) {if (VERBOSE) printf(#d " = %f\n", (d));}
-//#define vout(v) {if (VERBOSE) printf(#v " = (%f, %f, %f)\n", SPLIT(v));}
-//#define mout(x) {if (VERBOSE&&x.rows()<50)std::cout<<#x<<"\n"<<x<<"\n\n";}
-//
-//#define BUFFERSIZE 65536
-//
-//template <typename T1, typename T2>
-//T2 vec_cast(const T1 &v)
-//{
-//    return{ v[0], v[1], v[2] };
-//}
-//
-//OffsetSolution::~OffsetSolution()
-//{
-//}
-//
-//void OffsetSolution::offset()
-//{
-//    verbose_ = tcl_.get_bool("Verbose");
-//
-//    msg_.log("start offset.");
-//
-//    auto &mesh = scene_.get("Main")->mesh();
-//
-//    if (mesh.vertices_empty())
-//    {
-//        msg_.log("mesh empty.");
-//        return;
-//    }
-//
-//    n_vertices = mesh.n_vertices();
-//    n_edges = mesh.n_edges();
-//    n_faces = mesh.n_faces();
-//
-//    vector<T> tv_Lap;
-//    Basic_Prepare_and_Calculate_Laplacian(tv_Lap);
-//
-//    // MATLAB engine
-//    Engine *ep;
-//    if ((ep = engOpen("")) == nullptr)
-//    {
-//        msg_.log("MATLAB engine fail to start.");
-//        return;
-//    }
-//
-//    Input_Variables_to_Engine(ep);
-//
-//    // After this sub-routine, sparse matrix 'Lap' added to workspace.
-//    Input_Laplacian_to_Engine(tv_Lap, ep);
-//
-//    // After this sub-routine, n*3 matrix 'X_0' added to workspace.
-//    Input_Positions_to_Engine(ep);
-//
-//    // After this sub-routine, n_face*3 matrix 'Tri' added to workspace.
-//    Input_Topology_to_Engine(ep);
-//
-//    // After this sub-routine, n*3 matrix 'V' added to workspace.
-//    // After this sub-routine, n*1 vector 'bounds' added to workspace.
-//    Input_OffsetVector_to_Engine(ep);
-//
-//    QDir there{ "./script" };
-//    auto cd_statement = "cd " + there.absolutePath();
-//    engEvalString(ep, cd_statement.toStdString().c_str());
-//
-//    // run MATLAB script
-//    char buffer[BUFFERSIZE] = "";
-//    engOutputBuffer(ep, buffer, BUFFERSIZE);
-//    QFile script_file{ tcl_.get_string("Script_Filename") };
-//    script_file.open(QFile::ReadOnly | QFile::Text);
-//    QTextStream tsv{ &script_file };
-//    QString script = tsv.readAll();
-//    engEvalString(ep, script.toStdString().c_str());
-//    std::cout << buffer;
-//
-//    // Write Back
-//    mxArray *ResX = engGetVariable(ep, "X_in_result");
-//    if (scene_.get("Inner") != nullptr)
-//    {
-//        scene_.remove_model("Inner");
-//    }
-//
-//    auto mesh_clone_w = *scene_.get("Main");
-//    auto &mesh_clone = mesh_clone_w.mesh();
-//    for (int i = 0; i < n_vertices; i++)
-//    {
-//        Vector3f pos{ 0, 0, 0 };
-//        pos[0] = mxGetPr(ResX)[i];
-//        pos[1] = mxGetPr(ResX)[i + n_vertices];
-//        pos[2] = mxGetPr(ResX)[i + n_vertices * 2];
-//        mesh_clone.point(mesh_clone.vertex_handle(i)) = { SPLIT(pos) };
-//    }
-//
-//    mesh_clone_w.name_ = "Inner";
-//    mesh_clone_w.color_ = { 0.3f, 0.6f, 1.0f };
-//    scene_.add_model(mesh_clone_w);
-//
-//
-//    msg_.log("complete offset.");
-//}
-//
-//// return a vector of Triples contains rows, cols, vals for the Laplacian.
-//// use a cotangent-weight Laplacian
-//// Complish the prepare: position and geometry topology extraction, offset-vector.
-//void OffsetSolution::Basic_Prepare_and_Calculate_Laplacian(vector<T> &tv_Lap)
-//{
-//    auto &mesh_ = scene_.get("Main")->mesh();
-//
-//    positions.clear();
-//    for (auto vh : mesh_.vertices())
-//    {
-//        positions.push_back(vec_cast<OpenMesh::Vec3f, Eigen::Vector3f>(mesh_.point(vh)));
-//    }
-//
-//    adjacency = vector<vector<bool>>(n_vertices, vector<bool>(n_vertices, false));
-//    degrees = vector<int>(n_vertices, 0);
-//    neighbors = vector<vector<int>>(n_vertices);
-//    offset_vector = vector<Vector3f>(n_vertices, { 0, 0, 0 });
-//    offset_bounds = vector<float>(n_vertices, 0.0f);
-//    //triangles = vector<array<int, 3>>(n_faces, { 0, 0, 0 });
-//    for (auto vh : mesh_.vertices())
-//    {
-//        auto index_main = vh.idx();
-//        // for all the neighbors of the vertex:
-//        for (auto vvi = mesh_.vv_iter(vh); vvi.is_valid(); ++vvi)
-//        {
-//            auto vi = *vvi;
-//            auto index_sub = vi.idx();
-//            adjacency[index_main][index_sub] = true;
-//            degrees[index_main] += 1;
-//            neighbors[index_main].push_back(index_sub);
-//        }
-//    }
-//
-//    for (auto fh : mesh_.faces())
-//    {
-//        auto fvit = mesh_.fv_iter(fh);
-//        array<int, 3> face_idx;
-//        int i = 0;
-//        for (; fvit; ++fvit)
-//        {
-//            face_idx[i++] = fvit->idx();
-//        }
-//        triangles.push_back(face_idx);
-//    }
-//
-//    Calculate_OffsetVector();
-//
-//    for (int vi = 0; vi < n_vertices; ++vi)
-//    {
-//        float weight_sum = 0.0f;
-//        int degree = degrees[vi];
-//        for (int j = 0; j < degree; ++j)
-//        {
-//            int vj = neighbors[vi][j];
-//            int vleft = neighbors[vi][MOD(j + 1, degree)];
-//            int vright = neighbors[vi][MOD(j - 1, degree)];
-//            auto weight = _cotangent_for_angle_AOB(vi, vleft, vj) + _cotangent_for_angle_AOB(vi, vright, vj);
-//            /*if (weight < 0.0f)
-//            weight = 0.0f;*/
-//            weight_sum += weight;
-//            tv_Lap.push_back(T{ vi, vj, weight });
-//        }
-//        tv_Lap.push_back(T{ vi, vi, -weight_sum });
-//    }
-//}
-//
-//// Calculate the offset vectors and the bounds.
-//void OffsetSolution::Calculate_OffsetVector()
-//{
-//    auto &mesh = scene_.get("Main")->mesh();
-//    auto &skel = scene_.get("Skeleton")->mesh();
-//
-//    for (int vi = 0; vi < mesh.n_vertices(); ++vi)
-//    {
-//        auto mesh_pos = vec_cast<OpenMesh::Vec3f, Eigen::Vector3f>(mesh.point(mesh.vertex_handle(vi)));
-//        auto skel_pos = vec_cast<OpenMesh::Vec3f, Eigen::Vector3f>(skel.point(skel.vertex_handle(vi)));
-//
-//        Eigen::Vector3f delta = skel_pos - mesh_pos;
-//        float length = delta.norm();
-//        delta.normalize();
-//
-//        offset_vector[vi] = delta;
-//        offset_bounds[vi] = length;
-//    }
-//}
-//
-//void OffsetSolution::Input_Variables_to_Engine(Engine* ep)
-//{
-//    // scalar
-//    mxArray *scalar_Verbose = mxCreateDoubleMatrix(1, 1, mxREAL);
-//    mxGetPr(scalar_Verbose)[0] = tcl_.get_value("Verbose");
-//    engPutVariable(ep, "Verbose", scalar_Verbose);
-//    //mxArray *scalar_Iteration_Limit = mxCreateDoubleMatrix(1, 1, mxREAL);
-//    //mxGetPr(scalar_Iteration_Limit)[0] = tcl_.get_value("Iteration_Limit");
-//    //engPutVariable(ep, "Iteration_Limit", scalar_Iteration_Limit);
-//}
-//
-//void OffsetSolution::Input_Laplacian_to_Engine(const vector<T> &tv_Lap, Engine* ep)
-//{
-//    // sparse matrix: Laplacian
-//    int builder_length = tv_Lap.size();
-//    mxArray
-//        *LapRow = mxCreateDoubleMatrix(builder_length, 1, mxREAL),
-//        *LapCol = mxCreateDoubleMatrix(builder_length, 1, mxREAL),
-//        *LapVal = mxCreateDoubleMatrix(builder_length, 1, mxREAL);
-//
-//    for (int i = 0; i < builder_length; i++)
-//    {
-//        auto t = tv_Lap[i];
-//        mxGetPr(LapRow)[i] = t.row() + 1;     // MATLAB index starts
-//        mxGetPr(LapCol)[i] = t.col() + 1;     // from 1.
-//        mxGetPr(LapVal)[i] = t.value();
-//    }
-//    engPutVariable(ep, "LapRow", LapRow);
-//    engPutVariable(ep, "LapCol", LapCol);
-//    engPutVariable(ep, "LapVal", LapVal);
-//    engEvalString(ep, "Lap = sparse(LapRow, LapCol, LapVal);");
-//}
-//
-//void OffsetSolution::Input_Positions_to_Engine(Engine* ep)
-//{
-//    // matrix: X_0
-//    // size:   n * 3
-//    mxArray *X_0 = mxCreateDoubleMatrix(n_vertices, 3, mxREAL);
-//
-//    for (int i = 0; i < n_vertices; i++)
-//    {
-//        mxGetPr(X_0)[i] = positions[i][0];
-//        mxGetPr(X_0)[i + n_vertices] = positions[i][1];
-//        mxGetPr(X_0)[i + n_vertices * 2] = positions[i][2];
-//
-//    }
-//    engPutVariable(ep, "X_0", X_0);
-//}
-//
-//void OffsetSolution::Input_Topology_to_Engine(Engine* ep)
-//{
-//    // matrix: Tri
-//    // size:   n_face * 3
-//    mxArray *Tri = mxCreateDoubleMatrix(n_faces, 3, mxREAL);
-//
-//    for (int i = 0; i < n_faces; i++)
-//    {
-//        mxGetPr(Tri)[i] = triangles[i][0] + 1;
-//        mxGetPr(Tri)[i + n_faces] = triangles[i][1] + 1;
-//        mxGetPr(Tri)[i + n_faces * 2] = triangles[i][2] + 1;
-//
-//    }
-//    engPutVariable(ep, "Tri", Tri);
-//}
-//
-//void OffsetSolution::Input_OffsetVector_to_Engine(Engine* ep)
-//{
-//    // matrix: V
-//    // size:   n * 3
-//    mxArray *V = mxCreateDoubleMatrix(n_vertices, 3, mxREAL);
-//
-//    for (int i = 0; i < n_vertices; i++)
-//    {
-//        mxGetPr(V)[i] = offset_vector[i][0];
-//        mxGetPr(V)[i + n_vertices] = offset_vector[i][1];
-//        mxGetPr(V)[i + n_vertices * 2] = offset_vector[i][2];
-//    }
-//    engPutVariable(ep, "V", V);
-//
-//    // vector: bounds
-//    // size: n * 1
-//    mxArray *bounds = mxCreateDoubleMatrix(n_vertices, 1, mxREAL);
-//
-//    for (int i = 0; i < n_vertices; i++)
-//    {
-//        mxGetPr(bounds)[i] = offset_bounds[i];
-//    }
-//    engPutVariable(ep, "bounds", bounds);
-//}
-//
-//// return con(angle AOB)
-//float OffsetSolution::_cotangent_for_angle_AOB(int A, int O, int B)
-//{
-//    auto a = positions[A];
-//    auto o = positions[O];
-//    auto b = positions[B];
-//
-//    auto oa = static_cast<Vector3f>(a - o);
-//    auto ob = static_cast<Vector3f>(b - o);
-//    //vout(oa);
-//    //vout(ob);
-//
-//    auto cot = oa.dot(ob) / oa.cross(ob).norm();
-//    //dout(cot);
-//    //lout();
-//
-//    return cot;
-//}
\ No newline at end of file
+#include "OffsetSolution.h"
+#include "ManifoldHarmonics.h"
+
+#define VERBOSE verbose_
+
+using Eigen::VectorXd;
+using DMatrix = Eigen::Matrix<double, N_MOMENTS, Eigen::Dynamic>;
+
+static QString _format(const MomentVector &v)
+{
+    QString s;
+    for (int i = 0; i < v.size(); ++i)
+        s += QString(" %0").arg(v[i]);
+    return s;
+}
+
+OffsetSolution::OffsetSolution(OpenGLScene &scene, ConsoleMessageManager &msg) :
+    msg_(msg), scene_(scene), tcl_{ "./config/offset.config" }, verbose_(false),
+    n_vertices(0), n_edges(0), n_faces(0), n_eigs_(0), moment_tolerance_(0.0),
+    timings_{ 0.0, 0.0, 0.0 }, result_{ 0.0, 0.0, 0, 0, false, false }
+{
+}
+
+OffsetSolution::~OffsetSolution()
+{
+}
+
+bool OffsetSolution::offset()
+{
+    tcl_ = TextConfigLoader{ "./config/offset.config" };
+    verbose_ = tcl_.get_bool("Verbose");
+    timings_ = { 0.0, 0.0, 0.0 };
+    result_ = { 0.0, 0.0, 0, 0, false, false };
+
+    msg_.log("start offset.");
+
+    if (scene_.get("Main") == nullptr || scene_.get("Skeleton") == nullptr)
+    {
+        msg_.log("offset needs \"Main\" and \"Skeleton\".", ERROR_MSG);
+        return false;
+    }
+    auto &mesh = scene_.get("Main")->mesh();
+    if (mesh.vertices_empty())
+    {
+        msg_.log("mesh empty.");
+        return false;
+    }
+    if (scene_.get("Skeleton")->mesh().n_vertices() != mesh.n_vertices())
+    {
+        msg_.log("skeleton does not match the mesh.", ERROR_MSG);
+        return false;
+    }
+
+    n_vertices = mesh.n_vertices();
+    n_edges = mesh.n_edges();
+    n_faces = mesh.n_faces();
+
+    // STEP 1:  The problem, rebuilt only if the shapes or the bounds changed.
+    QElapsedTimer timer;
+    timer.start();
+    bool warm = !Prepare();
+    timings_.ms_prepare = timer.nsecsElapsed() * 1e-6;
+    if (optimizer_ == nullptr)
+        return false;
+
+    // STEP 2:  Optimize, from the last solution if there is one.
+    for (int i = 0; i < 6; ++i)
+        w1_[i] = tcl_.get_value(QString("W1_%0").arg(i + 1));
+    for (int i = 0; i < 4; ++i)
+        w2_[i] = tcl_.get_value(QString("W2_%0").arg(i + 1));
+    rho_ = { tcl_.get_value("Rho_Material"), tcl_.get_value("Rho_Water") };
+    // relative to the size of the mesh.
+    moment_tolerance_ = tcl_.get_value("Moment_Tolerance")
+        * (positions.colwise().maxCoeff() - positions.colwise().minCoeff()).norm();
+
+    OffsetOptimizer::Objective target;
+    if (tcl_.get_int("Method") == 1)
+        target = [this](const VectorXd &a, VectorXd &grad) { return Target_Buoyancy(a, grad); };
+    else
+        target = [this](const VectorXd &a, VectorXd &grad) { return Target_Static(a, grad); };
+
+    OffsetOptimizerOptions options;
+    options.max_iter = tcl_.get_int("Max_Iter");
+
+    const long long recomputed = inner_moments_->recomputed();
+    timer.restart();
+    auto result = optimizer_->minimize(target, a_, options);
+    result_ = result;
+    timings_.ms_optimize = timer.nsecsElapsed() * 1e-6;
+    msg_.log(QString("offset: f %0, violation %1, %2 iterations, %3 evaluations, %4 ms%5")
+        .arg(result.f).arg(result.violation).arg(result.iterations).arg(result.evaluations)
+        .arg(timings_.ms_optimize, 0, 'f', 0).arg(warm ? " (warm)" : ""), INFO_MSG);
+    if (VERBOSE)
+    {
+        MomentVector P;
+        DMatrix DP;
+        Shell_Moments(a_, P, DP);
+        msg_.log("final P_shell:" + _format(P), INFO_MSG);
+        msg_.log("final P_out:  " + _format(P_out), INFO_MSG);
+        msg_.log(QString("triangles recomputed: %0 over %1 evaluations of %2")
+            .arg(inner_moments_->recomputed() - recomputed).arg(result.evaluations).arg(n_faces), INFO_MSG);
+    }
+    if (!result.feasible)
+    {
+        // the shell would break the constraints: leave the mesh as it was.
+        msg_.log("offset: no feasible start, nothing written.", ERROR_MSG);
+        return false;
+    }
+    if (!result.converged)
+        msg_.log("offset: not converged.", ERROR_MSG);
+
+    // STEP 3:  Write Back
+    timer.restart();
+    Write_Back();
+    timings_.ms_write_back = timer.nsecsElapsed() * 1e-6;
+
+    msg_.log("complete offset.");
+    return true;
+}
+
+// Returns true if anything had to be rebuilt.
+bool OffsetSolution::Prepare()
+{
+    auto &mesh = scene_.get("Main")->mesh();
+
+    const Eigen::MatrixX3d old_positions = positions;
+    const Eigen::MatrixX3d old_vector = offset_vector;
+    const VectorXd old_lower = lower_, old_upper = upper_;
+    const int old_eigs = n_eigs_;
+
+    positions.resize(n_vertices, 3);
+    for (int vi = 0; vi < n_vertices; ++vi)
+    {
+        auto p = mesh.point(mesh.vertex_handle(vi));
+        positions.row(vi) = Eigen::Vector3d{ p[0], p[1], p[2] };
+    }
+    Calculate_OffsetVector();
+
+    // lower <= d <= upper: d >= Depth_Bound everywhere with Use_Const_Bound.
+    upper_ = tcl_.get_value("Upper_Bound") * offset_bounds;
+    if (tcl_.get_bool("Use_Const_Bound"))
+        lower_ = VectorXd::Constant(n_vertices, tcl_.get_value("Depth_Bound"));
+    else
+        lower_ = tcl_.get_value("Lower_Bound") * offset_bounds;
+    // a vertex closer to the skeleton than Depth_Bound: keep its box non-empty.
+    upper_ = upper_.cwiseMax(1e-6);
+    lower_ = lower_.cwiseMin(0.5 * upper_);
+    n_eigs_ = std::min(tcl_.get_int("N_Eigs"), n_vertices - 1);
+
+    const bool same_shape = optimizer_ != nullptr && old_positions.rows() == n_vertices
+        && old_positions == positions && old_vector == offset_vector
+        && static_cast<int>(triangles.size()) == n_faces;
+    if (same_shape && n_eigs_ == old_eigs && old_lower == lower_ && old_upper == upper_)
+        return false;
+
+    if (!same_shape || n_eigs_ != old_eigs)
+    {
+        triangles.clear();
+        for (auto fh : mesh.faces())
+        {
+            std::array<int, 3> face_idx;
+            int i = 0;
+            for (auto fvit = mesh.cfv_iter(fh); fvit.is_valid(); ++fvit)
+                face_idx[i++] = fvit->idx();
+            triangles.push_back(face_idx);
+        }
+
+        if (!Calculate_Basis())
+        {
+            optimizer_.reset();
+            return true;
+        }
+
+        // the outer surface does not move: integrated once.
+        outer_moments_.reset(new MassMomentsCache(triangles, offset_vector, -1.0));
+        outer_moments_->update(positions, 0.0);
+        MassMoments out;
+        outer_moments_->moments(out);
+        P_out = out.M;
+        inner_moments_.reset(new MassMomentsCache(triangles, offset_vector));
+        inner_moments_->set_basis(DdDa);
+    }
+
+    // a0 = DdDa \ ((upper - lower) / 2 * bounds), as the script.
+    VectorXd target = 0.5 * (tcl_.get_value("Upper_Bound") - tcl_.get_value("Lower_Bound")) * offset_bounds;
+    a_ = (DdDa.transpose() * DdDa).ldlt().solve(DdDa.transpose() * target);
+    optimizer_.reset(new OffsetOptimizer(DdDa, lower_, upper_));
+    return true;
+}
+
+// Calculate the offset vectors and the bounds.
+void OffsetSolution::Calculate_OffsetVector()
+{
+    auto &mesh = scene_.get("Main")->mesh();
+    auto &skel = scene_.get("Skeleton")->mesh();
+
+    offset_vector.resize(n_vertices, 3);
+    offset_bounds.resize(n_vertices);
+    for (int vi = 0; vi < n_vertices; ++vi)
+    {
+        auto mesh_pos = mesh.point(mesh.vertex_handle(vi));
+        auto skel_pos = skel.point(skel.vertex_handle(vi));
+
+        Eigen::Vector3d delta{ skel_pos[0] - mesh_pos[0], skel_pos[1] - mesh_pos[1], skel_pos[2] - mesh_pos[2] };
+        double length = delta.norm();
+        if (length > 1e-12)
+            delta /= length;
+
+        offset_vector.row(vi) = delta;
+        offset_bounds[vi] = length;
+    }
+}
+
+// DdDa: the lowest manifold harmonics, with the mass where the script's
+// eigs(Lap, n_eigs, 'sm') had none.
+bool OffsetSolution::Calculate_Basis()
+{
+    QElapsedTimer timer;
+    timer.start();
+    auto harmonics = CachedManifoldHarmonics(scene_.get("Main")->mesh(), n_eigs_);
+    if (harmonics == nullptr)
+    {
+        msg_.log("offset: eigen decomposition failed.", ERROR_MSG);
+        return false;
+    }
+    DdDa = harmonics->vectors;
+    msg_.log(QString("offset: %0 harmonics, %1 ms").arg(n_eigs_).arg(timer.elapsed()), INFO_MSG);
+    return true;
+}
+
+// P_shell and its derivative by a, DmDd_shell(:, 1:np) * DdDa; only the
+// triangles whose inner vertices moved beyond Moment_Tolerance (times the
+// bounding box diagonal) are integrated.
+void OffsetSolution::Shell_Moments(const Eigen::VectorXd& a, MomentVector& P, DMatrix& DP)
+{
+    VectorXd d = DdDa * a;
+    inner_ = positions + d.asDiagonal() * offset_vector;
+    inner_moments_->update(inner_, moment_tolerance_);
+
+    MassMoments shell;
+    ProjectedShellMoments(*inner_moments_, *outer_moments_, shell);
+    P = shell.M;
+    DP = shell.DmDd;
+}
+
+// Target1 of Optimize.m: centers of gravity and buoyancy aligned, the shell
+// floating (rho_water V_out = rho V_shell), gravity low.
+double OffsetSolution::Target_Buoyancy(const Eigen::VectorXd& a, Eigen::VectorXd& grad)
+{
+    MomentVector P;
+    DMatrix DP;
+    Shell_Moments(a, P, DP);
+
+    const double ex = P[MOMENT_CX] - P_out[MOMENT_CX];
+    const double ey = P[MOMENT_CY] - P_out[MOMENT_CY];
+    const double balance = rho_[1] * P_out[MOMENT_VOLUME] - rho_[0] * P[MOMENT_VOLUME];
+    const double f0 = P[MOMENT_VOLUME];
+    const double f1x = ex * ex;
+    const double f1y = ey * ey;
+    const double f2 = balance * balance;
+    const double f3 = P_out.segment<3>(MOMENT_CX).squaredNorm();
+    const double f4 = P[MOMENT_CZ];
+
+    grad = w1_[0] * 2.0 * (ex * DP.row(MOMENT_CX) + ey * DP.row(MOMENT_CY)).transpose()
+        - w1_[1] * 2.0 * balance * rho_[0] * DP.row(MOMENT_VOLUME).transpose()
+        + w1_[3] * DP.row(MOMENT_CZ).transpose()
+        + w1_[4] * 2.0 * ey * DP.row(MOMENT_CY).transpose()
+        - w1_[5] * DP.row(MOMENT_VOLUME).transpose();
+    return w1_[0] * (f1x + f1y) + w1_[1] * f2 + w1_[2] * f3 + w1_[3] * f4 + w1_[4] * f1y - w1_[5] * f0;
+}
+
+// Target2 of Optimize.m: center of gravity low and over the origin.
+double OffsetSolution::Target_Static(const Eigen::VectorXd& a, Eigen::VectorXd& grad)
+{
+    MomentVector P;
+    DMatrix DP;
+    Shell_Moments(a, P, DP);
+
+    const double cx = P[MOMENT_CX];
+    const double cy = P[MOMENT_CY];
+
+    grad = w2_[0] * DP.row(MOMENT_VOLUME).transpose()
+        + w2_[1] * DP.row(MOMENT_CZ).transpose()
+        + w2_[2] * 2.0 * (cx * DP.row(MOMENT_CX) + cy * DP.row(MOMENT_CY)).transpose()
+        + w2_[3] * 2.0 * a;
+    return w2_[0] * P[MOMENT_VOLUME] + w2_[1] * P[MOMENT_CZ] + w2_[2] * (cx * cx + cy * cy) + w2_[3] * a.squaredNorm();
+}
+
+void OffsetSolution::Write_Back()
+{
+    VectorXd d = DdDa * a_;
+    if (scene_.get("Inner") != nullptr)
+    {
+        scene_.remove_model("Inner");
+    }
+
+    auto mesh_clone_w = *scene_.get("Main");
+    auto &mesh_clone = mesh_clone_w.mesh();
+    for (int i = 0; i < n_vertices; i++)
+    {
+        Eigen::Vector3d pos = positions.row(i) + d[i] * offset_vector.row(i);
+        mesh_clone.point(mesh_clone.vertex_handle(i)) = {
+            static_cast<float>(pos[0]),
+            static_cast<float>(pos[1]),
+            static_cast<float>(pos[2])
+        };
+    }
+
+    mesh_clone_w.name_ = "Inner";
+    mesh_clone_w.color_ = { 0.3f, 0.6f, 1.0f };
+    scene_.add_model(mesh_clone_w);
+}
@@ -1,55 +1,82 @@
 #pragma once
-//#include "OpenGLScene.h"
-//#include "ConsoleMessageManager.h"
-//#include "TextConfigLoader.h"
-//#include <vector>
-//#include <array>
-//#include <Eigen/Dense>
-//#include <Eigen/Sparse>
-//#include <engine.h>
+#include "OpenGLScene.h"
+#include "ConsoleMessageManager.h"
+#include "TextConfigLoader.h"
+#include "OffsetOptimizer.h"
+#include "MassMoments.h"
+#include <vector>
+#include <array>
+#include <memory>
+#include <Eigen/Dense>
+
+// Inner offset surface of "Main" towards "Skeleton", written to "Inner";
+// script/Offset.m and Optimize.m, in process.
 //
-//using std::vector;
-//using std::array;
-//
-//using Vector3f = Eigen::Vector3f;
-//using std::vector;
-//using SpMat = Eigen::SparseMatrix<float>;
-//using Mat = Eigen::MatrixXf;
-//using Vec = Eigen::VectorXf;
-//using T = Eigen::Triplet<float>;
-//
-//class OffsetSolution
-//{
-//public:
-//    OffsetSolution(OpenGLScene &scene, ConsoleMessageManager &msg) :
-//        msg_(msg), scene_(scene), tcl_{ "./config/offset.config" } {  }
-//    ~OffsetSolution();
-//    void offset();
-//
-//private:
-//    ConsoleMessageManager &msg_;
-//    OpenGLScene &scene_;
-//    TextConfigLoader tcl_;
-//    bool verbose_;
-//
-//    int n_vertices;
-//    int n_edges;
-//    int n_faces;
-//
-//    vector<Vector3f>        positions;
-//    vector<Vector3f>        offset_vector;
-//    vector<float>           offset_bounds;
-//    vector<vector<bool>>    adjacency;
-//    vector<int>             degrees;
-//    vector<vector<int>>     neighbors;
-//    vector<array<int, 3>>   triangles;
-//
-//    float _cotangent_for_angle_AOB(int, int, int);
-//    void Basic_Prepare_and_Calculate_Laplacian(vector<T>& tv_Lap);
-//    void Calculate_OffsetVector();
-//    void Input_Variables_to_Engine(Engine* ep);
-//    void Input_Laplacian_to_Engine(const vector<T> &tv_Lap, Engine* ep);
-//    void Input_Positions_to_Engine(Engine* ep);
-//    void Input_Topology_to_Engine(Engine* ep);
-//    void Input_OffsetVector_to_Engine(Engine* ep);
-//};
+// Vertex i moves d_i along the unit vector to its skeleton point, bounded by
+// that distance; d = DdDa a over the N_Eigs lowest manifold harmonics.
+// The objective on the moments of the shell between the two surfaces
+// (Method 1 buoyancy, 2 static) is minimized over a by OffsetOptimizer.
+// The problem, the last a and the barrier weight are kept: offset() again
+// with only the weights of offset.config changed re-optimizes from there.
+struct OffsetTimings
+{
+    double ms_prepare;              // offset vectors, bounds and the basis.
+    double ms_optimize;
+    double ms_write_back;
+};
+
+class OffsetSolution
+{
+public:
+    OffsetSolution(OpenGLScene &scene, ConsoleMessageManager &msg);
+    ~OffsetSolution();
+    // false if nothing was written back.
+    bool offset();
+
+    // of the last offset().
+    const OffsetTimings &timings() const { return timings_; }
+    const OffsetOptimizerResult &result() const { return result_; }
+
+private:
+    ConsoleMessageManager &msg_;
+    OpenGLScene &scene_;
+    TextConfigLoader tcl_;
+    bool verbose_;
+
+    int n_vertices;
+    int n_edges;
+    int n_faces;
+
+    Eigen::MatrixX3d                positions;
+    Eigen::MatrixX3d                offset_vector;
+    Eigen::VectorXd                 offset_bounds;
+    std::vector<std::array<int, 3>> triangles;
+    int                             n_eigs_;
+    Eigen::MatrixXd                 DdDa;
+    Eigen::VectorXd                 lower_, upper_;
+
+    // the inner surface of the last evaluation; the shell is it and "Main".
+    Eigen::MatrixX3d                inner_;
+    MomentVector                    P_out;
+    std::unique_ptr<MassMomentsCache> inner_moments_;
+    std::unique_ptr<MassMomentsCache> outer_moments_;
+    double                          moment_tolerance_;
+
+    std::unique_ptr<OffsetOptimizer> optimizer_;
+    Eigen::VectorXd                 a_;
+
+    std::array<double, 6>           w1_;
+    std::array<double, 4>           w2_;
+    std::array<double, 2>           rho_;   // material, water.
+
+    OffsetTimings                   timings_;
+    OffsetOptimizerResult           result_;
+
+    bool Prepare();
+    void Calculate_OffsetVector();
+    bool Calculate_Basis();
+    void Shell_Moments(const Eigen::VectorXd &a, MomentVector &P, Eigen::Matrix<double, N_MOMENTS, Eigen::Dynamic> &DP);
+    double Target_Buoyancy(const Eigen::VectorXd &a, Eigen::VectorXd &grad);
+    double Target_Static(const Eigen::VectorXd &a, Eigen::VectorXd &grad);
+    void Write_Back();
+};
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "OpenGLMesh.h"
 #include "OpenGLScene.h"
+#include "TetraReorder.h"
 
 using OpenMesh::Vec3f;
 
@@ -23,6 +24,7 @@ Vec3f trans_coord(Vec3f &p)
 void OpenGLMesh::init()
 {
     mesh_.request_vertex_normals();
+    bvh_.bvh.reset();
 
     OpenMesh::IO::Options opt;
     QString mesh_file_name = file_location_ + file_name_ + mesh_extension_;
@@ -32,13 +34,6 @@ void OpenGLMesh::init()
     }
     // try find tetrahedralization.
     QString tetra_name = file_location_ + "tetra/" + file_name_;
-    //if (!_FileExists(tetra_name + TETRA_ELE_EXTENSION) && NEED_TETRA)
-    //{
-    //    TriMesh temp_mesh = this->mesh_;
-    //    mesh_unify(1.0, true, temp_mesh); // unify to 1.0 before tetra().
-    //    TetrahedralizationSolution ts{ temp_mesh, (tetra_name).toStdString() };
-    //    ts.tetra();
-    //}
 
     if (mesh_file_name.contains("coodtr"))
     {
@@ -65,15 +60,53 @@ void OpenGLMesh::init()
         ////mesh_.release_face_normals();
     }
 
-    if (NEED_TETRA)
+    // no tetra/ files: from the cache, or TetGen on a worker thread while
+    // the rest of the scene loads, read in finish_tetra().
+    if (NEED_TETRA && show_tetra_ && !_FileExists(tetra_name + ".ele"))
+    {
+        TriMesh unified = mesh_;
+        mesh_unify(1.0, true, unified); // unify to 1.0 before tetra().
+        tetra_job_ = CachedTetrahedralization(unified, TETRA_SWITCHES);
+    }
+    else if (NEED_TETRA)
         ReadTetra(tetra_name);
 
     update();
 }
 
+void OpenGLMesh::finish_tetra()
+{
+    if (!tetra_job_.valid())
+        return;
+    QString tetra_name = tetra_job_.get();
+    tetra_job_ = std::shared_future<QString>();
+    if (tetra_name.isEmpty())
+    {
+        std::cerr << "Error tetrahedralizing " << name_.toStdString() << std::endl;
+        return;
+    }
+    ReadTetra(tetra_name);
+    update();
+    tag_change();
+}
+
 void OpenGLMesh::tag_change()
 {
     changed_ = true;
+    bvh_.stale = true;
+}
+
+const MeshBVH& OpenGLMesh::bvh()
+{
+    if (bvh_.bvh == nullptr)
+    {
+        bvh_.bvh = std::make_shared<MeshBVH>();
+        bvh_.bvh->build(mesh_);
+    }
+    else if (bvh_.stale)
+        bvh_.bvh->refit(mesh_);
+    bvh_.stale = false;
+    return *bvh_.bvh;
 }
 
 Vec3f qvec2vec3f(const QVector3D &qc)
@@ -113,6 +146,10 @@ OpenGLMesh::OpenGLMesh(const OpenGLMesh& rhs)
     use_face_normal_ = rhs.use_face_normal_;
     show_tetra_ = rhs.show_tetra_;
     scale_ = rhs.scale_;
+    density_ = rhs.density_;
+    stiffness_ = rhs.stiffness_;
+    embed_in_ = rhs.embed_in_;
+    hidden_ = rhs.hidden_;
     center_ = rhs.center_;
     max_point = rhs.max_point;
     min_point = rhs.min_point;
@@ -155,6 +192,11 @@ void OpenGLMesh::update()
 {
     vbuffer.clear();
     ebuffer.clear();
+    if (hidden_)
+    {
+        changed_ = true;
+        return;
+    }
     //mesh_.update_normals();
     int i = 0;
     if (show_tetra_)
@@ -578,4 +620,7 @@ void OpenGLMesh::ReadTetra(const QString& name)
         input_ele.close();
     }
 
+    if (TETRA_REORDER)
+        ReorderTetra(tetra_);
+
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "OpenMeshBasic.h"
 #include "TetrahedralizationSolution.h"
+#include "MeshBVH.h"
 #include "GlobalConfig.h"
 #include <QString>
 #include <memory>
@@ -25,10 +26,10 @@ using OpenMesh::VertexHandle;
 struct TetraMesh
 {
 public:
-    int n_vertices;
-    int n_vertices_boundary;
-    int n_faces;
-    int n_tetras;
+    int n_vertices = 0;
+    int n_vertices_boundary = 0;
+    int n_faces = 0;
+    int n_tetras = 0;
     std::vector<OpenMesh::Vec3f> point; // boundary vertices before internal ones.
     std::vector<std::array<int, 3>> face_vertices;
     std::vector<std::array<int, 4>> tetra_vertices;
@@ -53,6 +54,18 @@ public:
     }
 };
 
+// The BVH of one mesh: a copied or assigned mesh starts without one and
+// builds its own, two meshes never refit the same tree.
+struct MeshBVHCache
+{
+    std::shared_ptr<MeshBVH> bvh;
+    bool stale = false;
+
+    MeshBVHCache() = default;
+    MeshBVHCache(const MeshBVHCache &) {  }
+    MeshBVHCache &operator=(const MeshBVHCache &) { bvh.reset(); stale = true; return *this; }
+};
+
 class OpenGLMesh
 {
 public:
@@ -61,12 +74,17 @@ public:
     ~OpenGLMesh();
     void update();
     void init();
+    // wait for the tetrahedralization init() started, if any, and read it.
+    void finish_tetra();
     void tag_change();
     void set_point(int idx, QVector3D p);
     void slice(const LayerConfig &slice_config);
     bool slice_no_in_show_area(float x, float y, float z);
     TriMesh &mesh() { return mesh_; }
     TetraMesh &tmesh() { return tetra_; }
+    // of mesh(), without position_: built on first use, refit after
+    // tag_change(); set_point() leaves that to the caller, once after its loop.
+    const MeshBVH &bvh();
     bool changed(); 
 
     std::vector<GLfloat> vbuffer;
@@ -82,6 +100,10 @@ public:
     bool use_face_normal_;
     bool show_tetra_;
     float scale_;
+    float density_ = 0.0f;          // for simulators, 0 for their default.
+    float stiffness_ = 1.0f;        // for simulators, multiplier of their stiffness.
+    QString embed_in_;              // cage model whose tetra mesh drives this surface.
+    bool hidden_ = false;           // simulated but not rendered, e.g. a cage.
     QVector3D center_;
     QVector3D max_point;
     QVector3D min_point;
@@ -104,6 +126,8 @@ private:
 
     void ReadTetra(const QString &name);
     TetraMesh tetra_;
+    std::shared_future<QString> tetra_job_;
+    MeshBVHCache bvh_;
     LayerConfig slice_config_;
 };
 
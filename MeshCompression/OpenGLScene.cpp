@@ -179,6 +179,10 @@ bool OpenGLScene::BuildFromJson()
         model->use_face_normal_ = model_jobj["UseFaceNormal"].toBool();
         model->show_tetra_ = model_jobj["ShowTetra"].toBool() & NEED_TETRA;
         model->scale_ = model_jobj["Scale"].toDouble();
+        model->density_ = model_jobj["Density"].toDouble(0.0);
+        model->stiffness_ = model_jobj["Stiffness"].toDouble(1.0);
+        model->embed_in_ = model_jobj["EmbedIn"].toString();
+        model->hidden_ = model_jobj["Hidden"].toBool();
         model->file_location_ = file_location_;
         model->file_name_ = model_jobj["FileName"].toString();
         model->mesh_extension_ = model_jobj["MeshExtension"].toString();
@@ -190,6 +194,14 @@ bool OpenGLScene::BuildFromJson()
         msg_.log("Read mesh:\t", model->name_, INFO_MSG);
     }
 
+    // tetrahedralizations started by init(), all running at once.
+    for (auto model : models_)
+    {
+        model->finish_tetra();
+        if (model->show_tetra_ && model->tmesh().n_tetras == 0)
+            msg_.log("no tetra mesh:\t", model->name_, ERROR_MSG);
+    }
+
     msg_.log("", INFO_MSG);
     msg_.reset_indent();
     return true;
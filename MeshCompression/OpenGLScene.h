@@ -26,6 +26,7 @@ public:
     void slice(const LayerConfig &slice_config);// { slice_config_ = slice_config; }
     std::shared_ptr<OpenGLMesh> get(const QString &model_name) const;
     std::shared_ptr<OpenGLMesh> get_by_tag(const QString &tag) const;
+    const std::vector<std::shared_ptr<OpenGLMesh>> &models() const { return models_; }
 
     std::vector<GLfloat> vbuffer;
     std::vector<GLuint> ebuffer;
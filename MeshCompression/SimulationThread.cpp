@@ -0,0 +1,43 @@
+#include "stdafx.h"
+#include "SimulationThread.h"
+
+void SimulationThread::stop()
+{
+    stop_ = true;
+    wait();
+}
+
+void SimulationThread::run()
+{
+    QElapsedTimer wall;
+    wall.start();
+    double sim_time = 0.0;
+    while (!stop_)
+    {
+        if (stepper_ != nullptr)
+        {
+            stepper_->advance(substeps_ * dt_);
+            steps_ = stepper_->accepted();
+        }
+        else
+        {
+            for (int i = 0; i < substeps_; ++i)
+                sim_->step(dt_);
+            steps_ += substeps_;
+        }
+        sim_time += substeps_ * dt_;
+
+        // copy into the back frame, its capacity is reused from the last time.
+        auto &frame = frames_.back();
+        frame.t = sim_->get_time();
+        frame.position = sim_->get_position();
+        frames_.publish();
+
+        if (realtime_)
+        {
+            double ahead = sim_time - wall.nsecsElapsed() * 1e-9;
+            if (ahead > 0.0)
+                usleep(static_cast<unsigned long>(ahead * 1e6));
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "SimulatorBase.h"
+#include "AdaptiveStepper.h"
+#include <QThread>
+#include <atomic>
+
+// One published state of the simulator.
+struct SimFrame
+{
+    double t;
+    std::vector<Vector3f> position;
+};
+
+// Lock-free triple buffer, one writer and one reader.
+// The writer fills back() and publish()es it, the reader consume()s the
+// latest published frame into front(). Neither side ever waits, frames the
+// reader is too slow for are dropped.
+class SimFrameBuffer
+{
+public:
+    SimFrameBuffer() : back_(0), middle_(1), front_(2) {  }
+    SimFrame &back() { return frames_[back_]; }
+    const SimFrame &front() const { return frames_[front_]; }
+    void publish() { back_ = middle_.exchange(back_ | DIRTY) & INDEX; }
+    bool consume()
+    {
+        if (!(middle_.load() & DIRTY))
+            return false;
+        front_ = middle_.exchange(front_) & INDEX;
+        return true;
+    }
+
+private:
+    static const int INDEX = 3;
+    static const int DIRTY = 4;
+
+    SimFrame frames_[3];
+    int back_;                      // writer only.
+    std::atomic<int> middle_;       // index of the shared one, and whether it is new.
+    int front_;                     // reader only.
+};
+
+// Runs a simulator on its own thread with a fixed time step,
+// publishing a frame every `substeps` steps.
+// With a stepper, a frame covers the same `substeps * dt`, in steps chosen
+// by the stepper.
+// If `realtime` is set, the simulated time does not run ahead of the wall clock.
+class SimulationThread : public QThread
+{
+public:
+    SimulationThread(SimulatorBase *sim, double dt, int substeps, bool realtime,
+        AdaptiveStepper *stepper = nullptr) :
+        sim_(sim), dt_(dt), substeps_(substeps), realtime_(realtime), stop_(false), steps_(0),
+        stepper_(stepper) {  }
+    ~SimulationThread() override { stop(); }
+    void stop();
+    SimFrameBuffer &frames() { return frames_; }
+    long long steps() const { return steps_.load(); }
+    // valid after stop().
+    const AdaptiveStepper *stepper() const { return stepper_.get(); }
+
+protected:
+    void run() override;
+
+private:
+    SimulatorBase *sim_;
+    double dt_;
+    int substeps_;
+    bool realtime_;
+    std::atomic<bool> stop_;
+    std::atomic<long long> steps_;
+    SimFrameBuffer frames_;
+    std::unique_ptr<AdaptiveStepper> stepper_;
+};
@@ -1,9 +1,13 @@
 #include "stdafx.h"
 #include "SimulatorBase.h"
+#include "TextConfigLoader.h"
+#include <QFile>
+#include <cstring>
 
 void SimulatorBase::init(const double& time)
 {
     init_time_ = last_time_ = time;
+    step_count_ = 0;
 
     init_ok_ = true;
 }
@@ -18,21 +22,121 @@ void SimulatorBase::simulate(const double& time)
     simulate_util();
     simulate_rebuild();
     last_time_ = curr_time_;
+    ++step_count_;
 }
 
-void SimulatorBase::simulate_util()
+void SimulatorBase::step(const double& step_dt)
 {
-    //auto ball = scene_.get("Ball");
-    //for (auto v : ball->mesh().vertices())
-    //{
-    //    auto &mesh = ball->mesh();
-    //    auto pos = mesh.point(v);
-    //    ball->mesh().set_point(v, pos * 1.002);
-    //}
-    //ball->update();
+    if (!init_ok_)
+        return;
+    curr_time_ = last_time_ + step_dt;
+    t = curr_time_ - init_time_;
+    dt = step_dt;
+    simulate_util();
+    last_time_ = curr_time_;
+    ++step_count_;
 }
 
-void SimulatorBase::simulate_rebuild()
+void SimulatorBase::get_state(SimState& s) const
+{
+    s.t = last_time_ - init_time_;
+    s.position = position;
+    s.velocity = velocity;
+}
+
+void SimulatorBase::set_state(const SimState& s)
+{
+    position = s.position;
+    velocity = s.velocity;
+    last_time_ = init_time_ + s.t;
+    t = s.t;
+    state_restored();
+}
+
+struct SimCheckpointHeader
+{
+    char magic[4];                  // "CKP1"
+    qint32 n_vertices;
+    double t;                       // since init(), as last_time_ - init_time_.
+    qint64 step_count;
+    qint64 extra_size;
+};
+
+bool SimulatorBase::save_checkpoint(const QString& filename) const
+{
+    QFile file(filename);
+    if (!init_ok_ || !file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    std::vector<char> extra;
+    save_extra(extra);
+    SimCheckpointHeader header;
+    std::memcpy(header.magic, "CKP1", 4);
+    header.n_vertices = static_cast<qint32>(position.size());
+    header.t = last_time_ - init_time_;
+    header.step_count = step_count_;
+    header.extra_size = static_cast<qint64>(extra.size());
+    const qint64 bytes = static_cast<qint64>(position.size()) * sizeof(Vector3f);
+    qint64 written = file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    written += file.write(reinterpret_cast<const char *>(position.data()), bytes);
+    written += file.write(reinterpret_cast<const char *>(velocity.data()), bytes);
+    written += file.write(extra.data(), header.extra_size);
+    return written == static_cast<qint64>(sizeof(header)) + 2 * bytes + header.extra_size;
+}
+
+bool SimulatorBase::load_checkpoint(const QString& filename)
+{
+    QFile file(filename);
+    if (!init_ok_ || !file.open(QIODevice::ReadOnly))
+        return false;
+    SimCheckpointHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, "CKP1", 4) != 0
+        || header.n_vertices != static_cast<qint32>(position.size())
+        || header.extra_size < 0)
+        return false;
+    const qint64 bytes = static_cast<qint64>(position.size()) * sizeof(Vector3f);
+    std::vector<Vector3f> p(position.size());
+    std::vector<Vector3f> v(velocity.size());
+    std::vector<char> extra(static_cast<size_t>(header.extra_size));
+    if (file.read(reinterpret_cast<char *>(p.data()), bytes) != bytes
+        || file.read(reinterpret_cast<char *>(v.data()), bytes) != bytes
+        || file.read(extra.data(), header.extra_size) != header.extra_size)
+        return false;
+
+    // vertices first, the simulator's own state may depend on them.
+    SimState s;
+    s.t = header.t;
+    s.position = std::move(p);
+    s.velocity = std::move(v);
+    SimState before;
+    get_state(before);
+    set_state(s);
+    if (!load_extra(extra.data(), extra.size()))
+    {
+        set_state(before);
+        return false;
+    }
+    step_count_ = header.step_count;
+    return true;
+}
+
+void _set_deterministic(bool deterministic)
+{
+    Eigen::setNbThreads(deterministic ? 1 : 0);
+}
+
+double SimulatorBase::energy() const
+{
+    double e = potential_energy();
+    for (size_t vi = 0; vi < masses.size() && vi < position.size(); ++vi)
+    {
+        e += 0.5 * masses[vi] * velocity[vi].squaredNorm();
+        e += masses[vi] * 9.8 * position[vi][2];
+    }
+    return e;
+}
+
+void SimulatorBase::simulate_util()
 {
     //auto ball = scene_.get("Ball");
     //for (auto v : ball->mesh().vertices())
@@ -72,6 +176,185 @@ T2 vec_cast(const T1 &v)
     return{ v[0], v[1], v[2] };
 }
 
+// write the simulated positions back to the model,
+// boundary vertices also go to the surface mesh for rendering.
+void SimulatorBase::simulate_rebuild()
+{
+    apply_position(position);
+}
+
+void SimulatorBase::apply_position(const std::vector<Vector3f>& p)
+{
+    _apply_position(bodies, p);
+}
+
+std::vector<SimBody> _gather_bodies(const OpenGLScene& scene)
+{
+    std::vector<SimBody> bodies;
+    int vertex_offset = 0;
+    int tetra_offset = 0;
+    for (auto &model : scene.models())
+    {
+        if (!model->show_tetra_ || model->name_ == "Ground" || !model->embed_in_.isEmpty()
+            || model->tmesh().n_tetras <= 0)
+            continue;
+        SimBody body;
+        body.model = model;
+        body.vertex_offset = vertex_offset;
+        body.tetra_offset = tetra_offset;
+        body.density = model->density_;
+        body.stiffness = model->stiffness_ > 0.0f ? model->stiffness_ : 1.0f;
+        bodies.push_back(body);
+        vertex_offset += model->tmesh().n_vertices;
+        tetra_offset += model->tmesh().n_tetras;
+    }
+    for (auto &model : scene.models())
+    {
+        if (model->embed_in_.isEmpty())
+            continue;
+        for (auto &body : bodies)
+        {
+            if (body.model->name_ != model->embed_in_)
+                continue;
+            auto e = std::make_shared<EmbeddedSurface>();
+            e->model = model;
+            BindEmbeddedSurface(*e, body.model->tmesh());
+            body.embedded.push_back(e);
+            break;
+        }
+    }
+    return bodies;
+}
+
+void _apply_position(const std::vector<SimBody>& bodies, const std::vector<Vector3f>& p)
+{
+    for (auto &body : bodies)
+    {
+        auto &model = *body.model;
+        auto &tmesh = model.tmesh();
+        if (static_cast<int>(p.size()) < body.vertex_offset + tmesh.n_vertices)
+            return;
+        for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        {
+            const Vector3f &x = p[body.vertex_offset + vi];
+            if (vi < tmesh.n_vertices_boundary)
+            {
+                model.set_point(vi, vec_cast<Vector3f, QVector3D>(x));
+            }
+            tmesh.point[vi] = vec_cast<Eigen::Vector3f, OpenMesh::Vec3f>(x);
+        }
+        model.tag_change();
+        model.update();
+        for (auto &e : body.embedded)
+            SkinEmbeddedSurface(*e, tmesh, p, body.vertex_offset);
+    }
+}
+
+bool SimulatorBase::init_bodies(float default_density)
+{
+    bodies = _gather_bodies(scene_);
+    tmesh_all = TetraMesh();
+    tmesh_all.n_vertices = 0;
+    tmesh_all.n_vertices_boundary = 0;  // per body, see bodies[].model.
+    tmesh_all.n_faces = 0;
+    tmesh_all.n_tetras = 0;
+    tetra_density.clear();
+    tetra_stiffness.clear();
+    for (auto &body : bodies)
+    {
+        auto &tmesh = body.model->tmesh();
+        for (auto p : tmesh.point)
+            tmesh_all.point.push_back(p);
+        for (auto fvs : tmesh.face_vertices)
+        {
+            for (auto &v : fvs)
+                v += body.vertex_offset;
+            tmesh_all.face_vertices.push_back(fvs);
+        }
+        for (auto tvs : tmesh.tetra_vertices)
+        {
+            for (auto &v : tvs)
+                v += body.vertex_offset;
+            tmesh_all.tetra_vertices.push_back(tvs);
+            tetra_density.push_back(body.density > 0.0f ? body.density : default_density);
+            tetra_stiffness.push_back(body.stiffness);
+        }
+        tmesh_all.n_vertices += tmesh.n_vertices;
+        tmesh_all.n_faces += tmesh.n_faces;
+        tmesh_all.n_tetras += tmesh.n_tetras;
+    }
+
+    position.clear();
+    for (int i = 0; i < tmesh_all.n_vertices; ++i)
+    {
+        position.push_back(vec_cast<OpenMesh::Vec3f, Eigen::Vector3f>(tmesh_all.point[i]));
+    }
+    velocity = std::vector<Vector3f>(tmesh_all.n_vertices, { 0,0,0 });
+
+    // vertex -> (tetra, corner), so the gather needs no atomics.
+    tetra_force = std::vector<std::array<Vector3f, 4>>(tmesh_all.n_tetras);
+    vert_tetra_begin = std::vector<int>(tmesh_all.n_vertices + 1, 0);
+    for (int ti = 0; ti < tmesh_all.n_tetras; ++ti)
+        for (int j = 0; j < 4; ++j)
+            ++vert_tetra_begin[tmesh_all.tetra_vertices[ti][j] + 1];
+    for (int vi = 0; vi < tmesh_all.n_vertices; ++vi)
+        vert_tetra_begin[vi + 1] += vert_tetra_begin[vi];
+    vert_tetra = std::vector<int>(4 * tmesh_all.n_tetras);
+    std::vector<int> fill(vert_tetra_begin.begin(), vert_tetra_begin.end() - 1);
+    for (int ti = 0; ti < tmesh_all.n_tetras; ++ti)
+        for (int j = 0; j < 4; ++j)
+            vert_tetra[fill[tmesh_all.tetra_vertices[ti][j]]++] = 4 * ti + j;
+
+    TextConfigLoader tcl{ "./config/simulator.config" };
+    collision_enabled_ = tcl.get_bool("Collision_Enable");
+    collision_stiffness_ = tcl.get_value("Collision_Stiffness");
+    contacts.clear();
+    if (collision_enabled_)
+        collision.init(tmesh_all, tcl.get_value("Collision_Thickness"), tcl.get_value("Collision_Cell_Scale"));
+    ccd_enabled_ = tcl.get_bool("CCD_Enable");
+    n_impacts_ = 0;
+    if (ccd_enabled_)
+        ccd.init(tmesh_all, tcl.get_value("Collision_Cell_Scale"), tcl.get_value("CCD_Safety"), tcl.get_value("CCD_Restitution"),
+            tcl.get_int("CCD_Passes"));
+    return !bodies.empty();
+}
+
+void SimulatorBase::gather_tetra_force(std::vector<Vector3f>& force) const
+{
+#pragma omp parallel for
+    for (int vi = 0; vi < tmesh_all.n_vertices; ++vi)
+        for (int i = vert_tetra_begin[vi]; i < vert_tetra_begin[vi + 1]; ++i)
+            force[vi] += tetra_force[vert_tetra[i] / 4][vert_tetra[i] % 4];
+}
+
+void SimulatorBase::collide_penalty(const std::vector<Vector3f>& x, std::vector<Vector3f>& force)
+{
+    if (!collision_enabled_ || collision.empty())
+        return;
+    collision.build(x);
+    collision.detect(x, contacts);
+    ApplyContactPenalty(tmesh_all, contacts, collision_stiffness_, force);
+}
+
+void SimulatorBase::resolve_ccd(const std::vector<Vector3f>& x_start, double h)
+{
+    if (!ccd_enabled_ || ccd.empty() || x_start.size() != position.size())
+        return;
+    n_impacts_ = ccd.resolve(x_start, position, velocity, masses, static_cast<float>(h));
+}
+
+void SimulatorBase::collide_project(std::vector<Vector3f>& x)
+{
+    if (!collision_enabled_ || collision.empty())
+        return;
+    std::vector<float> inv_masses(masses.size(), 0.0f);
+    for (size_t vi = 0; vi < masses.size(); ++vi)
+        inv_masses[vi] = masses[vi] > 0.0f ? 1.0f / masses[vi] : 0.0f;
+    collision.build(x);
+    collision.detect(x, contacts);
+    ProjectContacts(tmesh_all, contacts, collision.thickness(), inv_masses, x);
+}
+
 //// some old vector cast functions.
 //Vector3f qv_to_ev(const QVector3D &v)
 //{
@@ -97,27 +380,22 @@ void SimulatorSimpleSpring::init(const double& t)
 {
     SimulatorBase::init(t);
 
-    // Find a object called "Ball" in the scene.
-    ball = scene_.get("Ball");
-
-    if (ball == nullptr)
+    // All tetra bodies of the scene.
+    if (!init_bodies(1000.0f))
     {
         init_ok_ = false;
         return;
     }
 
-    auto &tmesh = ball->tmesh();
+    auto &tmesh = tmesh_all;
     // Clone original Tetra Mesh
-    tmesh_originial = ball->tmesh().copy();
+    tmesh_originial = tmesh_all.copy();
 
     velocity = std::vector<Vector3f>(tmesh.n_vertices, { 0,0,-10 });
+    masses = std::vector<float>(tmesh.n_vertices, 1.0f);
     vert_volume = std::vector<float>(tmesh.n_vertices, 0.0f);
     tetra_volume = std::vector<float>(tmesh.n_tetras, 0.0f);
 
-    for (int i = 0; i < tmesh.n_vertices; ++i)
-    {
-        position.push_back(vec_cast<OpenMesh::Vec3f, Eigen::Vector3f>(tmesh.point[i]));
-    }
     position_original = position;
 
     for (int i = 0; i < tmesh.n_tetras; ++i)
@@ -133,78 +411,65 @@ void SimulatorSimpleSpring::init(const double& t)
     }
 }
 
-void SimulatorSimpleSpring::simulate_util()
+void SimulatorSimpleSpring::spring_force(const std::vector<Vector3f>& x, std::vector<Vector3f>& force)
 {
-    const float density = 1000.0f; // \ro: 1000 kg/m^3, water like.
     const Vector3f g{ 0.0f, 0.0f, -9.8f }; // g: jyokuryo kassodoku.
     const float k = 200000.0f; // k;
-    const float mu = 0.03f; // mu;
-    auto &tmesh = ball->tmesh();
-    std::vector<Vector3f> force(tmesh.n_vertices, { 0,0,0 });
-    std::vector<float> masses(tmesh.n_vertices);
-    // for all vertices:
-    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
-    {
-        // STEP 1:  Apply external forces.
-        float m = density * vert_volume[vi];   // mass of the vertex, derived from volume.
-        // UNIFY MASS
-        m = 1.0f;
-
-        // STEP 1.1 Gravity.
-        Vector3f f_g = m * g;
-
-        // STEP 1.2 Collision force.
-        // Not here,
-        // we do a force balance after elastic force has been calculated.
-
-        force[vi] += f_g;
-        masses[vi] = m;
-    }
+    auto &tmesh = tmesh_all;
     // for all tetras:
+#pragma omp parallel for
     for (int ti = 0; ti < tmesh.n_tetras; ++ti)
     {
         // STEP 2:  Apply elastic force.
         auto tvs = tmesh.tetra_vertices[ti]; // contain indices
         std::array<Vector3f, 4> p;
-        p[0] = position[tvs[0]];
-        p[1] = position[tvs[1]];
-        p[2] = position[tvs[2]];
-        p[3] = position[tvs[3]];
+        p[0] = x[tvs[0]];
+        p[1] = x[tvs[1]];
+        p[2] = x[tvs[2]];
+        p[3] = x[tvs[3]];
         std::array<Vector3f, 4> p_ori;
         p_ori[0] = position_original[tvs[0]];
         p_ori[1] = position_original[tvs[1]];
         p_ori[2] = position_original[tvs[2]];
         p_ori[3] = position_original[tvs[3]];
 
+        auto &f = tetra_force[ti];
+        f.fill({ 0,0,0 });
         int edge_idxs[6][2] = { {0,1}, {0,2}, {0,3}, {1,2}, {1,3}, {2,3} };
         for (int ei = 0; ei < 6; ++ei)
         {
             int i1 = edge_idxs[ei][0], i2 = edge_idxs[ei][1];
             Vector3f l = p[i1] - p[i2];
             Vector3f l_ori = p_ori[i1] - p_ori[i2];
-            float delta = l.norm() - l_ori.norm();
-            if (abs(delta) > l_ori.norm() * 0.5f)
-                delta = delta * 3.0f;
-            float force_value = k * (l.norm() - l_ori.norm()); // positive->compressed; negative->stressed
-            force[tvs[i1]] += force_value * -l.normalized();
-            force[tvs[i2]] += force_value * l.normalized();
+            float force_value = tetra_stiffness[ti] * k * (l.norm() - l_ori.norm()); // positive->compressed; negative->stressed
+            f[i1] += force_value * -l.normalized();
+            f[i2] += force_value * l.normalized();
         }
     }
-    // Balance
+    // for all vertices: gravity, the springs of its tetras, and the balance.
+#pragma omp parallel for
     for (int vi = 0; vi < tmesh.n_vertices; ++vi)
     {
-        // if (position[vi][2] <= 0.0f && position[vi][1] <= 0.25f / 0.33f)
-        if (position[vi][2] <= 0.0f)
-        {
-            force[vi][2] += -position[vi][2] * k * 10.0f;
-        }
-    }
-    // Calm
-    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
-    {
-        //force[vi] += -velocity[vi] * velocity[vi].norm() * mu;
+        force[vi] += masses[vi] * g;
+        if (x[vi][2] <= 0.0f)
+            force[vi][2] += -x[vi][2] * k * 10.0f;
     }
+    gather_tetra_force(force);
+    collide_penalty(x, force);
+}
+
+void SimulatorSimpleSpring::simulate_util()
+{
+    auto &tmesh = tmesh_all;
+    std::vector<Vector3f> force(tmesh.n_vertices, { 0,0,0 });
+    // STEP 1:  Forces, masses are unified to 1 in init().
+    spring_force(position, force);
+
+    std::vector<Vector3f> x_start;
+    if (ccd_enabled_)
+        x_start = position;
     // update velocity and position
+#pragma omp parallel for
     for (int vi = 0; vi < tmesh.n_vertices; ++vi)
     {
         // v_i += f_i * dt / m_i
@@ -212,23 +477,33 @@ void SimulatorSimpleSpring::simulate_util()
         // p_i += v_i * dt
         position[vi] = position[vi] + dt * velocity[vi];
     }
+    resolve_ccd(x_start, dt);
 }
 
-void SimulatorSimpleSpring::simulate_rebuild()
+// springs on the tetra edges, and the ground penalty.
+double SimulatorSimpleSpring::potential_energy() const
 {
-    auto &tmesh = ball->tmesh();
-    auto &mesh = ball->mesh();
-    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+    const float k = 200000.0f; // k;
+    auto &tmesh = tmesh_all;
+    double e = 0.0;
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
     {
-        if (vi < tmesh.n_vertices_boundary)
+        auto tvs = tmesh.tetra_vertices[ti];
+        int edge_idxs[6][2] = { {0,1}, {0,2}, {0,3}, {1,2}, {1,3}, {2,3} };
+        for (int ei = 0; ei < 6; ++ei)
         {
-            ball->set_point(vi, vec_cast<Vector3f, QVector3D>(position[vi]));
-            //ball->set_point(vi, ev_to_qv(position[vi]));
+            int i1 = tvs[edge_idxs[ei][0]], i2 = tvs[edge_idxs[ei][1]];
+            float delta = (position[i1] - position[i2]).norm()
+                - (position_original[i1] - position_original[i2]).norm();
+            e += 0.5 * tetra_stiffness[ti] * k * delta * delta;
         }
-        tmesh.point[vi] = vec_cast<Eigen::Vector3f, OpenMesh::Vec3f>(position[vi]);
     }
-    ball->update();
-    //position_original = position;
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+    {
+        if (position[vi][2] <= 0.0f)
+            e += 0.5 * k * 10.0f * position[vi][2] * position[vi][2];
+    }
+    return e;
 }
 
 /*
@@ -239,22 +514,16 @@ void SimulatorSimpleSpring::simulate_rebuild()
 void SimulatorSimpleFED::init(const double& t)
 {
     SimulatorBase::init(t);
-    ball = scene_.get("Ball");
-    ground = scene_.get("Ground");
-    if (ball == nullptr || ground == nullptr)
+    if (!init_bodies(1000.0f))
     {
         init_ok_ = false;
         return;
     }
-    auto &tmesh = ball->tmesh();
-    velocity = std::vector<Vector3f>(tmesh.n_vertices, { 0,0,0 });
+    auto &tmesh = tmesh_all;
     vert_volume = std::vector<float>(tmesh.n_vertices, 0.0f);
     tetra_volume = std::vector<float>(tmesh.n_tetras, 0.0f);
-    //position = std::vector<Vector3f>(tmesh.n_vertices, { 0,0,0 });
-    for (int i = 0; i < tmesh.n_vertices; ++i)
-    {
-        position.push_back(vec_cast<OpenMesh::Vec3f, Eigen::Vector3f>(tmesh.point[i]));
-    }
+    masses = std::vector<float>(tmesh.n_vertices, 0.0f);
+    X_bar.clear();
     for (int i = 0; i < tmesh.n_tetras; ++i)
     {
         auto tvs = tmesh.tetra_vertices[i];
@@ -264,7 +533,10 @@ void SimulatorSimpleFED::init(const double& t)
         auto d = position[tvs[3]];
         tetra_volume[i] = _tetra_volume(a, b, c, d);
         for (int j = 0; j < 4; ++j)
+        {
             vert_volume[tvs[j]] += tetra_volume[i] * 0.25f;
+            masses[tvs[j]] += tetra_density[i] * tetra_volume[i] * 0.25f;
+        }
         Vector3f x_1 = (b - a);
         Vector3f x_2 = (c - a);
         Vector3f x_3 = (d - a);
@@ -278,35 +550,16 @@ void SimulatorSimpleFED::init(const double& t)
 
 void SimulatorSimpleFED::simulate_util()
 {
-    const float density = 1000.0f; // \ro: 1000 kg/m^3, water like.
     const Vector3f g{ 0.0f, 0.0f, -9.8f }; // g: jyokure kassodoku.
     const float E = 0.001e9f; // E: Young’s modulus (G Pascal)
     // 0.001-0.1 ~ rubber
     // 10        ~ wood
     // 100       ~ medal
     // 1000      ~ diamond
-    auto &tmesh = ball->tmesh();
+    auto &tmesh = tmesh_all;
     std::vector<Vector3f> force(tmesh.n_vertices, {0,0,0});
-    std::vector<float> masses(tmesh.n_vertices);
-    // for all vertices:
-    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
-    {
-        // STEP 1:  Apply external forces.
-        float m = density * vert_volume[vi];   // mass of the vertex, derived from volume.
-        ////DEBUG
-        //m = 1.0f;
-
-        // STEP 1.1 Gravity.
-        Vector3f f_g = m * g;
-
-        // STEP 1.2 Collision force.
-        // Not here,
-        // we do a force balance after elastic force has been calculated.
-
-        force[vi] += f_g;
-        masses[vi] = m;
-    }
     // for all tetras:
+#pragma omp parallel for
     for (int ti = 0; ti < tmesh.n_tetras; ++ti)
     {
         // STEP 2:  Apply elastic force.
@@ -326,8 +579,10 @@ void SimulatorSimpleFED::simulate_util()
         // Strain
         Matrix3f epsilon = 0.5f * (grad_u + grad_u_T + grad_u_T * grad_u);
         // Stress
-        Matrix3f sigma = E * epsilon;
+        Matrix3f sigma = tetra_stiffness[ti] * E * epsilon;
         // for all faces on the tetra:
+        auto &f = tetra_force[ti];
+        f.fill({ 0,0,0 });
         int face_idxs[4][4] = {{0,1,2,3}, {0,2,3,1}, {0,3,1,2}, {1,2,3,0}}; // j0, j1, j2, j_unuse
         for  (int fi = 0; fi < 4; ++fi)
         {
@@ -340,35 +595,36 @@ void SimulatorSimpleFED::simulate_util()
             // Calculate elastic force applied on face and assign it to 3 vertices.
             Vector3f f_face = -sigma * area_normal;
             for (int i = 0; i < 3; ++i)
-                force[tvs[j[i]]] += 1.0f / 3.0f * f_face;
+                f[j[i]] += 1.0f / 3.0f * f_face;
         }
     }
-    // Balance
+    // for all vertices:
     const float k = 10000.0f; // k;
     const float mu = 0.03f; // mu;
+#pragma omp parallel for
     for (int vi = 0; vi < tmesh.n_vertices; ++vi)
     {
+        // STEP 1:  Apply external forces.
+        // mass of the vertex, from the volume and density of its tetras at init.
+        force[vi] += masses[vi] * g;
+
+        // Balance
         if (position[vi][2] <= 0.0f)
-            //if (position[vi][2] <= 0.0f && position[vi][1] <= 0.33f / 0.25f)
         {
-            //force[vi][2] = 0;
-            //if (velocity[vi][2] < 0.0f)
-            //{
-            //    velocity[vi][2] = -velocity[vi][2];
-            //    //position[vi][2] = -position[vi][2];
-            //}
             force[vi][2] += -position[vi][2] * k * 5.0f;
 
             force[vi][0] += -position[vi][2] * k * mu * -velocity[vi][0];
             force[vi][1] += -position[vi][2] * k * mu * -velocity[vi][1];
         }
     }
-    // Calm
-    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
-    {
-        //force[vi] += - velocity[vi] * velocity[vi].norm();
-    }
+    gather_tetra_force(force);
+    collide_penalty(position, force);
+
+    std::vector<Vector3f> x_start;
+    if (ccd_enabled_)
+        x_start = position;
     // update velocity and position
+#pragma omp parallel for
     for (int vi = 0; vi < tmesh.n_vertices; ++vi)
     {
         // v_i += f_i * dt / m_i
@@ -376,19 +632,31 @@ void SimulatorSimpleFED::simulate_util()
         // p_i += v_i * dt
         position[vi] = position[vi] + dt * velocity[vi];
     }
+    resolve_ccd(x_start, dt);
 }
 
-void SimulatorSimpleFED::simulate_rebuild()
+// E/2 * |epsilon|^2 per volume, and the ground penalty.
+double SimulatorSimpleFED::potential_energy() const
 {
-    auto &tmesh = ball->tmesh();
-    auto &mesh = ball->mesh();
+    const float E = 0.001e9f;
+    const float k = 10000.0f;
+    auto &tmesh = tmesh_all;
+    double e = 0.0;
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        Matrix3f p_123;
+        p_123 << (position[tvs[1]] - position[tvs[0]]),
+                 (position[tvs[2]] - position[tvs[0]]),
+                 (position[tvs[3]] - position[tvs[0]]);
+        Matrix3f grad_u = p_123 * X_bar[ti] - Matrix3f::Identity();
+        Matrix3f epsilon = 0.5f * (grad_u + grad_u.transpose() + grad_u.transpose() * grad_u);
+        e += 0.5 * tetra_stiffness[ti] * E * tetra_volume[ti] * epsilon.squaredNorm();
+    }
     for (int vi = 0; vi < tmesh.n_vertices; ++vi)
     {
-        if (vi < tmesh.n_vertices_boundary)
-        {
-            ball->set_point(vi, vec_cast<Eigen::Vector3f, QVector3D>(position[vi]));
-        }
-        tmesh.point[vi] = vec_cast<Eigen::Vector3f, OpenMesh::Vec3f>(position[vi]);
+        if (position[vi][2] <= 0.0f)
+            e += 0.5 * k * 5.0f * position[vi][2] * position[vi][2];
     }
-    ball->update();
+    return e;
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "OpenGLScene.h"
+#include "ContinuousCollision.h"
+#include "EmbeddedSurface.h"
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
@@ -8,10 +10,41 @@ typedef OpenGLMesh Model;
 using Eigen::Matrix3f;
 using Eigen::Vector3f;
 
+float _tetra_volume(Vector3f a, Vector3f b, Vector3f c, Vector3f d);
+
+// A tetra body of the scene, and where it starts in the global index space
+// all bodies are simulated in.
+struct SimBody
+{
+    std::shared_ptr<Model> model;
+    int vertex_offset;
+    int tetra_offset;
+    float density;                  // 0 for the simulator's default.
+    float stiffness;                // multiplier of the simulator's stiffness.
+    std::vector<std::shared_ptr<EmbeddedSurface>> embedded;     // surfaces with "EmbedIn" this body.
+};
+// every model with ShowTetra and a tetra mesh, "Ground" and embedded
+// surfaces excluded, in scene order. Embedded surfaces are bound to the
+// current shape of their cage.
+std::vector<SimBody> _gather_bodies(const OpenGLScene &scene);
+// write global tetra vertex positions to the bodies' models,
+// boundary ones also to their surface meshes, and skin the embedded surfaces.
+void _apply_position(const std::vector<SimBody> &bodies, const std::vector<Vector3f> &p);
+
+// What a step starts from: enough to redo a step, or to go on from it.
+struct SimState
+{
+    double t;
+    std::vector<Vector3f> position;
+    std::vector<Vector3f> velocity;
+};
+
 class SimulatorBase
 {
 public:
-    explicit SimulatorBase(OpenGLScene &scene) : scene_(scene), t(0), init_ok_(false) {  }
+    explicit SimulatorBase(OpenGLScene &scene) :
+        scene_(scene), t(0), init_ok_(false), collision_enabled_(false), collision_stiffness_(0.0f),
+        ccd_enabled_(false), n_impacts_(0), step_error_(-1.0), step_count_(0) {  }
     virtual ~SimulatorBase() {  };
     virtual void init(const double &t);
     virtual void simulate_util();
@@ -19,6 +52,39 @@ public:
     void simulate(const double &t);
     double get_time() const { return t; }
 
+    // Split of simulate(), for driving the simulator from another thread:
+    // step() only advances the state, apply_position() writes a copy of it
+    // to the model, and must be called from the thread owning the scene.
+    void step(const double &dt);
+    const std::vector<Vector3f> &get_position() const { return position; }
+    void apply_position(const std::vector<Vector3f> &p);
+
+    // Total energy: kinetic, gravity (z = 0 as zero) and potential_energy().
+    // Not conserved with contact friction, but its drift over a free
+    // flight measures the integrator.
+    double energy() const;
+    virtual double potential_energy() const { return 0.0; }
+    int n_contacts() const { return static_cast<int>(contacts.size()); }
+    int n_impacts() const { return n_impacts_; }
+
+    // Save / restore the state, e.g. to reject a step.
+    void get_state(SimState &s) const;
+    void set_state(const SimState &s);
+    // Local error (max vertex distance) of the last step from an embedded
+    // lower order solution, < 0 if the integrator has none.
+    double step_error() const { return step_error_; }
+    // > 0 for simulators paying for a change of step (a factorization):
+    // an adaptive stepper keeps to steps of step_quantum() * 2^k.
+    virtual double step_quantum() const { return 0.0; }
+
+    // Binary checkpoint of the full state: time, step count, vertices and
+    // what the simulator keeps between steps (save_extra()). Restored into
+    // a simulator of the same type, initialized on the same scene, the run
+    // goes on bit for bit as if never interrupted.
+    bool save_checkpoint(const QString &filename) const;
+    bool load_checkpoint(const QString &filename);
+    long long step_count() const { return step_count_; }
+
 protected:
     OpenGLScene &scene_;
     bool init_ok_;
@@ -29,8 +95,62 @@ protected:
 
     double t;
     double dt;
+
+    // All bodies batched into one tetra mesh of global indices,
+    // per tetra parameters from their bodies, and the vertices' state.
+    bool init_bodies(float default_density);
+    std::vector<SimBody> bodies;
+    TetraMesh tmesh_all;
+    std::vector<float> tetra_density;
+    std::vector<float> tetra_stiffness;
+    std::vector<Vector3f> velocity;
+    std::vector<Vector3f> position;
+    std::vector<float> masses;
+
+    // Per tetra corner forces, filled in parallel, and gathered by vertex
+    // through the incidence vertex -> (tetra, corner), so no thread adds
+    // into another's vertex. Built by init_bodies().
+    void gather_tetra_force(std::vector<Vector3f> &force) const;
+    std::vector<std::array<Vector3f, 4>> tetra_force;
+    std::vector<int> vert_tetra_begin;
+    std::vector<int> vert_tetra;    // 4 * ti + local index
+
+    // Contacts of the boundary triangles, between bodies and within one,
+    // the hash is rebuilt on x at every call. For force based integrators
+    // a penalty, for position based ones a projection with the masses.
+    void collide_penalty(const std::vector<Vector3f> &x, std::vector<Vector3f> &force);
+    void collide_project(std::vector<Vector3f> &x);
+    bool collision_enabled_;
+    float collision_stiffness_;
+    CollisionSpatialHash collision;
+    std::vector<VertexTriangleContact> contacts;
+
+    // Continuous collision of the move from x_start to position (bodies and
+    // ground), every vertex stops before its first impact. Called after the
+    // update of any integrator, with the positions the step started from
+    // and the step h they moved over.
+    void resolve_ccd(const std::vector<Vector3f> &x_start, double h);
+    bool ccd_enabled_;
+    int n_impacts_;
+    ContinuousCollision ccd;
+
+    double step_error_;
+
+    // after set_state(), for simulators with state beyond the vertices.
+    virtual void state_restored() {  }
+    // that state, exactly, for checkpoints. load_extra() fails on data of
+    // another size.
+    virtual void save_extra(std::vector<char> &b) const {  }
+    virtual bool load_extra(const char *data, size_t size) { return size == 0; }
+    long long step_count_;
 };
 
+// Deterministic runs ("Deterministic" in simulator.config): Eigen's
+// products single threaded, as their blocking depends on the thread count.
+// The simulators' own parallel loops write disjoint outputs, and contacts
+// are sorted, so the OpenMP thread count does not change a result.
+void _set_deterministic(bool deterministic);
+
 class SimulatorSimpleSpring: public SimulatorBase
 {
 public:
@@ -38,18 +158,17 @@ public:
     ~SimulatorSimpleSpring() override {  };
     void init(const double& t) override;
     void simulate_util() override;
-    void simulate_rebuild() override;
+    double potential_energy() const override;
 
 protected:
     QVector3D x_0;
-    std::shared_ptr<Model> ball;
-    std::shared_ptr<Model> ground;
-    std::vector<Vector3f> velocity;
-    std::vector<Vector3f> position;
     std::vector<Vector3f> position_original;
     std::vector<float> tetra_volume;
     std::vector<float> vert_volume;
     TetraMesh tmesh_originial;
+
+    // gravity, the edge springs on x and the ground, into force.
+    void spring_force(const std::vector<Vector3f> &x, std::vector<Vector3f> &force);
 };
 
 class SimulatorSimpleFED : public SimulatorBase
@@ -59,14 +178,10 @@ public:
     ~SimulatorSimpleFED() override {  };
     void init(const double& t) override;
     void simulate_util() override;
-    void simulate_rebuild() override;
+    double potential_energy() const override;
 
 protected:
     QVector3D x_0;
-    std::shared_ptr<Model> ball;
-    std::shared_ptr<Model> ground;
-    std::vector<Vector3f> velocity;
-    std::vector<Vector3f> position;
     std::vector<float> tetra_volume;
     std::vector<float> vert_volume;
     std::vector<Matrix3f> X_bar;
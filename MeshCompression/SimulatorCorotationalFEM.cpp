@@ -0,0 +1,189 @@
+#include "stdafx.h"
+#include "SimulatorCorotationalFEM.h"
+#include <cstring>
+
+// Rotation part of A (Mueller et al. 2016), q is used as the initial guess
+// and holds the result. Converges in 1-2 iterations when warm-started.
+static void extract_rotation(const Matrix3f &A, Eigen::Quaternionf &q, int max_iter)
+{
+    for (int it = 0; it < max_iter; ++it)
+    {
+        Matrix3f R = q.matrix();
+        Vector3f omega = R.col(0).cross(A.col(0)) + R.col(1).cross(A.col(1)) + R.col(2).cross(A.col(2));
+        omega *= 1.0f / (std::abs(R.col(0).dot(A.col(0)) + R.col(1).dot(A.col(1)) + R.col(2).dot(A.col(2))) + 1.0e-9f);
+        float w = omega.norm();
+        if (w < 1.0e-9f)
+            break;
+        q = Eigen::Quaternionf(Eigen::AngleAxisf(w, omega / w)) * q;
+        q.normalize();
+    }
+}
+
+void SimulatorCorotationalFEM::init(const double& t)
+{
+    SimulatorBase::init(t);
+    if (!init_bodies(tcl_.get_value("FEM_Density")))
+    {
+        init_ok_ = false;
+        return;
+    }
+
+    const float E = tcl_.get_value("FEM_Young");
+    const float nu = tcl_.get_value("FEM_Poisson");
+    lambda_ = E * nu / ((1.0f + nu) * (1.0f - 2.0f * nu));
+    mu_ = E / (2.0f * (1.0f + nu));
+    rotation_iterations_ = tcl_.get_int("FEM_Rotation_Iterations");
+
+    auto &tmesh = tmesh_all;
+    vert_volume = std::vector<float>(tmesh.n_vertices, 0.0f);
+    tetra_volume = std::vector<float>(tmesh.n_tetras, 0.0f);
+    masses = std::vector<float>(tmesh.n_vertices, 0.0f);
+    Dm_inv = std::vector<Matrix3f>(tmesh.n_tetras, Matrix3f::Zero());
+    B = std::vector<Matrix3f>(tmesh.n_tetras, Matrix3f::Zero());
+    rotation = QuatVec(tmesh.n_tetras, Eigen::Quaternionf::Identity());
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        auto a = position[tvs[0]];
+        auto b = position[tvs[1]];
+        auto c = position[tvs[2]];
+        auto d = position[tvs[3]];
+        tetra_volume[ti] = _tetra_volume(a, b, c, d);
+        for (int j = 0; j < 4; ++j)
+        {
+            vert_volume[tvs[j]] += tetra_volume[ti] * 0.25f;
+            masses[tvs[j]] += tetra_density[ti] * tetra_volume[ti] * 0.25f;
+        }
+        // degenerated tetra, no elastic force from it.
+        if (tetra_volume[ti] < 1e-12f)
+            continue;
+        Matrix3f Dm;
+        Dm << (b - a), (c - a), (d - a);
+        Dm_inv[ti] = Dm.inverse();
+        // the body's stiffness scales both Lame parameters.
+        B[ti] = -tetra_stiffness[ti] * tetra_volume[ti] * Dm_inv[ti].transpose();
+    }
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        masses[vi] = std::max(masses[vi], 1e-6f);
+}
+
+void SimulatorCorotationalFEM::simulate_util()
+{
+    const Vector3f g{ 0.0f, 0.0f, -9.8f }; // g: jyokuryo kassodoku.
+    auto &tmesh = tmesh_all;
+
+    // for all tetras:
+#pragma omp parallel for
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        Matrix3f Ds;
+        Ds << (position[tvs[1]] - position[tvs[0]]),
+              (position[tvs[2]] - position[tvs[0]]),
+              (position[tvs[3]] - position[tvs[0]]);
+        Matrix3f F = Ds * Dm_inv[ti];
+
+        // F = R S, linear elasticity in the rotated frame.
+        extract_rotation(F, rotation[ti], rotation_iterations_);
+        Matrix3f R = rotation[ti].matrix();
+        Matrix3f RtF = R.transpose() * F;
+        // P = 2 mu (F - R) + lambda tr(R^T F - I) R
+        Matrix3f P = 2.0f * mu_ * (F - R) + lambda_ * (RtF.trace() - 3.0f) * R;
+
+        Matrix3f H = P * B[ti];
+        tetra_force[ti][1] = H.col(0);
+        tetra_force[ti][2] = H.col(1);
+        tetra_force[ti][3] = H.col(2);
+        tetra_force[ti][0] = -(H.col(0) + H.col(1) + H.col(2));
+    }
+
+    // contacts between the bodies.
+    std::vector<Vector3f> contact_force;
+    if (collision_enabled_)
+    {
+        contact_force = std::vector<Vector3f>(tmesh.n_vertices, { 0,0,0 });
+        collide_penalty(position, contact_force);
+    }
+
+    std::vector<Vector3f> x_start;
+    if (ccd_enabled_)
+        x_start = position;
+
+    // for all vertices:
+    const float k = 10000.0f; // k;
+    const float mu = 0.03f; // mu;
+#pragma omp parallel for
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+    {
+        Vector3f force = masses[vi] * g;
+        if (!contact_force.empty())
+            force += contact_force[vi];
+        for (int i = vert_tetra_begin[vi]; i < vert_tetra_begin[vi + 1]; ++i)
+            force += tetra_force[vert_tetra[i] / 4][vert_tetra[i] % 4];
+
+        // Balance
+        if (position[vi][2] <= 0.0f)
+        {
+            force[2] += -position[vi][2] * k * 5.0f;
+
+            force[0] += -position[vi][2] * k * mu * -velocity[vi][0];
+            force[1] += -position[vi][2] * k * mu * -velocity[vi][1];
+        }
+        // update velocity and position
+        velocity[vi] = velocity[vi] + dt * force / masses[vi];
+        position[vi] = position[vi] + dt * velocity[vi];
+    }
+    resolve_ccd(x_start, dt);
+}
+
+void SimulatorCorotationalFEM::save_extra(std::vector<char>& b) const
+{
+    for (auto &q : rotation)
+    {
+        auto p = reinterpret_cast<const char *>(q.coeffs().data());
+        b.insert(b.end(), p, p + 4 * sizeof(float));
+    }
+}
+
+bool SimulatorCorotationalFEM::load_extra(const char* data, size_t size)
+{
+    if (size != rotation.size() * 4 * sizeof(float))
+        return false;
+    for (auto &q : rotation)
+    {
+        std::memcpy(q.coeffs().data(), data, 4 * sizeof(float));
+        data += 4 * sizeof(float);
+    }
+    return true;
+}
+
+// with the rotations of the last step, and the ground penalty.
+double SimulatorCorotationalFEM::potential_energy() const
+{
+    const float k = 10000.0f; // k;
+    auto &tmesh = tmesh_all;
+    std::vector<double> e_tetra(tmesh.n_tetras);
+#pragma omp parallel for
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        Matrix3f Ds;
+        Ds << (position[tvs[1]] - position[tvs[0]]),
+              (position[tvs[2]] - position[tvs[0]]),
+              (position[tvs[3]] - position[tvs[0]]);
+        Matrix3f F = Ds * Dm_inv[ti];
+        Matrix3f R = rotation[ti].matrix();
+        float tr = (R.transpose() * F).trace() - 3.0f;
+        e_tetra[ti] = tetra_stiffness[ti] * tetra_volume[ti] * (mu_ * (F - R).squaredNorm() + 0.5f * lambda_ * tr * tr);
+    }
+    // summed in order, the same for any thread count.
+    double e = 0.0;
+    for (auto et : e_tetra)
+        e += et;
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+    {
+        if (position[vi][2] <= 0.0f)
+            e += 0.5 * k * 5.0f * position[vi][2] * position[vi][2];
+    }
+    return e;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "SimulatorBase.h"
+#include "TextConfigLoader.h"
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+// Co-rotational linear FEM on all tetra bodies of the scene.
+//
+// Everything that only depends on the rest shape (Dm^-1, and the
+// volume-weighted force matrix V * Dm^-T) is computed in init(),
+// the rotation of each tetra is extracted iteratively from a warm-started
+// quaternion, so a step is a few 3x3 products per tetra. Tetras run in
+// parallel, each writes the forces of its own corners and every vertex
+// gathers those of its tetras, so no thread adds into another's vertex.
+class SimulatorCorotationalFEM : public SimulatorBase
+{
+public:
+    explicit SimulatorCorotationalFEM(OpenGLScene& scene) :
+        SimulatorBase(scene), tcl_{ "./config/simulator.config" } {  }
+    ~SimulatorCorotationalFEM() override {  }
+    void init(const double& t) override;
+    void simulate_util() override;
+    double potential_energy() const override;
+
+protected:
+    using QuatVec = std::vector<Eigen::Quaternionf, Eigen::aligned_allocator<Eigen::Quaternionf>>;
+
+    // the warm-started rotations.
+    void save_extra(std::vector<char> &b) const override;
+    bool load_extra(const char *data, size_t size) override;
+
+    TextConfigLoader tcl_;
+    float lambda_;                  // Lame parameters, from Young's modulus and Poisson ratio.
+    float mu_;
+    int   rotation_iterations_;
+
+    std::vector<float> tetra_volume;
+    std::vector<float> vert_volume;
+    std::vector<Matrix3f> Dm_inv;   // rest shape, F = Ds * Dm^-1.
+    std::vector<Matrix3f> B;        // -s * V * Dm^-T, s of the body, forces on vertex 1..3 are columns of P * B.
+    QuatVec rotation;               // last rotation of each tetra, warm start of the next step.
+};
@@ -0,0 +1,364 @@
+#include "stdafx.h"
+#include "SimulatorModal.h"
+#include "SparseEigenSolver.h"
+#include <QDir>
+#include <QFileInfo>
+#include <cstring>
+
+using Eigen::VectorXf;
+using Eigen::MatrixXf;
+using RowMatrixXf = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+struct ModalCacheHeader
+{
+    char magic[4];                  // "MOD1"
+    qint32 n_vertices;
+    qint32 n_modes;
+    qint32 reserved;
+};
+
+// FNV-1a, 64 bits.
+static void _hash(quint64 &h, const void *data, size_t size)
+{
+    auto p = static_cast<const uchar *>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+}
+
+static bool _load_modes(const QString &filename, int n, int k, VectorXf &lambda, MatrixXf &U)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    ModalCacheHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, "MOD1", 4) != 0
+        || header.n_vertices != n || header.n_modes != k)
+        return false;
+    lambda.resize(k);
+    RowMatrixXf R(3 * n, k);
+    const qint64 bytes_u = static_cast<qint64>(R.size()) * sizeof(float);
+    if (file.read(reinterpret_cast<char *>(lambda.data()), k * sizeof(float)) != static_cast<qint64>(k * sizeof(float))
+        || file.read(reinterpret_cast<char *>(R.data()), bytes_u) != bytes_u)
+        return false;
+    U = R;
+    return true;
+}
+
+static void _save_modes(const QString &filename, int n, const VectorXf &lambda, const MatrixXf &U)
+{
+    QDir().mkpath(QFileInfo(filename).path());
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+    ModalCacheHeader header;
+    std::memcpy(header.magic, "MOD1", 4);
+    header.n_vertices = n;
+    header.n_modes = static_cast<qint32>(lambda.size());
+    header.reserved = 0;
+    RowMatrixXf R = U;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(lambda.data()), lambda.size() * sizeof(float));
+    file.write(reinterpret_cast<const char *>(R.data()), static_cast<qint64>(R.size()) * sizeof(float));
+}
+
+void SimulatorModal::init(const double& t)
+{
+    SimulatorBase::init(t);
+    n_modes_ = std::max(tcl_.get_int("Modal_Modes"), 1);
+    young_ = tcl_.get_value("Modal_Young");
+    poisson_ = tcl_.get_value("Modal_Poisson");
+    alpha_ = tcl_.get_value("Modal_Damping_Alpha");
+    beta_ = tcl_.get_value("Modal_Damping_Beta");
+    n_samples_ = std::max(tcl_.get_int("Modal_Contact_Samples"), 1);
+    ground_k_ = tcl_.get_value("Modal_Ground_Stiffness");
+    if (!init_bodies(tcl_.get_value("Modal_Density")))
+    {
+        init_ok_ = false;
+        return;
+    }
+
+    auto &tmesh = tmesh_all;
+    masses = std::vector<float>(tmesh.n_vertices, 0.0f);
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        float volume = _tetra_volume(position[tvs[0]], position[tvs[1]], position[tvs[2]], position[tvs[3]]);
+        for (int j = 0; j < 4; ++j)
+            masses[tvs[j]] += tetra_density[ti] * volume * 0.25f;
+    }
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        masses[vi] = std::max(masses[vi], 1e-6f);
+    rest = position;
+
+    modal.clear();
+    for (auto &body : bodies)
+    {
+        ModalBody mb;
+        if (!solve_modes(body, mb))
+        {
+            init_ok_ = false;
+            return;
+        }
+        modal.push_back(mb);
+    }
+}
+
+// Modes of one body, from the cache or solved and cached.
+bool SimulatorModal::solve_modes(const SimBody& body, ModalBody& mb)
+{
+    auto &tmesh = body.model->tmesh();
+    const int n = tmesh.n_vertices;
+    const int N = 3 * n;
+    const int k = std::min(n_modes_, N - 6);
+    if (k <= 0)
+        return false;
+    mb.offset = body.vertex_offset;
+    mb.n = n;
+    mb.mass = 0.0f;
+    Vector3f centroid{ 0,0,0 };
+    for (int vi = 0; vi < n; ++vi)
+    {
+        mb.mass += masses[mb.offset + vi];
+        centroid += masses[mb.offset + vi] * rest[mb.offset + vi];
+    }
+    centroid /= mb.mass;
+    const float density = tetra_density[body.tetra_offset];
+    const float stiffness = body.stiffness;
+
+    // the key: rest shape up to a translation, and all that changes K or M.
+    quint64 key = 14695981039346656037ULL;
+    _hash(key, &n, sizeof(n));
+    _hash(key, &k, sizeof(k));
+    for (int vi = 0; vi < n; ++vi)
+    {
+        Vector3f r = rest[mb.offset + vi] - centroid;
+        _hash(key, r.data(), 3 * sizeof(float));
+    }
+    _hash(key, tmesh.tetra_vertices.data(), tmesh.tetra_vertices.size() * sizeof(std::array<int, 4>));
+    float params[4] = { young_, poisson_, density, stiffness };
+    _hash(key, params, sizeof(params));
+    QString filename = QString("./cache/modal_%0.bin").arg(key, 16, 16, QChar('0'));
+
+    if (!_load_modes(filename, n, k, mb.lambda, mb.U))
+    {
+        // STEP 1:  Linear FEM stiffness, K_ab = V (mu (g_a . g_b) I + mu g_b g_a^T + lambda g_a g_b^T)
+        //          with g_a the gradients of the barycentric coordinates.
+        const double lambda = stiffness * young_ * poisson_ / ((1.0 + poisson_) * (1.0 - 2.0 * poisson_));
+        const double mu = stiffness * young_ / (2.0 * (1.0 + poisson_));
+        std::vector<Eigen::Triplet<double>> triplets;
+        triplets.reserve(tmesh.n_tetras * 144);
+        for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+        {
+            auto tvs = tmesh.tetra_vertices[ti];
+            Eigen::Vector3d x[4];
+            for (int j = 0; j < 4; ++j)
+                x[j] = rest[mb.offset + tvs[j]].cast<double>();
+            Eigen::Matrix3d Dm;
+            Dm << (x[1] - x[0]), (x[2] - x[0]), (x[3] - x[0]);
+            double volume = std::abs(Dm.determinant()) / 6.0;
+            if (volume < 1e-18)
+                continue;
+            Eigen::Matrix3d Dm_inv = Dm.inverse();
+            Eigen::Vector3d g[4];
+            for (int j = 0; j < 3; ++j)
+                g[j + 1] = Dm_inv.row(j).transpose();
+            g[0] = -(g[1] + g[2] + g[3]);
+            for (int a = 0; a < 4; ++a)
+                for (int b = 0; b < 4; ++b)
+                {
+                    Eigen::Matrix3d Kab = volume * (mu * g[a].dot(g[b]) * Eigen::Matrix3d::Identity()
+                        + mu * g[b] * g[a].transpose() + lambda * g[a] * g[b].transpose());
+                    for (int r = 0; r < 3; ++r)
+                        for (int c = 0; c < 3; ++c)
+                            triplets.emplace_back(3 * tvs[a] + r, 3 * tvs[b] + c, Kab(r, c));
+                }
+        }
+        Eigen::SparseMatrix<double> K(N, N);
+        K.setFromTriplets(triplets.begin(), triplets.end());
+        Eigen::VectorXd M(N);
+        for (int vi = 0; vi < n; ++vi)
+            M.segment<3>(3 * vi).setConstant(masses[mb.offset + vi]);
+
+        // STEP 2:  Rigid modes, M-orthonormal, kept out of the solve.
+        Eigen::MatrixXd D = Eigen::MatrixXd::Zero(N, 6);
+        for (int vi = 0; vi < n; ++vi)
+        {
+            Eigen::Vector3d r = (rest[mb.offset + vi] - centroid).cast<double>();
+            for (int i = 0; i < 3; ++i)
+            {
+                D(3 * vi + i, i) = 1.0;
+                D.block<3, 1>(3 * vi, 3 + i) = Eigen::Vector3d::Unit(i).cross(r);
+            }
+        }
+        for (int i = 0; i < 6; ++i)
+        {
+            for (int j = 0; j < i; ++j)
+                D.col(i) -= D.col(j).dot(M.asDiagonal() * D.col(i)) * D.col(j);
+            D.col(i) /= std::sqrt(D.col(i).dot(M.asDiagonal() * D.col(i)));
+        }
+
+        // STEP 3:  Lowest k modes.
+        Eigen::VectorXd values;
+        Eigen::MatrixXd vectors;
+        if (!SmallestEigenpairs(K, M, k, values, vectors, &D))
+            return false;
+        mb.lambda = values.cast<float>().cwiseMax(0.0f);
+        mb.U = vectors.cast<float>();
+        _save_modes(filename, n, mb.lambda, mb.U);
+    }
+
+    mb.q = VectorXf::Zero(mb.lambda.size());
+    mb.qd = VectorXf::Zero(mb.lambda.size());
+    mb.c = { 0,0,0 };
+    mb.cd = { 0,0,0 };
+
+    // evenly strided over the boundary vertices.
+    const int n_boundary = tmesh.n_vertices_boundary;
+    const int n_samples = std::min(n_samples_, n_boundary);
+    mb.samples.clear();
+    for (int i = 0; i < n_samples; ++i)
+        mb.samples.push_back(static_cast<int>(static_cast<long long>(i) * n_boundary / n_samples));
+    mb.sample_weight = n_samples > 0 ? static_cast<float>(n_boundary) / n_samples : 0.0f;
+    return true;
+}
+
+// x = x_rest + c + U q, v = cd + U qd.
+void SimulatorModal::reconstruct(const ModalBody& mb)
+{
+    VectorXf u = mb.U * mb.q;
+    VectorXf ud = mb.U * mb.qd;
+#pragma omp parallel for
+    for (int vi = 0; vi < mb.n; ++vi)
+    {
+        position[mb.offset + vi] = rest[mb.offset + vi] + mb.c + u.segment<3>(3 * vi);
+        velocity[mb.offset + vi] = mb.cd + ud.segment<3>(3 * vi);
+    }
+}
+
+void SimulatorModal::simulate_util()
+{
+    const Vector3f g{ 0.0f, 0.0f, -9.8f }; // g: jyokuryo kassodoku.
+    const float mu = 0.03f; // mu;
+    const float h = static_cast<float>(dt);
+
+    for (auto &mb : modal)
+    {
+        // the ground on the samples: a force on the translation, and through
+        // the rows of U on the modes.
+        Vector3f force_total{ 0,0,0 };
+        VectorXf force_q = VectorXf::Zero(mb.lambda.size());
+        for (int vi : mb.samples)
+        {
+            const Vector3f &x = position[mb.offset + vi];
+            const Vector3f &v = velocity[mb.offset + vi];
+            if (x[2] > 0.0f)
+                continue;
+            Vector3f force{ 0,0,0 };
+            force[2] += -x[2] * ground_k_;
+            force[0] += -x[2] * ground_k_ * mu * -v[0];
+            force[1] += -x[2] * ground_k_ * mu * -v[1];
+            force *= mb.sample_weight;
+            force_total += force;
+            force_q += mb.U.middleRows<3>(3 * vi).transpose() * force;
+        }
+        mb.cd += h * (g + force_total / mb.mass);
+        mb.c += h * mb.cd;
+
+        // implicit Euler of q'' + (alpha + beta lambda) q' + lambda q = f, per mode.
+        for (int j = 0; j < mb.lambda.size(); ++j)
+        {
+            const float l = mb.lambda[j];
+            mb.qd[j] = (mb.qd[j] + h * (force_q[j] - l * mb.q[j])) / (1.0f + h * (alpha_ + beta_ * l) + h * h * l);
+            mb.q[j] += h * mb.qd[j];
+        }
+        reconstruct(mb);
+    }
+}
+
+// back from a restored state: c is the mass-weighted mean displacement
+// (the modes have none), q its M-projection on U.
+void SimulatorModal::state_restored()
+{
+    for (auto &mb : modal)
+    {
+        VectorXf u(3 * mb.n);
+        VectorXf ud(3 * mb.n);
+        mb.c = { 0,0,0 };
+        mb.cd = { 0,0,0 };
+        for (int vi = 0; vi < mb.n; ++vi)
+        {
+            mb.c += masses[mb.offset + vi] * (position[mb.offset + vi] - rest[mb.offset + vi]);
+            mb.cd += masses[mb.offset + vi] * velocity[mb.offset + vi];
+        }
+        mb.c /= mb.mass;
+        mb.cd /= mb.mass;
+        for (int vi = 0; vi < mb.n; ++vi)
+        {
+            const float m = masses[mb.offset + vi];
+            u.segment<3>(3 * vi) = m * (position[mb.offset + vi] - rest[mb.offset + vi] - mb.c);
+            ud.segment<3>(3 * vi) = m * (velocity[mb.offset + vi] - mb.cd);
+        }
+        mb.q = mb.U.transpose() * u;
+        mb.qd = mb.U.transpose() * ud;
+    }
+}
+
+void SimulatorModal::save_extra(std::vector<char>& b) const
+{
+    auto put = [&b](const float *p, size_t n)
+    {
+        auto c = reinterpret_cast<const char *>(p);
+        b.insert(b.end(), c, c + n * sizeof(float));
+    };
+    for (auto &mb : modal)
+    {
+        put(mb.c.data(), 3);
+        put(mb.cd.data(), 3);
+        put(mb.q.data(), mb.q.size());
+        put(mb.qd.data(), mb.qd.size());
+    }
+}
+
+bool SimulatorModal::load_extra(const char* data, size_t size)
+{
+    size_t expected = 0;
+    for (auto &mb : modal)
+        expected += (6 + 2 * mb.q.size()) * sizeof(float);
+    if (size != expected)
+        return false;
+    auto get = [&data](float *p, size_t n)
+    {
+        std::memcpy(p, data, n * sizeof(float));
+        data += n * sizeof(float);
+    };
+    for (auto &mb : modal)
+    {
+        get(mb.c.data(), 3);
+        get(mb.cd.data(), 3);
+        get(mb.q.data(), mb.q.size());
+        get(mb.qd.data(), mb.qd.size());
+    }
+    return true;
+}
+
+// modal strain energy, and the ground penalty the samples feel.
+double SimulatorModal::potential_energy() const
+{
+    double e = 0.0;
+    for (auto &mb : modal)
+    {
+        for (int j = 0; j < mb.lambda.size(); ++j)
+            e += 0.5 * mb.lambda[j] * mb.q[j] * mb.q[j];
+        for (int vi : mb.samples)
+        {
+            float z = position[mb.offset + vi][2];
+            if (z <= 0.0f)
+                e += 0.5 * ground_k_ * mb.sample_weight * z * z;
+        }
+    }
+    return e;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "SimulatorBase.h"
+#include "TextConfigLoader.h"
+
+// Reduced-order (modal) linear FEM, for meshes too large for the
+// full-space simulators.
+//
+// At init the lowest k vibration modes of each body's linearized stiffness,
+// K U = M U Lambda with the rigid modes deflated, are solved once and cached
+// in ./cache/ by a hash of the rest shape and the parameters. A body then
+// moves as x = x_rest + c + U q: a translation c driven by gravity and the
+// ground, and k decoupled damped oscillators q. The ground acts on a fixed
+// sample of boundary vertices, so a step is O(k * samples) plus a GEMV
+// with U to reconstruct the vertices. Rotations are linearized (no modal
+// derivatives), large rotations of a body look sheared.
+class SimulatorModal : public SimulatorBase
+{
+public:
+    explicit SimulatorModal(OpenGLScene& scene) :
+        SimulatorBase(scene), tcl_{ "./config/simulator.config" } {  }
+    ~SimulatorModal() override {  }
+    void init(const double& t) override;
+    void simulate_util() override;
+    double potential_energy() const override;
+
+protected:
+    void state_restored() override;
+    // c, cd, q and qd of every body, which the projection in
+    // state_restored() only gives up to rounding.
+    void save_extra(std::vector<char> &b) const override;
+    bool load_extra(const char *data, size_t size) override;
+
+    struct ModalBody
+    {
+        int offset;                 // first global vertex.
+        int n;                      // vertices.
+        float mass;
+        Eigen::VectorXf lambda;     // eigenvalues (omega^2), k.
+        Eigen::MatrixXf U;          // 3n x k, M-orthonormal modes.
+        Eigen::VectorXf q;
+        Eigen::VectorXf qd;
+        Vector3f c;                 // translation, and its velocity.
+        Vector3f cd;
+        std::vector<int> samples;   // boundary vertices the ground acts on.
+        float sample_weight;        // boundary vertices per sample.
+    };
+
+    bool solve_modes(const SimBody &body, ModalBody &mb);
+    void reconstruct(const ModalBody &mb);
+
+    TextConfigLoader tcl_;
+    int n_modes_;
+    float young_;
+    float poisson_;
+    float alpha_;                   // Rayleigh damping, alpha M + beta K.
+    float beta_;
+    int n_samples_;
+    float ground_k_;
+
+    std::vector<ModalBody> modal;
+    std::vector<Vector3f> rest;
+};
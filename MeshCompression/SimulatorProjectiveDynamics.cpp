@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "SimulatorProjectiveDynamics.h"
+#include <Eigen/SVD>
+
+using T = Eigen::Triplet<float>;
+
+void SimulatorProjectiveDynamics::init(const double& t)
+{
+    SimulatorBase::init(t);
+
+    iterations_ = tcl_.get_int("PD_Iterations");
+    stiffness_ = tcl_.get_value("PD_Stiffness");
+
+    // All tetra bodies of the scene.
+    if (!init_bodies(tcl_.get_value("PD_Density")))
+    {
+        init_ok_ = false;
+        return;
+    }
+
+    auto &tmesh = tmesh_all;
+    vert_volume = std::vector<float>(tmesh.n_vertices, 0.0f);
+    tetra_volume = std::vector<float>(tmesh.n_tetras, 0.0f);
+    masses = std::vector<float>(tmesh.n_vertices, 0.0f);
+    Dm_inv_T = std::vector<Matrix3f>(tmesh.n_tetras, Matrix3f::Zero());
+    weights = std::vector<float>(tmesh.n_tetras, 0.0f);
+
+    // G: for each tetra, 3 rows giving F^T = Dm^-T * [x1-x0, x2-x0, x3-x0]^T.
+    std::vector<T> tv_G;
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        auto a = position[tvs[0]];
+        auto b = position[tvs[1]];
+        auto c = position[tvs[2]];
+        auto d = position[tvs[3]];
+        tetra_volume[ti] = _tetra_volume(a, b, c, d);
+        for (int j = 0; j < 4; ++j)
+        {
+            vert_volume[tvs[j]] += tetra_volume[ti] * 0.25f;
+            masses[tvs[j]] += tetra_density[ti] * tetra_volume[ti] * 0.25f;
+        }
+        // degenerated tetra from TetGen, leave it out of the energy.
+        if (tetra_volume[ti] < 1e-12f)
+            continue;
+
+        Matrix3f Dm;
+        Dm << (b - a), (c - a), (d - a);
+        Dm_inv_T[ti] = Dm.inverse().transpose();
+        weights[ti] = tetra_stiffness[ti] * stiffness_ * tetra_volume[ti];
+        for (int r = 0; r < 3; ++r)
+        {
+            float sum = 0.0f;
+            for (int col = 0; col < 3; ++col)
+            {
+                tv_G.push_back(T{ 3 * ti + r, tvs[col + 1], Dm_inv_T[ti](r, col) });
+                sum += Dm_inv_T[ti](r, col);
+            }
+            tv_G.push_back(T{ 3 * ti + r, tvs[0], -sum });
+        }
+    }
+    G.resize(3 * tmesh.n_tetras, tmesh.n_vertices);
+    G.setFromTriplets(tv_G.begin(), tv_G.end());
+
+    Eigen::VectorXf W(3 * tmesh.n_tetras);
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+        W.segment<3>(3 * ti).setConstant(weights[ti]);
+    GtW = SpMat(G.transpose()) * W.asDiagonal();
+
+    // lumped mass, keep it positive for vertices not used by any tetra.
+    std::vector<T> tv_M;
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+    {
+        masses[vi] = std::max(masses[vi], 1e-6f);
+        tv_M.push_back(T{ vi, vi, masses[vi] });
+    }
+    M.resize(tmesh.n_vertices, tmesh.n_vertices);
+    M.setFromTriplets(tv_M.begin(), tv_M.end());
+
+    base_h_ = tcl_.get_value("PD_Time_Step");
+    factorizations_.clear();
+    solver_ = nullptr;
+    if (!prefactor(base_h_))
+    {
+        std::cerr << "PD: cannot factorize the system matrix." << std::endl;
+        init_ok_ = false;
+    }
+}
+
+// A = M / h^2 + G^T W G, constant as long as h does not change.
+// A step factorized before is looked up, the oldest one dropped past 8.
+// False if the factorization fails, h_ and solver_ are kept then.
+bool SimulatorProjectiveDynamics::prefactor(float h)
+{
+    for (auto &f : factorizations_)
+    {
+        if (std::abs(f.first - h) <= 1e-6f * h)
+        {
+            h_ = h;
+            solver_ = f.second.get();
+            return true;
+        }
+    }
+    SpMat A = M / (h * h) + GtW * G;
+    std::unique_ptr<Solver> solver(new Solver);
+    solver->compute(A);
+    if (solver->info() != Eigen::Success)
+        return false;
+    if (factorizations_.size() >= 8)
+        factorizations_.erase(factorizations_.begin());
+    factorizations_.emplace_back(h, std::move(solver));
+    h_ = h;
+    solver_ = factorizations_.back().second.get();
+    return true;
+}
+
+// project every tetra to its closest rotation, P gets R^T stacked by tetra.
+void SimulatorProjectiveDynamics::local_step(const MatX3& X, MatX3& P) const
+{
+    auto &tmesh = tmesh_all;
+#pragma omp parallel for
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        Matrix3f Ds_T;
+        for (int r = 0; r < 3; ++r)
+            Ds_T.row(r) = X.row(tvs[r + 1]) - X.row(tvs[0]);
+        Matrix3f F = (Dm_inv_T[ti] * Ds_T).transpose();
+
+        Eigen::JacobiSVD<Matrix3f> svd(F, Eigen::ComputeFullU | Eigen::ComputeFullV);
+        Matrix3f U = svd.matrixU();
+        Matrix3f R = U * svd.matrixV().transpose();
+        // reflection, flip the axis of the smallest singular value.
+        if (R.determinant() < 0.0f)
+        {
+            U.col(2) = -U.col(2);
+            R = U * svd.matrixV().transpose();
+        }
+        P.middleRows<3>(3 * ti) = R.transpose();
+    }
+}
+
+void SimulatorProjectiveDynamics::simulate_util()
+{
+    const Vector3f g{ 0.0f, 0.0f, -9.8f }; // g: jyokuryo kassodoku.
+    const float mu = 0.03f; // mu: friction on the ground.
+    auto &tmesh = tmesh_all;
+
+    // factorize only for a step not seen before.
+    if (std::abs(static_cast<float>(dt) - h_) > 1e-9f && !prefactor(static_cast<float>(dt)))
+    {
+        std::cerr << "PD: cannot factorize the system matrix for step " << dt << "." << std::endl;
+        return;
+    }
+    const float h = h_;
+
+    // STEP 1:  Inertia, y = x + h v + h^2 g.
+    MatX3 Y(tmesh.n_vertices, 3);
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        Y.row(vi) = (position[vi] + h * velocity[vi] + h * h * g).transpose();
+    MatX3 inertia = M * Y / (h * h);
+
+    // STEP 2:  Local / global iterations.
+    MatX3 X = Y;
+    MatX3 P(3 * tmesh.n_tetras, 3);
+    for (int it = 0; it < iterations_; ++it)
+    {
+        local_step(X, P);
+        X = solver_->solve(inertia + GtW * P);
+    }
+
+    // STEP 3:  Velocity update and collision with the ground.
+    std::vector<Vector3f> x_start;
+    if (ccd_enabled_)
+        x_start = position;
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+    {
+        Vector3f p = X.row(vi).transpose();
+        Vector3f v = (p - position[vi]) / h;
+        if (p[2] <= 0.0f)
+        {
+            p[2] = 0.0f;
+            if (v[2] < 0.0f)
+                v[2] = 0.0f;
+            v[0] *= 1.0f - mu;
+            v[1] *= 1.0f - mu;
+        }
+        position[vi] = p;
+        velocity[vi] = v;
+    }
+
+    // STEP 4:  Contacts between the bodies, the correction goes to the velocity.
+    if (collision_enabled_)
+    {
+        std::vector<Vector3f> before = position;
+        collide_project(position);
+        for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+            velocity[vi] += (position[vi] - before[vi]) / h;
+    }
+
+    // STEP 5:  No vertex passes through a body or the ground within the step.
+    resolve_ccd(x_start, dt);
+}
+
+double SimulatorProjectiveDynamics::potential_energy() const
+{
+    auto &tmesh = tmesh_all;
+    std::vector<double> e_tetra(tmesh.n_tetras);
+#pragma omp parallel for
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        Matrix3f Ds_T;
+        for (int r = 0; r < 3; ++r)
+            Ds_T.row(r) = (position[tvs[r + 1]] - position[tvs[0]]).transpose();
+        Matrix3f F = (Dm_inv_T[ti] * Ds_T).transpose();
+        Eigen::JacobiSVD<Matrix3f> svd(F, Eigen::ComputeFullU | Eigen::ComputeFullV);
+        Matrix3f U = svd.matrixU();
+        if ((U * svd.matrixV().transpose()).determinant() < 0.0f)
+            U.col(2) = -U.col(2);
+        e_tetra[ti] = 0.5 * weights[ti] * (F - U * svd.matrixV().transpose()).squaredNorm();
+    }
+    // summed in order, the same for any thread count.
+    double e = 0.0;
+    for (auto et : e_tetra)
+        e += et;
+    return e;
+}
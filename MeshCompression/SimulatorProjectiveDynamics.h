@@ -0,0 +1,49 @@
+#pragma once
+#include "SimulatorBase.h"
+#include "TextConfigLoader.h"
+#include <Eigen/Sparse>
+
+// Projective Dynamics (Bouaziz et al. 2014) on all tetra bodies of the scene.
+//
+// Per tetra the elastic energy is  w/2 * || F - R ||^2,  R the closest rotation.
+// The global matrix  M/h^2 + sum w G^T G  only depends on the rest shape and h,
+// it is factorized once, each iteration is a parallel local projection
+// followed by a back-substitution. Factorizations are kept per step, so an
+// adaptive stepper going between a few steps factorizes each once.
+class SimulatorProjectiveDynamics : public SimulatorBase
+{
+public:
+    explicit SimulatorProjectiveDynamics(OpenGLScene& scene) :
+        SimulatorBase(scene), tcl_{ "./config/simulator.config" }, h_(0.0f), base_h_(0.0f), solver_(nullptr) {  }
+    ~SimulatorProjectiveDynamics() override {  }
+    void init(const double& t) override;
+    void simulate_util() override;
+    double potential_energy() const override;
+    // steps of PD_Time_Step * 2^k reuse their factorization.
+    double step_quantum() const override { return base_h_; }
+
+protected:
+    using SpMat = Eigen::SparseMatrix<float>;
+    using MatX3 = Eigen::Matrix<float, Eigen::Dynamic, 3>;
+    using Solver = Eigen::SimplicialLDLT<SpMat>;
+
+    bool prefactor(float h);
+    void local_step(const MatX3 &X, MatX3 &P) const;
+
+    TextConfigLoader tcl_;
+    float h_;                       // time step the system matrix is factorized for.
+    float base_h_;                  // PD_Time_Step.
+    int   iterations_;
+    float stiffness_;
+
+    std::vector<float> tetra_volume;
+    std::vector<float> vert_volume;
+    std::vector<Matrix3f> Dm_inv_T;  // rest shape, F^T = Dm^-T * Ds^T.
+    std::vector<float> weights;     // stiffness * body stiffness * tetra volume.
+
+    SpMat G;                        // 3T * N, maps positions to F^T of every tetra.
+    SpMat GtW;                      // G^T * W, N * 3T.
+    SpMat M;                        // lumped mass, N * N.
+    std::vector<std::pair<float, std::unique_ptr<Solver>>> factorizations_;
+    Solver *solver_;                // the one of h_.
+};
@@ -0,0 +1,260 @@
+#include "stdafx.h"
+#include "SimulatorXPBD.h"
+
+static float _signed_volume(const Vector3f &a, const Vector3f &b, const Vector3f &c, const Vector3f &d)
+{
+    return 1.0f / 6 * (b - a).dot((c - a).cross(d - a));
+}
+
+// greedy coloring, no two constraints in one color share a vertex.
+template <size_t N>
+static std::vector<std::vector<int>> _color_constraints(
+    const std::vector<std::array<int, N>> &cons, int n_vertices)
+{
+    std::vector<std::vector<int>> colors;
+    std::vector<std::vector<char>> used(n_vertices); // used[vi][color]
+    for (int ci = 0; ci < static_cast<int>(cons.size()); ++ci)
+    {
+        size_t c = 0;
+        for (;; ++c)
+        {
+            bool free = true;
+            for (auto vi : cons[ci])
+                if (c < used[vi].size() && used[vi][c])
+                    free = false;
+            if (free)
+                break;
+        }
+        if (c >= colors.size())
+            colors.resize(c + 1);
+        colors[c].push_back(ci);
+        for (auto vi : cons[ci])
+        {
+            if (used[vi].size() <= c)
+                used[vi].resize(c + 1, 0);
+            used[vi][c] = 1;
+        }
+    }
+    return colors;
+}
+
+void SimulatorXPBD::init(const double& t)
+{
+    SimulatorBase::init(t);
+    if (!init_bodies(tcl_.get_value("XPBD_Density")))
+    {
+        init_ok_ = false;
+        return;
+    }
+
+    substeps_ = std::max(tcl_.get_int("XPBD_Substeps"), 1);
+    iterations_ = std::max(tcl_.get_int("XPBD_Iterations"), 1);
+    edge_compliance_ = tcl_.get_value("XPBD_Edge_Compliance");
+    volume_compliance_ = tcl_.get_value("XPBD_Volume_Compliance");
+    friction_ = tcl_.get_value("XPBD_Friction");
+
+    auto &tmesh = tmesh_all;
+    prev_position = position;
+
+    // masses, and the rest volume constraints.
+    masses = std::vector<float>(tmesh.n_vertices, 0.0f);
+    tetra_volume = std::vector<float>(tmesh.n_tetras, 0.0f);
+    std::vector<float> vert_stiffness(tmesh.n_vertices, 1.0f);
+    std::vector<std::array<int, 2>> all_edges;
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto tvs = tmesh.tetra_vertices[ti];
+        tetra_volume[ti] = _signed_volume(position[tvs[0]], position[tvs[1]], position[tvs[2]], position[tvs[3]]);
+        for (int j = 0; j < 4; ++j)
+        {
+            masses[tvs[j]] += tetra_density[ti] * std::abs(tetra_volume[ti]) * 0.25f;
+            vert_stiffness[tvs[j]] = tetra_stiffness[ti];
+        }
+        for (int j = 0; j < 4; ++j)
+            for (int k = j + 1; k < 4; ++k)
+                all_edges.push_back({ std::min(tvs[j], tvs[k]), std::max(tvs[j], tvs[k]) });
+    }
+    inv_masses = std::vector<float>(tmesh.n_vertices, 0.0f);
+    for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        inv_masses[vi] = masses[vi] > 0.0f ? 1.0f / masses[vi] : 0.0f;
+
+    // edges shared by several tetras only give one constraint.
+    std::sort(all_edges.begin(), all_edges.end());
+    all_edges.erase(std::unique(all_edges.begin(), all_edges.end()), all_edges.end());
+    edges = all_edges;
+    edge_length = std::vector<float>(edges.size());
+    edge_stiffness = std::vector<float>(edges.size());
+    for (size_t ei = 0; ei < edges.size(); ++ei)
+    {
+        edge_length[ei] = (position[edges[ei][1]] - position[edges[ei][0]]).norm();
+        // an edge never joins two bodies.
+        edge_stiffness[ei] = vert_stiffness[edges[ei][0]];
+    }
+
+    edge_lambda = std::vector<float>(edges.size(), 0.0f);
+    volume_lambda = std::vector<float>(tmesh.n_tetras, 0.0f);
+    edge_colors = _color_constraints(edges, tmesh.n_vertices);
+    volume_colors = _color_constraints(tmesh.tetra_vertices, tmesh.n_vertices);
+}
+
+// C = |x1 - x0| - l0
+void SimulatorXPBD::solve_edge(int ci, float alpha_tilde)
+{
+    int i0 = edges[ci][0];
+    int i1 = edges[ci][1];
+    float w = inv_masses[i0] + inv_masses[i1];
+    if (w == 0.0f)
+        return;
+    Vector3f d = position[i1] - position[i0];
+    float len = d.norm();
+    if (len < 1e-9f)
+        return;
+    Vector3f n = d / len;
+    float C = len - edge_length[ci];
+    alpha_tilde /= edge_stiffness[ci];
+    float d_lambda = (-C - alpha_tilde * edge_lambda[ci]) / (w + alpha_tilde);
+    edge_lambda[ci] += d_lambda;
+    position[i0] -= d_lambda * inv_masses[i0] * n;
+    position[i1] += d_lambda * inv_masses[i1] * n;
+}
+
+// C = V - V0
+void SimulatorXPBD::solve_volume(int ci, float alpha_tilde)
+{
+    auto tvs = tmesh_all.tetra_vertices[ci];
+    const Vector3f &p0 = position[tvs[0]];
+    const Vector3f &p1 = position[tvs[1]];
+    const Vector3f &p2 = position[tvs[2]];
+    const Vector3f &p3 = position[tvs[3]];
+    std::array<Vector3f, 4> grad;
+    grad[1] = 1.0f / 6 * (p2 - p0).cross(p3 - p0);
+    grad[2] = 1.0f / 6 * (p3 - p0).cross(p1 - p0);
+    grad[3] = 1.0f / 6 * (p1 - p0).cross(p2 - p0);
+    grad[0] = -(grad[1] + grad[2] + grad[3]);
+    float w = 0.0f;
+    for (int j = 0; j < 4; ++j)
+        w += inv_masses[tvs[j]] * grad[j].squaredNorm();
+    if (w < 1e-12f)
+        return;
+    float C = _signed_volume(p0, p1, p2, p3) - tetra_volume[ci];
+    alpha_tilde /= tetra_stiffness[ci];
+    float d_lambda = (-C - alpha_tilde * volume_lambda[ci]) / (w + alpha_tilde);
+    volume_lambda[ci] += d_lambda;
+    for (int j = 0; j < 4; ++j)
+        position[tvs[j]] += d_lambda * inv_masses[tvs[j]] * grad[j];
+}
+
+// z >= 0, with static / kinetic friction on the tangential move of the substep.
+void SimulatorXPBD::solve_ground(int vi)
+{
+    if (position[vi][2] >= 0.0f)
+        return;
+    float depth = -position[vi][2];
+    position[vi][2] = 0.0f;
+    Vector3f d = position[vi] - prev_position[vi];
+    d[2] = 0.0f;
+    float d_len = d.norm();
+    if (d_len < friction_ * depth)
+        position[vi] -= d;
+    else if (d_len > 0.0f)
+        position[vi] -= d * (friction_ * depth / d_len);
+}
+
+void SimulatorXPBD::simulate_util()
+{
+    const Vector3f g{ 0.0f, 0.0f, -9.8f }; // g: jyokuryo kassodoku.
+    auto &tmesh = tmesh_all;
+    const float h = static_cast<float>(dt) / substeps_;
+    if (h <= 0.0f)
+        return;
+    // compliance scaled by the substep, stiffness is the same for any substeps / iterations.
+    const float alpha_edge = edge_compliance_ / (h * h);
+    const float alpha_volume = volume_compliance_ / (h * h);
+
+    for (int step = 0; step < substeps_; ++step)
+    {
+        // STEP 1:  Predict.
+#pragma omp parallel for
+        for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+        {
+            prev_position[vi] = position[vi];
+            if (inv_masses[vi] == 0.0f)
+                continue;
+            velocity[vi] += h * g;
+            position[vi] += h * velocity[vi];
+        }
+        std::fill(edge_lambda.begin(), edge_lambda.end(), 0.0f);
+        std::fill(volume_lambda.begin(), volume_lambda.end(), 0.0f);
+        // contacts found once per substep on the predicted positions.
+        if (collision_enabled_)
+        {
+            collision.build(position);
+            collision.detect(position, contacts);
+        }
+
+        // STEP 2:  Solve constraints, color by color.
+        for (int it = 0; it < iterations_; ++it)
+        {
+            for (auto &color : edge_colors)
+            {
+#pragma omp parallel for
+                for (int i = 0; i < static_cast<int>(color.size()); ++i)
+                    solve_edge(color[i], alpha_edge);
+            }
+            for (auto &color : volume_colors)
+            {
+#pragma omp parallel for
+                for (int i = 0; i < static_cast<int>(color.size()); ++i)
+                    solve_volume(color[i], alpha_volume);
+            }
+#pragma omp parallel for
+            for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+                solve_ground(vi);
+            if (collision_enabled_)
+                ProjectContacts(tmesh, contacts, collision.thickness(), inv_masses, position);
+        }
+
+        // STEP 3:  Update velocity.
+#pragma omp parallel for
+        for (int vi = 0; vi < tmesh.n_vertices; ++vi)
+            velocity[vi] = (position[vi] - prev_position[vi]) / h;
+
+        // STEP 4:  Clamp what still tunnels within the substep.
+        resolve_ccd(prev_position, h);
+    }
+}
+
+// C^2 / (2 alpha) of the compliant constraints, rigid ones store no energy.
+double SimulatorXPBD::potential_energy() const
+{
+    auto &tmesh = tmesh_all;
+    const int n_edges = static_cast<int>(edges.size());
+    std::vector<double> e_edge(n_edges, 0.0);
+    std::vector<double> e_tetra(tmesh.n_tetras, 0.0);
+    if (edge_compliance_ > 0.0f)
+    {
+#pragma omp parallel for
+        for (int ei = 0; ei < n_edges; ++ei)
+        {
+            float C = (position[edges[ei][1]] - position[edges[ei][0]]).norm() - edge_length[ei];
+            e_edge[ei] = 0.5 * C * C * edge_stiffness[ei] / edge_compliance_;
+        }
+    }
+    if (volume_compliance_ > 0.0f)
+    {
+#pragma omp parallel for
+        for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+        {
+            auto tvs = tmesh.tetra_vertices[ti];
+            float C = _signed_volume(position[tvs[0]], position[tvs[1]], position[tvs[2]], position[tvs[3]]) - tetra_volume[ti];
+            e_tetra[ti] = 0.5 * C * C * tetra_stiffness[ti] / volume_compliance_;
+        }
+    }
+    // summed in order, the same for any thread count.
+    double e = 0.0;
+    for (auto ee : e_edge)
+        e += ee;
+    for (auto et : e_tetra)
+        e += et;
+    return e;
+}
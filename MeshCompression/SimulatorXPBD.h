@@ -0,0 +1,46 @@
+#pragma once
+#include "SimulatorBase.h"
+#include "TextConfigLoader.h"
+
+// Extended Position Based Dynamics (Macklin et al. 2016) on all tetra bodies of the scene.
+//
+// Constraints: length of every tetra edge, signed volume of every tetra,
+// and z >= 0 for the ground. Edge and volume constraints are colored so that
+// no two constraints of one color share a vertex, a color is solved in parallel.
+// Stiffness is given as compliance, it does not depend on the iteration count,
+// the compliance of a body is divided by its stiffness.
+class SimulatorXPBD : public SimulatorBase
+{
+public:
+    explicit SimulatorXPBD(OpenGLScene& scene) :
+        SimulatorBase(scene), tcl_{ "./config/simulator.config" } {  }
+    ~SimulatorXPBD() override {  }
+    void init(const double& t) override;
+    void simulate_util() override;
+    double potential_energy() const override;
+
+protected:
+    void solve_edge(int ci, float alpha_tilde);
+    void solve_volume(int ci, float alpha_tilde);
+    void solve_ground(int vi);
+
+    TextConfigLoader tcl_;
+    int   substeps_;
+    int   iterations_;
+    float edge_compliance_;
+    float volume_compliance_;
+    float friction_;
+
+    std::vector<float> inv_masses;
+    std::vector<Vector3f> prev_position;
+
+    std::vector<std::array<int, 2>> edges;
+    std::vector<float> edge_length;
+    std::vector<float> edge_stiffness;
+    std::vector<float> edge_lambda;
+    std::vector<std::vector<int>> edge_colors;
+
+    std::vector<float> tetra_volume; // signed, rest shape.
+    std::vector<float> volume_lambda;
+    std::vector<std::vector<int>> volume_colors;
+};
@@ -1,46 +1,45 @@
-//#pragma once
-//
-//#include "OpenGLMesh.h"
-//#include "ConsoleMessageManager.h"
-//#include <vector>
-//#include <Eigen/Dense>
-//#include <Eigen/Sparse>
-//#include <engine.h>
-//#include "TextConfigLoader.h"
-//
-//using Vector3f = Eigen::Vector3f;
-//using std::vector;
-//using SpMat = Eigen::SparseMatrix<float>;
-//using Mat = Eigen::MatrixXf;
-//using Vec = Eigen::VectorXf;
-//using T = Eigen::Triplet<float>;
-//
-//class SkeletonSolution
-//{
-//public:
-//    SkeletonSolution(TriMesh &mesh, ConsoleMessageManager &msg);
-//    ~SkeletonSolution();
-//
-//    void skeletonize();
-//
-//private:
-//    ConsoleMessageManager &msg_;
-//    TextConfigLoader tcl_;
-//    TriMesh &mesh_;
-//
-//    int n_vertices;
-//    int n_edges;
-//    int n_faces;
-//
-//    vector<Vector3f>        positions;
-//    vector<vector<bool>>    adjacency;
-//    vector<int>             degrees;
-//    vector<vector<int>>     neighbors;
-//
-//    float _cotangent_for_angle_AOB(int, int, int);
-//    void Basic_Prepare_and_Calculate_Laplacian(vector<T>& tv_Lap);
-//    void Input_Variables_to_Engine(Engine* ep);
-//    void Input_Laplacian_to_Engine(const vector<T> &tv_Lap, Engine* ep);
-//    void Input_Positions_to_Engine(Engine* ep);
-//};
-//
+#pragma once
+
+#include "OpenGLMesh.h"
+#include "ConsoleMessageManager.h"
+#include "TextConfigLoader.h"
+#include "MeshLaplacian.h"
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+// Laplacian contraction of a closed mesh towards its skeleton, in place.
+//
+// Every iteration solves the least squares problem of script/Skeleton.m,
+//     [Lap; W I] X = [0; W X],
+// through its normal equations (Lap^T Lap + W^2 I) X = W^2 X. The pattern
+// never changes, so the symbolic factorization is done once, the numeric
+// one once, or every iteration with Update_Laplacian (weights from the
+// contracted shape). The three coordinates are solved in parallel.
+class SkeletonSolution
+{
+public:
+    SkeletonSolution(TriMesh &mesh, ConsoleMessageManager &msg);
+    ~SkeletonSolution();
+
+    void skeletonize();
+
+private:
+    using SpMat = Eigen::SparseMatrix<double>;
+
+    ConsoleMessageManager &msg_;
+    TextConfigLoader tcl_;
+    TriMesh &mesh_;
+
+    int n_vertices;
+    int n_edges;
+    int n_faces;
+
+    Eigen::MatrixX3d positions;
+    Eigen::SimplicialLDLT<SpMat> solver_;
+
+    void Factorize_Normal_Equations(const MeshLaplacian &lap, double w, bool analyze);
+    void Contract(double w);
+    void Write_Back();
+};
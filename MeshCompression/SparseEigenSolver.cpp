@@ -0,0 +1,151 @@
+#include "stdafx.h"
+#include "SparseEigenSolver.h"
+#include <Eigen/Eigenvalues>
+#include <Eigen/SparseCholesky>
+
+using Eigen::VectorXd;
+using Eigen::MatrixXd;
+using SpMat = Eigen::SparseMatrix<double>;
+using RowBlock = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// X -= B (B^T X), B orthonormal, twice for stability; a block at once.
+static void _orthogonalize(const Eigen::Ref<const MatrixXd> &B, Eigen::Ref<MatrixXd> X)
+{
+    if (B.cols() == 0)
+        return;
+    for (int pass = 0; pass < 2; ++pass)
+        X -= B * (B.transpose() * X);
+}
+
+// LDLT^-1 B, the right-hand sides together: each entry of L is read once for
+// all of them (SimplicialLDLT::solve runs over L once per column).
+static MatrixXd _solve_block(const Eigen::SimplicialLDLT<SpMat> &solver, const MatrixXd &B)
+{
+    const SpMat &L = solver.matrixL().nestedExpression();
+    const int N = static_cast<int>(L.cols());
+    const int b = static_cast<int>(B.cols());
+    RowBlock Y = solver.permutationP() * B;
+    // L y = x, by columns of L; unit diagonal.
+    for (int j = 0; j < N; ++j)
+    {
+        const double *yj = &Y(j, 0);
+        for (SpMat::InnerIterator it(L, j); it; ++it)
+        {
+            if (it.index() <= j)
+                continue;
+            double *yi = &Y(it.index(), 0);
+            for (int c = 0; c < b; ++c)
+                yi[c] -= it.value() * yj[c];
+        }
+    }
+    Y = solver.vectorD().cwiseInverse().asDiagonal() * Y;
+    // L^T z = y, backwards.
+    for (int j = N - 1; j >= 0; --j)
+    {
+        double *yj = &Y(j, 0);
+        for (SpMat::InnerIterator it(L, j); it; ++it)
+        {
+            if (it.index() <= j)
+                continue;
+            const double *yi = &Y(it.index(), 0);
+            for (int c = 0; c < b; ++c)
+                yj[c] -= it.value() * yi[c];
+        }
+    }
+    return solver.permutationPinv() * Y;
+}
+
+bool SmallestEigenpairs(const SpMat& K, const VectorXd& M, int n,
+    VectorXd& values, MatrixXd& vectors, const MatrixXd* deflate, double tol)
+{
+    const int N = static_cast<int>(K.rows());
+    const int n_deflate = deflate != nullptr ? static_cast<int>(deflate->cols()) : 0;
+    n = std::min(n, N - n_deflate);
+    if (n <= 0)
+        return false;
+
+    // sigma: a little below 0, relative to the scale of K / M.
+    double scale = 0.0;
+    for (int i = 0; i < N; ++i)
+        scale += K.coeff(i, i) / M[i];
+    const double sigma = -1e-6 * scale / N;
+    SpMat shifted = K;
+    for (int i = 0; i < N; ++i)
+        shifted.coeffRef(i, i) -= sigma * M[i];
+    Eigen::SimplicialLDLT<SpMat> solver(shifted);
+    if (solver.info() != Eigen::Success)
+        return false;
+    const VectorXd M_sqrt = M.cwiseSqrt();
+    // deflated vectors in the symmetric form, orthonormal.
+    MatrixXd D;
+    if (n_deflate > 0)
+        D = M_sqrt.asDiagonal() * (*deflate);
+
+    const int b = std::min(8, n);   // block size, multiplicity it resolves at once.
+    const int cap = std::min(N - n_deflate, std::max(10 * n, n + 100));
+    MatrixXd V(N, cap);             // orthonormal Krylov basis.
+    MatrixXd H = MatrixXd::Zero(cap, cap);
+    MatrixXd X = MatrixXd::Random(N, b);   // the next block, orthogonal to V.
+    _orthogonalize(D, X);
+    int cols = 0;
+    VectorXd theta;
+    MatrixXd S;
+    while (true)
+    {
+        // STEP 1:  Orthonormalize the next block's columns against each other.
+        const int room = std::min(static_cast<int>(X.cols()), cap - cols);
+        if (room <= 0)
+            break;
+        int added = 0;
+        for (int c = 0; c < room; ++c)
+        {
+            VectorXd x = X.col(c);
+            _orthogonalize(V.middleCols(cols, added), x);
+            for (int attempt = 0; attempt < 3 && x.norm() <= 1e-10; ++attempt)
+            {
+                x = VectorXd::Random(N);    // the Krylov space is invariant here.
+                _orthogonalize(D, x);
+                _orthogonalize(V.leftCols(cols + added), x);
+            }
+            V.col(cols + added) = x.normalized();
+            ++added;
+        }
+
+        // STEP 2:  One solve for the block, and the new part of H = V^T op(V).
+        MatrixXd block = M_sqrt.asDiagonal() * V.middleCols(cols, added);
+        MatrixXd solved = _solve_block(solver, block);
+        solved = M_sqrt.asDiagonal() * solved;
+        _orthogonalize(D, solved);
+        MatrixXd h = V.leftCols(cols + added).transpose() * solved;
+        H.block(0, cols, cols + added, added) = h;
+        H.block(cols, 0, added, cols + added) = h.transpose();
+        cols += added;
+        // the next block, against the basis all of it at once.
+        X = solved;
+        _orthogonalize(V.leftCols(cols), X);
+
+        // STEP 3:  Ritz pairs, and their residuals op(y) - theta y: op of all
+        //          but the last block is in the span of V, so only the part of
+        //          the last one outside it counts, the next block.
+        if (cols < n + b && cols < cap)
+            continue;
+        Eigen::SelfAdjointEigenSolver<MatrixXd> es(H.topLeftCorner(cols, cols));
+        const int k = std::min(n, cols);
+        theta = es.eigenvalues().tail(k).reverse();     // largest first.
+        S = es.eigenvectors().rightCols(k).rowwise().reverse();
+        MatrixXd R = X * S.bottomRows(added);
+        double worst = 0.0;
+        for (int i = 0; i < k; ++i)
+            worst = std::max(worst, R.col(i).norm() / std::abs(theta[i]));
+        if (worst < tol || cols >= cap)
+            break;
+    }
+
+    // back to K x = lambda M x, smallest lambda (largest theta) first.
+    const int k = static_cast<int>(theta.size());
+    values.resize(k);
+    for (int i = 0; i < k; ++i)
+        values[i] = sigma + 1.0 / theta[i];
+    vectors = M_sqrt.cwiseInverse().asDiagonal() * (V.leftCols(cols) * S);
+    return true;
+}
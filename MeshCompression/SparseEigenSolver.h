@@ -0,0 +1,19 @@
+#pragma once
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+
+// Smallest n eigenpairs of the generalized problem  K x = lambda M x,
+// K sparse symmetric positive semi-definite, M diagonal positive (lumped).
+//
+// Shift-invert block Lanczos: with A = M^-1/2 K M^-1/2 the largest
+// eigenvalues of (A - sigma I)^-1 are the ones of A closest to sigma < 0,
+// a block product is one multi-right-hand-side solve with the LDLT of
+// K - sigma M, factorized once. Blocks find repeated eigenvalues (symmetric
+// shapes have many), the basis is fully reorthogonalized and grown until the
+// wanted Ritz pairs have residual below tol.
+// `deflate` (M-orthonormal columns, e.g. known null vectors) is kept out of
+// the search space. Eigenvalues ascending, vectors M-orthonormal.
+// Returns false if K - sigma M cannot be factorized.
+bool SmallestEigenpairs(const Eigen::SparseMatrix<double> &K, const Eigen::VectorXd &M, int n,
+    Eigen::VectorXd &values, Eigen::MatrixXd &vectors,
+    const Eigen::MatrixXd *deflate = nullptr, double tol = 1e-8);
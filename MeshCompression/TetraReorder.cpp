@@ -0,0 +1,154 @@
+#include "stdafx.h"
+#include "TetraReorder.h"
+#include <algorithm>
+#include <numeric>
+
+using OpenMesh::Vec3f;
+
+// spread the lower 10 bits of v to every third bit.
+static unsigned int _expand_bits(unsigned int v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// 30 bits Morton code of p in the box [lo, lo + ext].
+static unsigned int _morton(const Vec3f &p, const Vec3f &lo, const Vec3f &ext)
+{
+    unsigned int c[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        float u = ext[i] > 0.0f ? (p[i] - lo[i]) / ext[i] : 0.0f;
+        c[i] = static_cast<unsigned int>(std::min(std::max(u * 1024.0f, 0.0f), 1023.0f));
+    }
+    return (_expand_bits(c[0]) << 2) | (_expand_bits(c[1]) << 1) | _expand_bits(c[2]);
+}
+
+void ReorderTetra(TetraMesh &tmesh)
+{
+    if (tmesh.n_vertices <= 0)
+        return;
+
+    Vec3f lo = tmesh.point[0];
+    Vec3f hi = tmesh.point[0];
+    for (auto &p : tmesh.point)
+    {
+        lo.minimize(p);
+        hi.maximize(p);
+    }
+    Vec3f ext = hi - lo;
+
+    // STEP 1:  Interior vertices, old index of the i-th new one.
+    std::vector<int> order(tmesh.n_vertices);
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<unsigned int> code(tmesh.n_vertices);
+    for (int vi = tmesh.n_vertices_boundary; vi < tmesh.n_vertices; ++vi)
+        code[vi] = _morton(tmesh.point[vi], lo, ext);
+    std::stable_sort(order.begin() + tmesh.n_vertices_boundary, order.end(),
+        [&code](int a, int b) { return code[a] < code[b]; });
+
+    std::vector<int> new_index(tmesh.n_vertices);
+    std::vector<Vec3f> point(tmesh.n_vertices);
+    for (int i = 0; i < tmesh.n_vertices; ++i)
+    {
+        new_index[order[i]] = i;
+        point[i] = tmesh.point[order[i]];
+    }
+    tmesh.point = point;
+
+    for (auto &f : tmesh.face_vertices)
+        for (auto &v : f)
+            v = new_index[v];
+    for (auto &t : tmesh.tetra_vertices)
+        for (auto &v : t)
+            v = new_index[v];
+
+    // STEP 2:  Tetras by their centroid.
+    std::vector<std::pair<unsigned int, int>> tetra_code(tmesh.n_tetras);
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+    {
+        auto &tvs = tmesh.tetra_vertices[ti];
+        Vec3f c = 0.25f * (tmesh.point[tvs[0]] + tmesh.point[tvs[1]] + tmesh.point[tvs[2]] + tmesh.point[tvs[3]]);
+        tetra_code[ti] = { _morton(c, lo, ext), ti };
+    }
+    std::stable_sort(tetra_code.begin(), tetra_code.end());
+    std::vector<std::array<int, 4>> tetra_vertices(tmesh.n_tetras);
+    for (int ti = 0; ti < tmesh.n_tetras; ++ti)
+        tetra_vertices[ti] = tmesh.tetra_vertices[tetra_code[ti].second];
+    tmesh.tetra_vertices = tetra_vertices;
+}
+
+TetraOrderStat MeasureTetraOrder(const TetraMesh &tmesh)
+{
+    TetraOrderStat stat{ 0.0, 0.0, 0.0 };
+    if (tmesh.n_tetras <= 0)
+        return stat;
+
+    // index span
+    for (auto &tvs : tmesh.tetra_vertices)
+    {
+        auto mm = std::minmax_element(tvs.begin(), tvs.end());
+        stat.avg_index_span += *mm.second - *mm.first;
+    }
+    stat.avg_index_span /= tmesh.n_tetras;
+
+    // LRU cache simulation of the point reads.
+    const int n_sets = 64;
+    const int n_ways = 8;
+    std::vector<long long> tag(n_sets * n_ways, -1);
+    std::vector<long long> used(n_sets * n_ways, 0);
+    long long clock = 0;
+    long long misses = 0;
+    for (auto &tvs : tmesh.tetra_vertices)
+    {
+        for (auto vi : tvs)
+        {
+            long long line = static_cast<long long>(vi) * sizeof(Vec3f) / 64;
+            int set = static_cast<int>(line % n_sets);
+            int victim = set * n_ways;
+            bool hit = false;
+            for (int w = set * n_ways; w < (set + 1) * n_ways; ++w)
+            {
+                if (tag[w] == line)
+                {
+                    used[w] = ++clock;
+                    hit = true;
+                    break;
+                }
+                if (used[w] < used[victim])
+                    victim = w;
+            }
+            if (!hit)
+            {
+                ++misses;
+                tag[victim] = line;
+                used[victim] = ++clock;
+            }
+        }
+    }
+    stat.misses_per_tetra = static_cast<double>(misses) / tmesh.n_tetras;
+
+    // the gather every simulator does.
+    const int repeat = 10;
+    float sum = 0.0f;
+    QElapsedTimer timer;
+    timer.start();
+    for (int r = 0; r < repeat; ++r)
+    {
+        for (auto &tvs : tmesh.tetra_vertices)
+        {
+            Vec3f x = tmesh.point[tvs[1]] - tmesh.point[tvs[0]];
+            Vec3f y = tmesh.point[tvs[2]] - tmesh.point[tvs[0]];
+            Vec3f z = tmesh.point[tvs[3]] - tmesh.point[tvs[0]];
+            sum += x | (y % z);
+        }
+    }
+    stat.ns_per_tetra = static_cast<double>(timer.nsecsElapsed()) / repeat / tmesh.n_tetras;
+    // keep the loop.
+    volatile float keep = sum;
+    (void)keep;
+    return stat;
+}
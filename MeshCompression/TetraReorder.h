@@ -0,0 +1,19 @@
+#pragma once
+#include "OpenGLMesh.h"
+
+// Reorder a TetraMesh for cache locality of the per-tetra vertex gathers.
+//
+// Interior vertices are sorted along a Morton (Z-order) curve of their
+// position, tetras along the curve of their centroid. Boundary vertices keep
+// their indices, they are the TriMesh vertices and stay in front of the
+// interior ones. face_vertices and tetra_vertices are remapped.
+void ReorderTetra(TetraMesh &tmesh);
+
+// Cost of gathering the 4 vertices of every tetra in storage order.
+struct TetraOrderStat
+{
+    double avg_index_span;          // mean of (max - min) vertex index of a tetra.
+    double misses_per_tetra;        // simulated 32KB 8-way L1, 64B lines, 12B points.
+    double ns_per_tetra;            // measured, Ds of every tetra.
+};
+TetraOrderStat MeasureTetraOrder(const TetraMesh &tmesh);
@@ -1,71 +1,123 @@
 #include "stdafx.h"
-//
-//#include "TetrahedralizationSolution.h"
-//
-//bool TetrahedralizationSolution::tetra()
-//{
-//    tetgenio in, out;
-//    tetgenio::facet *f;
-//    tetgenio::polygon *p;
-//
-//    // All indices start from 1.
-//    in.firstnumber = 0;
-//
-//    in.numberofpoints = mesh_.n_vertices();
-//    in.pointlist = new REAL[in.numberofpoints * 3];
-//    for (auto v_it : mesh_.vertices())
-//    {
-//        auto point = mesh_.point(v_it);
-//        in.pointlist[v_it.idx() * 3 + 0] = point[0];
-//        in.pointlist[v_it.idx() * 3 + 1] = point[1];
-//        in.pointlist[v_it.idx() * 3 + 2] = point[2];
-//    }
-//
-//    in.numberoffacets = mesh_.n_faces();
-//
-//    in.facetlist = new tetgenio::facet[in.numberoffacets];
-//    in.facetmarkerlist = new int[in.numberoffacets];
-//
-//    for (auto f_it : mesh_.faces())
-//    {
-//        f = &in.facetlist[f_it.idx()];
-//        f->numberofpolygons = 1;
-//        f->polygonlist = new tetgenio::polygon[f->numberofpolygons];
-//        f->numberofholes = 0;
-//        f->holelist = NULL;
-//        p = &f->polygonlist[0];
-//        p->numberofvertices = 3;
-//        p->vertexlist = new int[p->numberofvertices];
-//
-//        in.facetmarkerlist[f_it.idx()] = 0;
-//
-//        auto fv_it = mesh_.cfv_iter(f_it);
-//        int i = 0;
-//        for (; fv_it; ++fv_it)
-//        {
-//            p->vertexlist[i++] = fv_it->idx();
-//        }
-//    }
-//   
-//
-//    // Tetrahedralize the PLC. Switches are chosen to read a PLC (p),
-//    //   do quality mesh generation (q) with a specified quality bound
-//    //   (1.414), and apply a maximum volume constraint (a0.1).
-//
-//    tetrahedralize("pq2.5", &in, &out);
-//
-//    in.save_nodes(name_ori_);
-//    in.save_poly(name_ori_);
-//
-//    out.save_nodes(name_);
-//    out.save_elements(name_);
-//    out.save_faces(name_);
-//
-//    return true;
-//}
-//
-//TetrahedralizationSolution::~TetrahedralizationSolution()
-//{
-//    delete[] name_;
-//    delete[] name_ori_;
-//}
+#include "TetrahedralizationSolution.h"
+#include "MeshLaplacian.h"
+#include "GlobalConfig.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <atomic>
+#include <mutex>
+#if USE_TETGEN
+#define TETLIBRARY
+#include <tetgen.h>
+
+// TetGen's exact predicates keep their filter bounds in globals, set from
+// each input's box: one tetrahedralize() at a time.
+static std::mutex _tetgen_mutex;
+#endif
+
+// .ele last: it being there means the others are.
+static const char *_extensions[] = { ".node", ".face", ".ele" };
+
+TetrahedralizationSolution::TetrahedralizationSolution(const TriMesh& unified, const QString& switches) :
+    mesh_(unified), switches_(switches)
+{
+    quint64 key = MeshHash(mesh_);
+    QByteArray bytes = switches_.toUtf8();
+    for (int i = 0; i < bytes.size(); ++i)
+    {
+        key ^= static_cast<uchar>(bytes[i]);
+        key *= 1099511628211ULL;
+    }
+    name_ = QString("./cache/tetra/%0").arg(key, 16, 16, QChar('0'));
+}
+
+bool TetrahedralizationSolution::cached() const
+{
+    return QFileInfo(name_ + ".ele").isFile();
+}
+
+bool TetrahedralizationSolution::tetra()
+{
+#if USE_TETGEN
+    tetgenio in, out;
+
+    // All indices start from 0.
+    in.firstnumber = 0;
+    in.numberofpoints = mesh_.n_vertices();
+    in.pointlist = new REAL[in.numberofpoints * 3];
+    for (auto v_it : mesh_.vertices())
+    {
+        auto point = mesh_.point(v_it);
+        for (int c = 0; c < 3; ++c)
+            in.pointlist[v_it.idx() * 3 + c] = point[c];
+    }
+
+    in.numberoffacets = mesh_.n_faces();
+    in.facetlist = new tetgenio::facet[in.numberoffacets];
+    in.facetmarkerlist = new int[in.numberoffacets];
+    for (auto f_it : mesh_.faces())
+    {
+        tetgenio::facet *f = &in.facetlist[f_it.idx()];
+        f->numberofpolygons = 1;
+        f->polygonlist = new tetgenio::polygon[f->numberofpolygons];
+        f->numberofholes = 0;
+        f->holelist = NULL;
+        tetgenio::polygon *p = &f->polygonlist[0];
+        p->numberofvertices = 3;
+        p->vertexlist = new int[p->numberofvertices];
+        in.facetmarkerlist[f_it.idx()] = 0;
+        int i = 0;
+        for (auto fv_it = mesh_.cfv_iter(f_it); fv_it.is_valid(); ++fv_it)
+            p->vertexlist[i++] = fv_it->idx();
+    }
+
+    QByteArray switches = switches_.toLatin1();
+    try
+    {
+        std::lock_guard<std::mutex> lock(_tetgen_mutex);
+        tetrahedralize(switches.data(), &in, &out);
+    }
+    catch (int)
+    {
+        // TetGen throws its error code.
+        return false;
+    }
+    if (out.numberoftetrahedra == 0)
+        return false;
+
+    // written under a name of its own, then moved in: a half written result
+    // is never read, and two jobs on the same surface do not collide.
+    static std::atomic<int> job{ 0 };
+    QDir().mkpath(QFileInfo(name_).path());
+    QString temp = name_ + QString(".tmp%0").arg(job++);
+    QByteArray temp_bytes = temp.toLocal8Bit();
+    out.save_nodes(temp_bytes.data());
+    out.save_faces(temp_bytes.data());
+    out.save_elements(temp_bytes.data());
+    for (auto ext : _extensions)
+    {
+        QFile::remove(name_ + ext);
+        if (!QFile::rename(temp + ext, name_ + ext))
+            return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::shared_future<QString> CachedTetrahedralization(const TriMesh& unified, const QString& switches)
+{
+    auto ts = std::make_shared<TetrahedralizationSolution>(unified, switches);
+    if (ts->cached())
+    {
+        std::promise<QString> hit;
+        hit.set_value(ts->cache_name());
+        return hit.get_future().share();
+    }
+    return std::async(std::launch::async, [ts]()
+    {
+        return ts->tetra() ? ts->cache_name() : QString();
+    }).share();
+}
@@ -1,31 +1,32 @@
 #pragma once
-//#include "OpenMeshBasic.h"
-//#define TETLIBRARY
-//#include <tetgen.h> 
-//#include <string>
-//#include <cstring>
-//
-//#define TETRA_ELE_EXTENSION ".ele"
-//
-//class TetrahedralizationSolution 
-//{
-//public:
-//    TetrahedralizationSolution() = delete;
-//    TetrahedralizationSolution(const TriMesh &mesh, const std::string &name) 
-//        : mesh_(mesh)
-//    {
-//        name_ = new char[name.size() + 1];
-//        name_ori_ = new char[name.size() + 1 + 4]; // + ".ori"
-//        strcpy_s(name_, name.size() + 1, name.c_str());
-//        strcpy_s(name_ori_, name.size() + 1 + 4, name.c_str());
-//        strcat_s(name_ori_, name.size() + 1 + 4, ".ori");
-//    }
-//    bool tetra();
-//    ~TetrahedralizationSolution();
+#include "OpenMeshBasic.h"
+#include <QString>
+#include <future>
+
+// TetGen on a closed surface, in process, written as the .node, .face and
+// .ele files OpenGLMesh::ReadTetra reads.
 //
-//private:
-//    const TriMesh &mesh_;
-//    char *name_;
-//    char *name_ori_;
-//};
+// The surface is taken unified (height 1, centered), as the tetra/ files
+// always were. Results are content addressed, ./cache/tetra/<hash> by the
+// points, the faces and the switches, so a surface is tetrahedralized once
+// whatever its file is called. Without USE_TETGEN only the cache is read.
+class TetrahedralizationSolution
+{
+public:
+    TetrahedralizationSolution(const TriMesh &unified, const QString &switches);
+
+    // base name of the files, there or not yet.
+    QString cache_name() const { return name_; }
+    bool cached() const;
+    // run TetGen and store the files; false without TetGen or if it fails.
+    bool tetra();
+
+private:
+    TriMesh mesh_;
+    QString switches_;
+    QString name_;
+};
 
+// The base name of the tetra files of `unified`: from the cache at once,
+// else tetrahedralized on a worker thread; empty if that fails.
+std::shared_future<QString> CachedTetrahedralization(const TriMesh &unified, const QString &switches);
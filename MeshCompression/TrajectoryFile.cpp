@@ -0,0 +1,220 @@
+#include "stdafx.h"
+#include "TrajectoryFile.h"
+#include <cstring>
+#include <cmath>
+
+#define FRAME_KEY       0
+#define FRAME_DELTA     1
+#define FRAME_HEAD_SIZE (sizeof(double) + sizeof(quint8) + sizeof(quint32))
+
+static void _put_varint(std::vector<char> &b, qint32 v)
+{
+    quint32 z = (static_cast<quint32>(v) << 1) ^ static_cast<quint32>(v >> 31);
+    while (z >= 0x80)
+    {
+        b.push_back(static_cast<char>(z | 0x80));
+        z >>= 7;
+    }
+    b.push_back(static_cast<char>(z));
+}
+
+// reads nothing past `end`: a truncated varint decodes as what was read.
+static qint32 _get_varint(const uchar *&p, const uchar *end)
+{
+    quint32 z = 0;
+    int shift = 0;
+    while (p < end && (*p & 0x80) && shift < 28)
+    {
+        z |= static_cast<quint32>(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    if (p < end)
+        z |= static_cast<quint32>(*p++) << shift;
+    return static_cast<qint32>(z >> 1) ^ -static_cast<qint32>(z & 1);
+}
+
+bool TrajectoryRecorder::open(const QString& filename, int n_vertices, int keyframe_interval, float quant_step)
+{
+    close();
+    file_.setFileName(filename);
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    std::memcpy(header_.magic, "TRJ1", 4);
+    header_.n_vertices = n_vertices;
+    header_.keyframe_interval = std::max(keyframe_interval, 1);
+    header_.quant_step = quant_step;
+    header_.n_frames = 0;
+    header_.reserved = 0;
+    header_.index_offset = 0;
+    file_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+
+    n_frames_ = 0;
+    offsets_.clear();
+    last_ = std::vector<Vector3f>(n_vertices, { 0,0,0 });
+    return true;
+}
+
+void TrajectoryRecorder::write(double t, const std::vector<Vector3f>& position)
+{
+    if (!is_open() || static_cast<int>(position.size()) < header_.n_vertices)
+        return;
+
+    quint8 type = n_frames_ % header_.keyframe_interval == 0 ? FRAME_KEY : FRAME_DELTA;
+    buffer_.clear();
+    if (type == FRAME_KEY)
+    {
+        buffer_.resize(header_.n_vertices * 3 * sizeof(float));
+        for (int vi = 0; vi < header_.n_vertices; ++vi)
+        {
+            std::memcpy(&buffer_[vi * 3 * sizeof(float)], position[vi].data(), 3 * sizeof(float));
+            last_[vi] = position[vi];
+        }
+    }
+    else
+    {
+        // quantize against the reconstruction, so the error does not accumulate.
+        const float inv_step = 1.0f / header_.quant_step;
+        for (int vi = 0; vi < header_.n_vertices; ++vi)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                qint32 q = static_cast<qint32>(std::lround((position[vi][i] - last_[vi][i]) * inv_step));
+                last_[vi][i] += q * header_.quant_step;
+                _put_varint(buffer_, q);
+            }
+        }
+    }
+
+    offsets_.push_back(file_.pos());
+    quint32 size = static_cast<quint32>(buffer_.size());
+    file_.write(reinterpret_cast<const char *>(&t), sizeof(t));
+    file_.write(reinterpret_cast<const char *>(&type), sizeof(type));
+    file_.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    file_.write(buffer_.data(), buffer_.size());
+    ++n_frames_;
+}
+
+void TrajectoryRecorder::close()
+{
+    if (!is_open())
+        return;
+
+    header_.n_frames = n_frames_;
+    header_.index_offset = file_.pos();
+    if (!offsets_.empty())
+        file_.write(reinterpret_cast<const char *>(offsets_.data()), offsets_.size() * sizeof(qint64));
+    file_.seek(0);
+    file_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+    file_.close();
+}
+
+bool TrajectoryPlayer::open(const QString& filename)
+{
+    close();
+    file_.setFileName(filename);
+    if (!file_.open(QIODevice::ReadOnly))
+        return false;
+    size_ = file_.size();
+    if (size_ < static_cast<qint64>(sizeof(TrajectoryHeader)))
+    {
+        file_.close();
+        return false;
+    }
+    data_ = file_.map(0, size_);
+    if (data_ == nullptr)
+    {
+        file_.close();
+        return false;
+    }
+
+    std::memcpy(&header_, data_, sizeof(header_));
+    const qint64 head_size = static_cast<qint64>(sizeof(TrajectoryHeader));
+    if (std::memcmp(header_.magic, "TRJ1", 4) != 0 ||
+        header_.n_frames <= 0 || header_.keyframe_interval <= 0 || header_.n_vertices < 0 ||
+        header_.index_offset < head_size || header_.index_offset > size_ ||
+        (size_ - header_.index_offset) / static_cast<qint64>(sizeof(qint64)) < header_.n_frames)
+    {
+        close();
+        return false;
+    }
+    index_ = reinterpret_cast<const qint64 *>(data_ + header_.index_offset);
+
+    // every frame has to lie between the header and the index, keyframes in full.
+    const qint64 key_size = static_cast<qint64>(header_.n_vertices) * 3 * sizeof(float);
+    for (int fi = 0; fi < header_.n_frames; ++fi)
+    {
+        qint64 offset = index_[fi];
+        if (offset < head_size || offset > header_.index_offset - static_cast<qint64>(FRAME_HEAD_SIZE))
+        {
+            close();
+            return false;
+        }
+        quint8 type;
+        quint32 size;
+        std::memcpy(&type, data_ + offset + sizeof(double), sizeof(quint8));
+        std::memcpy(&size, data_ + offset + sizeof(double) + sizeof(quint8), sizeof(quint32));
+        if (offset + static_cast<qint64>(FRAME_HEAD_SIZE) + size > header_.index_offset ||
+            (type == FRAME_KEY && size != key_size) ||
+            (type != FRAME_KEY && type != FRAME_DELTA) ||
+            (fi % header_.keyframe_interval == 0 && type != FRAME_KEY))
+        {
+            close();
+            return false;
+        }
+    }
+    decoded_ = -1;
+    current_ = std::vector<Vector3f>(header_.n_vertices, { 0,0,0 });
+    return true;
+}
+
+void TrajectoryPlayer::close()
+{
+    if (data_ != nullptr)
+        file_.unmap(data_);
+    data_ = nullptr;
+    decoded_ = -1;
+    if (file_.isOpen())
+        file_.close();
+}
+
+bool TrajectoryPlayer::frame(int fi, double& t, std::vector<Vector3f>& position)
+{
+    if (!is_open() || fi < 0 || fi >= header_.n_frames)
+        return false;
+
+    // go on from the decoded frame, or from the last keyframe.
+    int key = fi - fi % header_.keyframe_interval;
+    int begin = (decoded_ >= key && decoded_ <= fi) ? decoded_ + 1 : key;
+    for (int i = begin; i <= fi; ++i)
+        decode(i);
+
+    t = t_;
+    position = current_;
+    return true;
+}
+
+void TrajectoryPlayer::decode(int fi)
+{
+    const uchar *p = data_ + index_[fi];
+    quint8 type;
+    quint32 size;
+    std::memcpy(&t_, p, sizeof(double));
+    std::memcpy(&type, p + sizeof(double), sizeof(quint8));
+    std::memcpy(&size, p + sizeof(double) + sizeof(quint8), sizeof(quint32));
+    p += FRAME_HEAD_SIZE;
+    const uchar *end = p + size;
+
+    if (type == FRAME_KEY)
+    {
+        for (int vi = 0; vi < header_.n_vertices; ++vi)
+            std::memcpy(current_[vi].data(), p + vi * 3 * sizeof(float), 3 * sizeof(float));
+    }
+    else
+    {
+        for (int vi = 0; vi < header_.n_vertices; ++vi)
+            for (int i = 0; i < 3; ++i)
+                current_[vi][i] += _get_varint(p, end) * header_.quant_step;
+    }
+    decoded_ = fi;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "SimulatorBase.h"
+#include <QFile>
+
+// Binary trajectory of the simulated tetra vertices, all bodies in global order.
+//
+// Layout (native little-endian):
+//   header    TrajectoryHeader, 32 bytes
+//   frames    double t, uint8 type, uint32 size, payload
+//             KEY:   n_vertices * 3 floats
+//             DELTA: n_vertices * 3 zigzag varints, quantized differences
+//                    to the previous (reconstructed) frame
+//   index     int64 offset of every frame
+// A keyframe is written every `keyframe_interval` frames, so playback can
+// seek to any frame decoding at most that many deltas.
+struct TrajectoryHeader
+{
+    char    magic[4];               // "TRJ1"
+    int     n_vertices;
+    int     keyframe_interval;
+    float   quant_step;             // length of one quantization step.
+    int     n_frames;
+    int     reserved;
+    qint64  index_offset;
+};
+
+class TrajectoryRecorder
+{
+public:
+    TrajectoryRecorder() : n_frames_(0) {  }
+    ~TrajectoryRecorder() { close(); }
+    bool open(const QString &filename, int n_vertices, int keyframe_interval, float quant_step);
+    void write(double t, const std::vector<Vector3f> &position);
+    void close();
+    bool is_open() const { return file_.isOpen(); }
+    int  n_frames() const { return n_frames_; }
+
+private:
+    QFile file_;
+    TrajectoryHeader header_;
+    int n_frames_;
+    std::vector<Vector3f> last_;    // what the player will reconstruct.
+    std::vector<qint64> offsets_;
+    std::vector<char> buffer_;
+};
+
+// A recorded sequence of tetra vertex positions.
+class FramePlayer
+{
+public:
+    virtual ~FramePlayer() {  }
+    virtual bool open(const QString &filename) = 0;
+    virtual void close() = 0;
+    virtual bool is_open() const = 0;
+    virtual int  n_frames() const = 0;
+    virtual int  n_vertices() const = 0;
+    virtual bool frame(int fi, double &t, std::vector<Vector3f> &position) = 0;
+};
+
+class TrajectoryPlayer : public FramePlayer
+{
+public:
+    TrajectoryPlayer() : data_(nullptr), decoded_(-1) {  }
+    ~TrajectoryPlayer() override { close(); }
+    bool open(const QString &filename) override;
+    void close() override;
+    bool is_open() const override { return data_ != nullptr; }
+    int  n_frames() const override { return data_ == nullptr ? 0 : header_.n_frames; }
+    int  n_vertices() const override { return header_.n_vertices; }
+    // decode frame fi, sequential playback decodes a single delta per frame.
+    bool frame(int fi, double &t, std::vector<Vector3f> &position) override;
+
+private:
+    void decode(int fi);
+
+    QFile file_;
+    uchar *data_;                   // the whole mapped file.
+    qint64 size_;
+    TrajectoryHeader header_;
+    const qint64 *index_;
+    int decoded_;                   // frame held in current_.
+    double t_;
+    std::vector<Vector3f> current_;
+};
@@ -0,0 +1,48 @@
+#include "stdafx.h"
+#include "TriangleGeometry.h"
+
+using Eigen::Vector3f;
+
+// Ericson, Real-Time Collision Detection, 5.1.5.
+Vector3f ClosestBarycentric(const Vector3f &p, const Vector3f &a, const Vector3f &b, const Vector3f &c)
+{
+    Vector3f ab = b - a;
+    Vector3f ac = c - a;
+    Vector3f ap = p - a;
+    float d1 = ab.dot(ap);
+    float d2 = ac.dot(ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return{ 1.0f, 0.0f, 0.0f };
+    Vector3f bp = p - b;
+    float d3 = ab.dot(bp);
+    float d4 = ac.dot(bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return{ 0.0f, 1.0f, 0.0f };
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    {
+        float v = d1 / (d1 - d3);
+        return{ 1.0f - v, v, 0.0f };
+    }
+    Vector3f cp = p - c;
+    float d5 = ab.dot(cp);
+    float d6 = ac.dot(cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return{ 0.0f, 0.0f, 1.0f };
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    {
+        float w = d2 / (d2 - d6);
+        return{ 1.0f - w, 0.0f, w };
+    }
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+    {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        return{ 0.0f, 1.0f - w, w };
+    }
+    float denom = 1.0f / (va + vb + vc);
+    float v = vb * denom;
+    float w = vc * denom;
+    return{ 1.0f - v - w, v, w };
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <Eigen/Core>
+
+// Barycentric coordinates of the point on triangle abc closest to p.
+Eigen::Vector3f ClosestBarycentric(const Eigen::Vector3f &p,
+    const Eigen::Vector3f &a, const Eigen::Vector3f &b, const Eigen::Vector3f &c);
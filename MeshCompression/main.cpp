@@ -2,9 +2,23 @@
 #include "meshprogram.h"
 #include <QtWidgets/QApplication>
 #include "TextConfigLoader.h"
+#include "HeadlessRunner.h"
+#include "BatchOffset.h"
+#include <iostream>
 
 int main(int argc, char *argv[])
 {
+    // no window, just run a simulator and report its performance.
+    if (argc > 1 && QString(argv[1]) == "--headless")
+        return RunHeadless(argc, argv);
+    // no window, the offset of every pair of a manifest.
+    if (argc > 2 && QString(argv[1]) == "--batch")
+    {
+        QCoreApplication a(argc, argv);
+        ConsoleMessageManager msg(std::cout);
+        return RunBatchOffset(argv[2], msg) ? 0 : 1;
+    }
+
     TextConfigLoader gui_config{ "./config/gui.config" };
     auto global_font = gui_config.get_string("Global_Font");
 
@@ -9,8 +9,17 @@
 
 #include "GlobalConfig.h"
 #include "SimulatorSimpleSpring_Midpoint.h"
+#include "SimulatorProjectiveDynamics.h"
+#include "SimulatorCorotationalFEM.h"
+#include "SimulatorXPBD.h"
+#include "TetraReorder.h"
+#include "HeadlessRunner.h"
 #include "SkeletonSolution.h"
 #include "OffsetSolution.h"
+#include "MassMoments.h"
+#include "BatchOffset.h"
+#include "MassPropertySolution.h"
+#include "MeshBVH.h"
 //#include "PsudoColorRGB.h"
 
 #define updateGL update
@@ -66,6 +75,11 @@ RenderingWidget::RenderingWidget(QWidget *parent, MainWindow* mainwindow) :
     scene(msg),
     light_dir_fix_(false),
     sim(nullptr),
+    sim_thread_(nullptr),
+    sim_frame_time_(0.0),
+    sim_fixed_dt_(0.0),
+    play_frame_(0),
+    play_time_(0.0),
     render_config{ "./config/render.config" },
     shader_config{ "./config/shader.config" }
 {
@@ -97,6 +111,7 @@ RenderingWidget::RenderingWidget(QWidget *parent, MainWindow* mainwindow) :
 
 RenderingWidget::~RenderingWidget()
 {
+    StopSimulation();
     SafeDelete(timer);
     makeCurrent();
     vbo->destroy();
@@ -301,6 +316,16 @@ void RenderingWidget::paintGL()
 {
     msg.log(QString("printGL()"), TRIVIAL_MSG);
 
+    // Take the latest frame of the simulation thread, if there is a new one.
+    if (sim_thread_ != nullptr && sim_thread_->frames().consume())
+    {
+        auto &frame = sim_thread_->frames().front();
+        sim->apply_position(frame.position);
+        sim_frame_time_ = frame.t;
+        if (recorder_.is_open())
+            recorder_.write(frame.t, frame.position);
+    }
+
     // OpenGL work.
     glDisable(GL_CULL_FACE);
     glDisable(GL_DEPTH_TEST);
@@ -353,6 +378,7 @@ void RenderingWidget::paintGL()
             vbo_basic_buffer_.clear();
             Render_Indication();
             Render_Skeleton();
+            Render_MassProperties();
             Render_Axes();
             basic_buffer_changed = false;
         }
@@ -480,10 +506,16 @@ void RenderingWidget::paintGL()
     painter.setFont(QFont{ "PT Mono", 12 });
     painter.drawText(this->width() / 15, this->height() / 15,
         QString("FPS: %0").arg(fps, 0, 'f', 1));
-    if (sim != nullptr)
+    if (player_ != nullptr && player_->is_open())
+    {
+        painter.drawText(this->width() / 15, this->height() / 15 * 2,
+        QString("t=%0s (replay %1/%2)").arg(play_time_, 0, 'f', 3)
+            .arg(play_frame_).arg(player_->n_frames()));
+    }
+    else if (sim != nullptr)
     {
         painter.drawText(this->width() / 15, this->height() / 15 * 2,
-        QString("t=%0s").arg(sim->get_time(), 0, 'f', 3));
+        QString("t=%0s").arg(sim_thread_ != nullptr ? sim_frame_time_ : sim->get_time(), 0, 'f', 3));
     }
     painter.end();
 }
@@ -578,6 +610,7 @@ void RenderingWidget::ReadScene()
     QTextCodec::setCodecForLocale(code);
     QByteArray byfilename = filename.toLocal8Bit();
 
+    StopSimulation();
     scene.open(filename);
 
     /// BRANCH: DEV_SKELETON
@@ -585,7 +618,11 @@ void RenderingWidget::ReadScene()
     /// DISABLED SIM PART.
     //sim = new SimulatorSimpleSpring(scene);
     ////sim = new SimulatorSimpleFED(scene);
+    ////sim = new SimulatorProjectiveDynamics(scene);
+    ////sim = new SimulatorCorotationalFEM(scene);
+    ////sim = new SimulatorXPBD(scene);
     //sim->init(0.0f);
+    //StartSimulation();
 
     frame = 0;
     basic_buffer_changed = true;
@@ -638,6 +675,24 @@ void RenderingWidget::ControlLineEvent(const QString &cmd_text)
             msg.log("Reload Configurations.", INFO_MSG);
             return;
         }
+        // contract "Main" into "Skeleton", or "Skeleton" further.
+        if (cmd_text == "skeleton" || cmd_text == "skel")
+        {
+            Skeleton();
+            return;
+        }
+        // "Main" offset towards "Skeleton" into "Inner", see offset.config.
+        if (cmd_text == "offset")
+        {
+            Main_Solution();
+            return;
+        }
+        // "Main", hollowed by "Inner": its moments and how it floats.
+        if (cmd_text == "mass")
+        {
+            MassAnalysis("Main");
+            return;
+        }
 
         // same as "script $cmd$"
         QFile script_file{ "./script/" + cmd_text + ".script" };
@@ -666,6 +721,60 @@ void RenderingWidget::ControlLineEvent(const QString &cmd_text)
             OpenOneMesh(o);
         else if (v == "load_skel" || v == "ls")
             Load_Skeleton(o);
+        else if (v == "tetra_order" || v == "to")
+            TetraOrderBenchmark(o);
+        else if (v == "moments")
+            MomentsBenchmark(o);
+        else if (v == "batch")
+            RunBatchOffset(o, msg);
+        else if (v == "mass")
+            MassAnalysis(o);
+        else if (v == "bvh")
+            BVHBenchmark(o);
+        else if (v == "record")
+            Record(o);
+        else if (v == "play")
+            Play(o);
+        else if (v == "checkpoint")
+            Checkpoint(o);
+        else if (v == "restore")
+            Restore(o);
+        else if (v == "pca" && cmd_size >= 3)
+        {
+            // "pca <trajectory> <output.pca>"
+            TextConfigLoader sim_config{ "./config/simulator.config" };
+            CompressAnimation(o, cmd_split[2],
+                sim_config.get_int("PCA_Components"), sim_config.get_int("PCA_Coeff_Bits"), msg);
+        }
+        else if (v == "sim")
+        {
+            if (o == "start")
+                StartSimulation();
+            else if (o == "stop")
+                StopSimulation();
+            else
+            {
+                // "sim SimulatorXPBD", (re)create the simulator of the scene.
+                auto new_sim = CreateSimulator(o, scene);
+                if (new_sim == nullptr)
+                {
+                    msg.log("unknown simulator: ", o, ERROR_MSG);
+                }
+                else
+                {
+                    StopSimulation();
+                    SafeDelete(sim);
+                    sim = new_sim;
+                    sim->init(0.0f);
+                    frame = 0;
+                    // "Deterministic": fixed steps of Thread_Time_Step, from the timer too.
+                    TextConfigLoader sim_config{ "./config/simulator.config" };
+                    bool deterministic = sim_config.get_bool("Deterministic");
+                    _set_deterministic(deterministic);
+                    sim_fixed_dt_ = deterministic ? sim_config.get_value("Thread_Time_Step") : 0.0;
+                }
+            }
+        }
         else if (v == "script" || v == "run" || v == "$")
         {
             QFile script_file{ "./script/" + o + ".script" };
@@ -797,20 +906,20 @@ void RenderingWidget::Skeleton()
     if (scene.get("Skeleton") == nullptr)
     {
         auto mesh_clone = *scene.get("Main");
-        //SkeletonSolution ss(mesh_clone.mesh(), msg);
-        //ss.skeletonize();
-        //mesh_clone.color_ = { 1.0f, 0.0f, 0.0f };
-        //mesh_clone.name_ = "Skeleton";
-        //scene.add_model(mesh_clone);
+        SkeletonSolution ss(mesh_clone.mesh(), msg);
+        ss.skeletonize();
+        mesh_clone.color_ = { 1.0f, 0.0f, 0.0f };
+        mesh_clone.name_ = "Skeleton";
+        scene.add_model(mesh_clone);
     }
     else
     {
         auto mesh_clone = *scene.get("Skeleton");
         scene.remove_model("Skeleton");
-        //SkeletonSolution ss(mesh_clone.mesh(), msg);
-        //ss.skeletonize();
-        //mesh_clone.name_ = "Skeleton";
-        //scene.add_model(mesh_clone);
+        SkeletonSolution ss(mesh_clone.mesh(), msg);
+        ss.skeletonize();
+        mesh_clone.name_ = "Skeleton";
+        scene.add_model(mesh_clone);
     }
 
     basic_buffer_changed = true;
@@ -875,6 +984,47 @@ void RenderingWidget::Render_Skeleton()
     }
 }
 
+// center of gravity red, of buoyancy blue, and the waterline, of the last
+// "mass".
+void RenderingWidget::Render_MassProperties()
+{
+    if (mass_ == nullptr || !mass_->valid() || scene.get(mass_->properties().name) == nullptr)
+        return;
+
+    const auto &prop = mass_->properties();
+    const float r = 0.02f * static_cast<float>(std::cbrt(prop.outer.volume));
+    auto cross = [this, r](const Eigen::Vector3d &c, const OpenMesh::Vec3f &color)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            OpenMesh::Vec3f p(float(c[0]), float(c[1]), float(c[2])), q = p;
+            p[axis] -= r;
+            q[axis] += r;
+            _push_vec(vbo_basic_buffer_, p);
+            _push_vec(vbo_basic_buffer_, color);
+            _push_vec(vbo_basic_buffer_, q);
+            _push_vec(vbo_basic_buffer_, color);
+        }
+    };
+    cross(prop.shell.center, { 1.0f, 0.0f, 0.0f });
+    cross(prop.floating.submerged.center, { 0.0f, 0.4f, 1.0f });
+    for (const auto &p : prop.waterline)
+    {
+        _push_vec(vbo_basic_buffer_, { float(p[0]), float(p[1]), float(p[2]) });
+        _push_vec(vbo_basic_buffer_, { 0.0f, 0.8f, 0.8f });
+    }
+}
+
+void RenderingWidget::MassAnalysis(const QString& name)
+{
+    if (mass_ == nullptr)
+        mass_.reset(new MassPropertySolution{ scene, msg });
+    mass_->analyze(name);
+
+    basic_buffer_changed = true;
+    updateGL();
+}
+
 void RenderingWidget::Load_Skeleton()
 {
     if (scene.model_number() == 0)
@@ -947,12 +1097,338 @@ void RenderingWidget::Load_Skeleton(const QString& filename)
     updateGL();
 }
 
+// run `sim` on its own thread, with the fixed step in simulator.config.
+void RenderingWidget::StartSimulation()
+{
+    if (sim == nullptr || sim_thread_ != nullptr)
+        return;
+
+    TextConfigLoader sim_config{ "./config/simulator.config" };
+    double dt = sim_config.get_value("Thread_Time_Step");
+    int substeps = sim_config.get_int("Thread_Substeps");
+    if (dt <= 0.0 || substeps <= 0)
+    {
+        msg.log("invalid Thread_Time_Step / Thread_Substeps.", ERROR_MSG);
+        return;
+    }
+    sim_frame_time_ = sim->get_time();
+    AdaptiveStepper *stepper = nullptr;
+    if (sim_config.get_bool("Adaptive_Enable") && sim_fixed_dt_ <= 0.0)
+        stepper = new AdaptiveStepper(sim);
+    sim_thread_ = new SimulationThread(sim, dt, substeps, sim_config.get_bool("Thread_Realtime"), stepper);
+    sim_thread_->start();
+    msg.log(QString("simulation thread started, dt = %0s, %1 steps per frame.")
+        .arg(dt).arg(substeps), INFO_MSG);
+}
+
+void RenderingWidget::StopSimulation()
+{
+    if (sim_thread_ == nullptr)
+        return;
+
+    sim_thread_->stop();
+    msg.log(QString("simulation thread stopped after %0 steps.")
+        .arg(sim_thread_->steps()), INFO_MSG);
+    if (auto stepper = sim_thread_->stepper())
+    {
+        msg.log(QString("adaptive: %0 rejected, dt in [%1, %2]s.")
+            .arg(stepper->rejected()).arg(stepper->dt_min_used()).arg(stepper->dt_max_used()), INFO_MSG);
+    }
+    SafeDelete(sim_thread_);
+    sim_thread_ = nullptr;
+}
+
+// "record <file>" streams the frames of `sim` to a trajectory file, "record stop" ends it.
+void RenderingWidget::Record(const QString& filename)
+{
+    if (filename == "stop")
+    {
+        msg.log(QString("%0 frames recorded.").arg(recorder_.n_frames()), INFO_MSG);
+        recorder_.close();
+        return;
+    }
+    if (sim == nullptr || sim->get_position().empty())
+    {
+        msg.log("no simulation to record.", ERROR_MSG);
+        return;
+    }
+
+    TextConfigLoader sim_config{ "./config/simulator.config" };
+    if (!recorder_.open(filename, static_cast<int>(sim->get_position().size()),
+        sim_config.get_int("Record_Keyframe_Interval"), sim_config.get_value("Record_Quant_Step")))
+    {
+        msg.log("cannot write trajectory: ", filename, ERROR_MSG);
+    }
+}
+
+// "play <file>" replays a trajectory (or a .pca animation) on the tetra bodies in a loop,
+// "play stop" ends it.
+void RenderingWidget::Play(const QString& filename)
+{
+    if (filename == "stop")
+    {
+        player_.reset();
+        return;
+    }
+
+    play_bodies_ = _gather_bodies(scene);
+    int n_vertices = 0;
+    for (auto &body : play_bodies_)
+        n_vertices += body.model->tmesh().n_vertices;
+    if (filename.endsWith(".pca"))
+        player_.reset(new AnimationPCAPlayer);
+    else
+        player_.reset(new TrajectoryPlayer);
+    if (!player_->open(filename))
+    {
+        player_.reset();
+        msg.log("cannot open trajectory: ", filename, ERROR_MSG);
+        return;
+    }
+    if (play_bodies_.empty() || n_vertices != player_->n_vertices())
+    {
+        msg.log("trajectory does not match the tetra bodies of the scene.", ERROR_MSG);
+        player_.reset();
+        return;
+    }
+    StopSimulation();
+    play_frame_ = 0;
+    msg.log(QString("replay %0 frames.").arg(player_->n_frames()), INFO_MSG);
+}
+
+// "checkpoint <file>" saves the state of `sim`, stopping its thread first.
+void RenderingWidget::Checkpoint(const QString& filename)
+{
+    if (sim == nullptr)
+    {
+        msg.log("no simulation to checkpoint.", ERROR_MSG);
+        return;
+    }
+    StopSimulation();
+    if (!sim->save_checkpoint(filename))
+    {
+        msg.log("cannot write checkpoint: ", filename, ERROR_MSG);
+        return;
+    }
+    msg.log(QString("checkpoint at t = %0s, step %1.").arg(sim->get_time()).arg(sim->step_count()), INFO_MSG);
+}
+
+// "restore <file>" goes on from a checkpoint of a simulator of the same
+// type on the same scene, e.g. after "sim <Simulator>".
+void RenderingWidget::Restore(const QString& filename)
+{
+    if (sim == nullptr)
+    {
+        msg.log("no simulation to restore into.", ERROR_MSG);
+        return;
+    }
+    StopSimulation();
+    if (!sim->load_checkpoint(filename))
+    {
+        msg.log("cannot restore checkpoint: ", filename, ERROR_MSG);
+        return;
+    }
+    sim->simulate_rebuild();
+    msg.log(QString("restored at t = %0s, step %1.").arg(sim->get_time()).arg(sim->step_count()), INFO_MSG);
+}
+
+// compare the tetra gather of a model in loaded order and Morton order,
+// the loaded order is TetGen's unless TETRA_REORDER.
+void RenderingWidget::TetraOrderBenchmark(const QString& name)
+{
+    auto model = scene.get(name);
+    if (model == nullptr || model->tmesh().n_tetras == 0)
+    {
+        msg.log("no tetra mesh: ", name, ERROR_MSG);
+        return;
+    }
+
+    auto reordered = model->tmesh().copy();
+    ReorderTetra(reordered);
+    auto before = MeasureTetraOrder(model->tmesh());
+    auto after = MeasureTetraOrder(reordered);
+    msg.log(QString("%0: %1 vertices, %2 tetras")
+        .arg(name).arg(reordered.n_vertices).arg(reordered.n_tetras), INFO_MSG);
+    msg.log(QString("%0 span %1, misses/tetra %2, %3 ns/tetra")
+        .arg(TETRA_REORDER ? "loaded:" : "tetgen:")
+        .arg(before.avg_index_span, 0, 'f', 1)
+        .arg(before.misses_per_tetra, 0, 'f', 3)
+        .arg(before.ns_per_tetra, 0, 'f', 2), INFO_MSG);
+    msg.log(QString("morton: span %0, misses/tetra %1, %2 ns/tetra")
+        .arg(after.avg_index_span, 0, 'f', 1)
+        .arg(after.misses_per_tetra, 0, 'f', 3)
+        .arg(after.ns_per_tetra, 0, 'f', 2), INFO_MSG);
+}
+
+// The moments of the shell between the model and a surface inside it, the
+// MEX path against the native one; towards "Skeleton" if it matches the
+// model, else against the normals, 5% of the bounding box in.
+void RenderingWidget::MomentsBenchmark(const QString& name)
+{
+    auto model = scene.get(name);
+    if (model == nullptr || model->mesh().n_faces() == 0)
+    {
+        msg.log("no surface mesh: ", name, ERROR_MSG);
+        return;
+    }
+    auto &mesh = model->mesh();
+    auto skel = scene.get("Skeleton");
+    const bool to_skeleton = skel != nullptr && skel->mesh().n_vertices() == mesh.n_vertices();
+    mesh.update_normals();
+
+    const int n = static_cast<int>(mesh.n_vertices());
+    Eigen::MatrixX3d outer(n, 3), directions(n, 3);
+    for (int vi = 0; vi < n; ++vi)
+    {
+        auto vh = mesh.vertex_handle(vi);
+        auto p = mesh.point(vh);
+        outer.row(vi) = Eigen::Vector3d{ p[0], p[1], p[2] };
+        Eigen::Vector3d dir;
+        if (to_skeleton)
+        {
+            auto q = skel->mesh().point(skel->mesh().vertex_handle(vi));
+            dir = Eigen::Vector3d{ q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+        }
+        else
+        {
+            auto normal = mesh.normal(vh);
+            dir = -Eigen::Vector3d{ normal[0], normal[1], normal[2] };
+        }
+        if (dir.norm() > 1e-12)
+            dir.normalize();
+        directions.row(vi) = dir;
+    }
+    std::vector<std::array<int, 3>> triangles;
+    for (auto fh : mesh.faces())
+    {
+        std::array<int, 3> face_idx;
+        int i = 0;
+        for (auto fvit = mesh.cfv_iter(fh); fvit.is_valid(); ++fvit)
+            face_idx[i++] = fvit->idx();
+        triangles.push_back(face_idx);
+    }
+    const double depth = 0.05 * (outer.colwise().maxCoeff() - outer.colwise().minCoeff()).norm();
+    Eigen::MatrixX3d inner = outer + depth * directions;
+
+    auto stat = MeasureMassMoments(inner, outer, triangles, directions, 3);
+    msg.log(QString("%0: %1 vertices, %2 triangles, %3")
+        .arg(name).arg(n).arg(triangles.size()).arg(to_skeleton ? "to skeleton" : "along normals"), INFO_MSG);
+    msg.log(QString("reference %0 ms, parallel %1 ms, fused %2 ms")
+        .arg(stat.ms_reference, 0, 'f', 2)
+        .arg(stat.ms_parallel, 0, 'f', 2)
+        .arg(stat.ms_fused, 0, 'f', 2), INFO_MSG);
+    msg.log(QString("max relative error: M %0, DmDd %1")
+        .arg(stat.max_error_M, 0, 'g', 3)
+        .arg(stat.max_error_DmDd, 0, 'g', 3), INFO_MSG);
+}
+
+// The BVH of a model: build, refit and query times against every triangle.
+// The offset check: "Inner" and "Skeleton" have to be inside the model.
+void RenderingWidget::BVHBenchmark(const QString& name)
+{
+    auto model = scene.get(name);
+    if (model == nullptr || model->mesh().n_faces() == 0)
+    {
+        msg.log("no surface mesh: ", name, ERROR_MSG);
+        return;
+    }
+    auto &mesh = model->mesh();
+    std::vector<Eigen::Vector3f> position(mesh.n_vertices());
+    for (auto vh : mesh.vertices())
+        position[vh.idx()] = vec_cast<OpenMesh::Vec3f, Eigen::Vector3f>(mesh.point(vh));
+    std::vector<std::array<int, 3>> faces;
+    for (auto fh : mesh.faces())
+    {
+        std::array<int, 3> face_idx;
+        int i = 0;
+        for (auto fvit = mesh.cfv_iter(fh); fvit.is_valid(); ++fvit)
+            face_idx[i++] = fvit->idx();
+        faces.push_back(face_idx);
+    }
+
+    auto stat = MeasureMeshBVH(position, faces, 10000);
+    msg.log(QString("%0: %1 triangles, %2 nodes (%3 KB), %4 leaves, depth %5, SAH cost %6")
+        .arg(name).arg(faces.size()).arg(stat.n_nodes).arg(stat.n_nodes * sizeof(BVHNode) / 1024)
+        .arg(stat.n_leaves).arg(stat.depth).arg(stat.sah_cost, 0, 'f', 1), INFO_MSG);
+    msg.log(QString("build %0 ms, refit %1 ms").arg(stat.ms_build, 0, 'f', 2).arg(stat.ms_refit, 0, 'f', 2), INFO_MSG);
+    msg.log(QString("ray %0 ns (all triangles %1 ns), closest point %2 ns")
+        .arg(stat.ns_per_ray, 0, 'f', 0).arg(stat.ns_per_ray_brute, 0, 'f', 0)
+        .arg(stat.ns_per_closest, 0, 'f', 0), INFO_MSG);
+
+    const auto &bvh = model->bvh();
+    for (const QString &other_name : { QString("Inner"), QString("Skeleton") })
+    {
+        auto other = scene.get(other_name);
+        if (other == nullptr || other_name == name)
+            continue;
+        // into the model's own coordinates.
+        const QVector3D shift = other->position_ - model->position_;
+        const Eigen::Vector3f offset{ shift[0], shift[1], shift[2] };
+        auto &other_mesh = other->mesh();
+        const int n = static_cast<int>(other_mesh.n_vertices());
+        int outside = 0;
+        float nearest = std::numeric_limits<float>::max();
+        for (auto vh : other_mesh.vertices())
+        {
+            Eigen::Vector3f p = vec_cast<OpenMesh::Vec3f, Eigen::Vector3f>(other_mesh.point(vh)) + offset;
+            if (!bvh.inside(p))
+                ++outside;
+            ClosestHit hit;
+            if (bvh.closest(p, nearest, hit))
+                nearest = hit.distance;
+        }
+        msg.log(QString("%0: %1 of %2 vertices outside %3, nearest %4 from it")
+            .arg(other_name).arg(outside).arg(n).arg(name).arg(nearest, 0, 'g', 4),
+            outside == 0 ? INFO_MSG : ERROR_MSG);
+    }
+}
+
+// The nearest visible model under pixel (x, y), by the BVH of each.
+void RenderingWidget::Pick(int x, int y)
+{
+    const float aspect = float(width()) / float(height());
+    const float tan_half = std::tan(45.0f / 2.0f * PI / 180.0f);
+    const float nx = 2.0f * x / width() - 1.0f;
+    const float ny = 1.0f - 2.0f * y / height();
+    const QVector3D d = camera_.direction() * -1.0f
+        + camera_.right() * (nx * tan_half * aspect) + camera_.up() * (ny * tan_half);
+    const QVector3D o = camera_.position();
+
+    std::shared_ptr<OpenGLMesh> picked;
+    RayHit picked_hit;
+    float best = std::numeric_limits<float>::max();
+    for (auto &model : scene.models())
+    {
+        if (model->hidden_ || model->mesh().n_faces() == 0)
+            continue;
+        const QVector3D local = o - model->position_;
+        const Eigen::Vector3f origin{ local[0], local[1], local[2] };
+        RayHit hit;
+        if (model->bvh().raycast(origin, Eigen::Vector3f{ d[0], d[1], d[2] }, best, hit))
+        {
+            best = hit.t;
+            picked = model;
+            picked_hit = hit;
+        }
+    }
+    if (picked == nullptr)
+    {
+        msg.log("nothing picked.", INFO_MSG);
+        return;
+    }
+    const QVector3D p = o + d * best;
+    msg.log(QString("picked %0, triangle %1 at (%2, %3, %4)").arg(picked->name_).arg(picked_hit.fi)
+        .arg(p[0], 0, 'f', 4).arg(p[1], 0, 'f', 4).arg(p[2], 0, 'f', 4), INFO_MSG);
+}
+
 void RenderingWidget::Main_Solution()
 {
-    //OffsetSolution os{ scene, msg };
-    //os.offset();
+    if (offset_ == nullptr)
+        offset_.reset(new OffsetSolution{ scene, msg });
+    offset_->offset();
 
-    //basic_buffer_changed = true;
+    basic_buffer_changed = true;
+    updateGL();
 }
 
 // calculate FPS,
@@ -992,10 +1468,18 @@ void RenderingWidget::timerEvent()
     // State current time as `last_time`
     last_time = QTime::currentTime();
 
+    // Replay a recorded trajectory, instead of simulating.
+    if (player_ != nullptr && player_->is_open() && player_->n_frames() > 0)
+    {
+        std::vector<Vector3f> position;
+        if (player_->frame(play_frame_, play_time_, position))
+            _apply_position(play_bodies_, position);
+        play_frame_ = (play_frame_ + 1) % player_->n_frames();
+    }
     // Screen-Shot
-    if (sim != nullptr)
+    else if (sim != nullptr)
     {
-        auto t = sim->get_time();
+        auto t = sim_thread_ != nullptr ? sim_frame_time_ : sim->get_time();
         if (SCREEN_SHOT_ENABLE &&
             frame >= SCREEN_SHOT_FRAME_BEGIN &&
             frame <= SCREEN_SHOT_FRAME_END &&
@@ -1006,7 +1490,19 @@ void RenderingWidget::timerEvent()
                 .arg("spring").arg(frame / SCREEN_SHOT_FRAME_STEP), "PNG");
             emit(operatorInfo(QString("Screen-Shot at frame %0").arg(frame / SCREEN_SHOT_FRAME_STEP)));
         }
-        sim->simulate(t + 0.0002f); // current time, in fact.
+        // the simulation thread steps on its own, paintGL takes its frames.
+        if (sim_thread_ == nullptr)
+        {
+            if (sim_fixed_dt_ > 0.0)
+            {
+                sim->step(sim_fixed_dt_);
+                sim->simulate_rebuild();
+            }
+            else
+                sim->simulate(t + 0.0002f); // current time, in fact.
+            if (recorder_.is_open())
+                recorder_.write(sim->get_time(), sim->get_position());
+        }
         frame++;
     }
 
@@ -1072,14 +1568,14 @@ void RenderingWidget::mouseMoveEvent(QMouseEvent *e)
 
 void RenderingWidget::mouseDoubleClickEvent(QMouseEvent *e)
 {
-    //switch (e->button())
-    //{
-    //case Qt::LeftButton:
-    //	break;
-    //default:
-    //	break;
-    //}
-    //updateGL();
+    switch (e->button())
+    {
+    case Qt::LeftButton:
+        Pick(e->pos().x(), e->pos().y());
+        break;
+    default:
+        break;
+    }
 }
 
 void RenderingWidget::mouseReleaseEvent(QMouseEvent *e)
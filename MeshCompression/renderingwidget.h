@@ -9,6 +9,9 @@
 #include "OpenGLMesh.h"
 #include "OpenGLScene.h"
 #include "SimulatorBase.h"
+#include "SimulationThread.h"
+#include "TrajectoryFile.h"
+#include "AnimationPCA.h"
 #include "meshprogram.h"
 #include "LayerConfig.h"
 
@@ -19,6 +22,8 @@ typedef OpenMesh::TriMesh_ArrayKernelT<>  TriMesh;
 class MainWindow;
 class CArcBall;
 class Mesh3D;
+class OffsetSolution;
+class MassPropertySolution;
 
 class RenderingWidget : public QOpenGLWidget, protected QOpenGLFunctions
 {
@@ -75,6 +80,17 @@ public slots:
     void Main_Solution();
     void OpenOneMesh();
     void OpenOneMesh(const QString &filename);
+    void TetraOrderBenchmark(const QString &name);
+    void MomentsBenchmark(const QString &name);
+    void MassAnalysis(const QString &name);
+    void BVHBenchmark(const QString &name);
+    void Pick(int x, int y);
+    void StartSimulation();
+    void StopSimulation();
+    void Record(const QString &filename);
+    void Play(const QString &filename);
+    void Checkpoint(const QString &filename);
+    void Restore(const QString &filename);
     void LayerConfigChanged(const LayerConfig &config);
 
     void ReloadConfig();
@@ -83,6 +99,7 @@ private:
     void Render_Axes();
     void Render_Indication();
     void Render_Skeleton();
+    void Render_MassProperties();
     int  GenStencil(std::vector<GLfloat> &);
 
 private slots:
@@ -151,8 +168,18 @@ private:
     bool                        light_dir_fix_;
     int                         frame;
     SimulatorBase              *sim;
+    SimulationThread           *sim_thread_;
+    double                      sim_frame_time_;
+    double                      sim_fixed_dt_;  // > 0: deterministic, the timer steps exactly this.
+    TrajectoryRecorder          recorder_;
+    std::unique_ptr<FramePlayer> player_;
+    std::vector<SimBody>        play_bodies_;
+    int                         play_frame_;
+    double                      play_time_;
 
     LayerConfig                 layer_config_;
+    std::unique_ptr<OffsetSolution> offset_;   // kept: "offset" again re-optimizes from the last result.
+    std::unique_ptr<MassPropertySolution> mass_;   // kept: drawn until the next "mass".
 };
 
 #endif // RENDERINGWIDGET_H